@@ -3,18 +3,19 @@ cmake_minimum_required(VERSION 3.20)
 
 # Required variables:
 #   RC_PARSER  = path to rc_parser executable
-#   CMD        = parse | tokens | ast
-#   INPUT      = path to .rc file used as stdin
+#   CMD        = parse | tokens | ast | serve
+#   INPUT      = path to .rc file used as stdin (serve: a requests file)
 #
 # Optional:
 #   EXTRA_ARGS = extra args string (space-separated), e.g. "--print-tree"
+#   ECHO_OUTPUT = if set, print stdout (for PASS_REGULAR_EXPRESSION)
 
 if(NOT DEFINED RC_PARSER OR RC_PARSER STREQUAL "")
   message(FATAL_ERROR "RC_PARSER not set")
 endif()
 
 if(NOT DEFINED CMD OR CMD STREQUAL "")
-  message(FATAL_ERROR "CMD not set (parse|tokens|ast)")
+  message(FATAL_ERROR "CMD not set (parse|tokens|ast|serve)")
 endif()
 
 if(NOT DEFINED INPUT OR INPUT STREQUAL "")
@@ -34,7 +35,11 @@ if(NOT EXISTS "${INPUT_NORM}")
 endif()
 
 # Build command list
-set(args "${CMD}" "--") # '--' is stdin alias in your CLI
+if(CMD STREQUAL "serve")
+  set(args "${CMD}") # serve reads its requests from stdin
+else()
+  set(args "${CMD}" "--") # '--' is stdin alias in your CLI
+endif()
 
 if(DEFINED EXTRA_ARGS AND NOT EXTRA_ARGS STREQUAL "")
   separate_arguments(extra_list NATIVE_COMMAND "${EXTRA_ARGS}")
@@ -63,3 +68,7 @@ if(NOT rv EQUAL 0)
   endif()
   message(FATAL_ERROR "Command failed with exit code ${rv}")
 endif()
+
+if(DEFINED ECHO_OUTPUT)
+  message("${out}")
+endif()
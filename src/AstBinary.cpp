@@ -0,0 +1,486 @@
+#include "AstBinary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace astbin {
+
+static constexpr char kMagic[8] = { 'R', 'C', 'A', 'S', 'T', 0, 0, 0 };
+static constexpr uint32_t kNoIdent = 0xFFFFFFFFu;
+
+// deeper nesting than this is refused (a damaged file must not blow the stack)
+static constexpr int kMaxDepth = 4096;
+
+// ---------- writing ----------
+namespace {
+
+class Encoder {
+public:
+    std::string finish() {
+        std::string out(kMagic, sizeof(kMagic));
+        put(out, kVersion);
+        put(out, static_cast<uint32_t>(names_.size()));
+        put(out, static_cast<uint32_t>(nodes_.size()));
+        for (const std::string* s : names_) {
+            put(out, static_cast<uint32_t>(s->size()));
+            out += *s;
+        }
+        out += nodes_;
+        return out;
+    }
+
+    void program(const ast::Program& p) {
+        loc(p.loc);
+        word(static_cast<uint32_t>(p.procedures.size()));
+        for (const ast::ProcDef* d : p.procedures) procDef(*d);
+        block(*p.main->body);
+        loc(p.main->loc);
+    }
+
+private:
+    std::string nodes_;
+    std::vector<const std::string*> names_;
+    std::unordered_map<const std::string*, uint32_t> index_;
+
+    static void put(std::string& out, uint32_t v) {
+        const char b[4] = { static_cast<char>(v), static_cast<char>(v >> 8),
+                            static_cast<char>(v >> 16), static_cast<char>(v >> 24) };
+        out.append(b, 4);
+    }
+
+    void word(uint64_t v) {
+        while (v >= 0x80) {
+            nodes_ += static_cast<char>(v | 0x80);
+            v >>= 7;
+        }
+        nodes_ += static_cast<char>(v);
+    }
+
+    static uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+
+    void signedWord(int64_t v) { word(zigzag(v)); }
+
+    uint32_t prevLine_ = 0;
+
+    void ident(ast::Ident id) {
+        if (id.empty()) {
+            word(kNoIdent);
+            return;
+        }
+        const std::string* s = &id.str();
+        auto it = index_.find(s);
+        if (it == index_.end()) {
+            it = index_.emplace(s, static_cast<uint32_t>(names_.size())).first;
+            names_.push_back(s);
+        }
+        word(it->second);
+    }
+
+    void idents(const ast::List<ast::Ident>& l) {
+        word(static_cast<uint32_t>(l.size()));
+        for (ast::Ident id : l) ident(id);
+    }
+
+    void loc(const ast::SourceRange& r) {
+        const int64_t dl = static_cast<int64_t>(r.start.line) - prevLine_;
+        word((zigzag(dl) << 1) | (r.file == ast::kNoFile ? 0 : 1));
+        word(r.start.col);
+        signedWord(static_cast<int64_t>(r.end.line) - r.start.line);
+        word(r.end.col);
+        prevLine_ = r.start.line;
+    }
+
+    void expr(const ast::Expr& e) {
+        if (const auto* v = std::get_if<ast::Value>(&e)) {
+            word(0);
+            word(v->kind == ast::Value::Kind::Int ? 0 : 1);
+            signedWord(v->intValue);
+            word(v->boolValue ? 1 : 0);
+            loc(v->loc);
+        } else {
+            const auto& x = std::get<ast::ExprVar>(e);
+            word(1);
+            ident(x.name);
+            loc(x.loc);
+        }
+    }
+
+    void procExpr(const ast::ProcExpr& pe) {
+        ident(pe.process);
+        expr(pe.expr);
+        loc(pe.loc);
+    }
+
+    void procVar(const ast::ProcVar& pv) {
+        ident(pv.process);
+        ident(pv.var);
+        loc(pv.loc);
+    }
+
+    void raceId(const ast::RaceId& r) {
+        ident(r.process);
+        ident(r.key);
+        loc(r.loc);
+    }
+
+    void interaction(const ast::Interaction& in) {
+        word(static_cast<uint32_t>(in.index()));
+        std::visit([&](const auto& n) {
+            using T = std::decay_t<decltype(n)>;
+            if constexpr (std::is_same_v<T, ast::Comm>) {
+                procExpr(n.from);
+                procVar(n.to);
+            } else if constexpr (std::is_same_v<T, ast::Select>) {
+                ident(n.from);
+                ident(n.to);
+                ident(n.label);
+            } else if constexpr (std::is_same_v<T, ast::Assign>) {
+                procVar(n.target);
+                expr(n.value);
+            } else if constexpr (std::is_same_v<T, ast::Race>) {
+                raceId(n.id);
+                procExpr(n.left);
+                procExpr(n.right);
+                procVar(n.target);
+            } else if constexpr (std::is_same_v<T, ast::Discharge>) {
+                raceId(n.id);
+                ident(n.source);
+                procVar(n.target);
+            }
+            loc(n.loc);
+        }, in);
+    }
+
+    void stmt(const ast::Stmt& st) {
+        word(static_cast<uint32_t>(st.index()));
+        std::visit([&](const auto& n) {
+            using T = std::decay_t<decltype(n)>;
+            if constexpr (std::is_same_v<T, ast::InteractionStmt>) {
+                interaction(n.interaction);
+            } else if constexpr (std::is_same_v<T, ast::CallStmt>) {
+                ident(n.proc);
+                idents(n.args);
+            } else if constexpr (std::is_same_v<T, ast::IfLocalStmt>) {
+                procExpr(n.condition);
+                block(*n.thenBlock);
+                block(*n.elseBlock);
+            } else if constexpr (std::is_same_v<T, ast::IfRaceStmt>) {
+                raceId(n.condition);
+                block(*n.thenBlock);
+                block(*n.elseBlock);
+            }
+            loc(n.loc);
+        }, st);
+    }
+
+    void block(const ast::Block& b) {
+        word(static_cast<uint32_t>(b.statements.size()));
+        for (const ast::Stmt* st : b.statements) stmt(*st);
+        loc(b.loc);
+    }
+
+    void procDef(const ast::ProcDef& d) {
+        ident(d.name);
+        idents(d.params);
+        block(*d.body);
+        loc(d.loc);
+    }
+};
+
+// ---------- reading ----------
+
+// thrown on anything malformed; deserialize() turns it into nullptr
+struct Corrupt {};
+
+class Decoder {
+public:
+    Decoder(std::string_view data, const std::string& file, ast::Program& into)
+        : p_(reinterpret_cast<const unsigned char*>(data.data())),
+          end_(p_ + data.size()),
+          file_(ast::SourceFiles::intern(file)),
+          prog_(into) {}
+
+    void program() {
+        if (static_cast<size_t>(end_ - p_) < sizeof(kMagic) || std::memcmp(p_, kMagic, sizeof(kMagic)) != 0) {
+            throw Corrupt{};
+        }
+        p_ += sizeof(kMagic);
+        if (fixed() != kVersion) throw Corrupt{};
+        const uint32_t nameCount = fixed();
+        const uint32_t nodeBytes = fixed();
+
+        names_.reserve(std::min<size_t>(nameCount, static_cast<size_t>(end_ - p_) / 4));
+        for (uint32_t i = 0; i < nameCount; ++i) {
+            const uint32_t len = fixed();
+            if (static_cast<size_t>(end_ - p_) < len) throw Corrupt{};
+            names_.push_back(prog_.idents.intern(std::string_view(reinterpret_cast<const char*>(p_), len)));
+            p_ += len;
+        }
+        if (static_cast<size_t>(end_ - p_) != nodeBytes) throw Corrupt{};
+
+        prog_.loc = loc();
+        const uint32_t n = count();
+        for (uint32_t i = 0; i < n; ++i) procs_.push_back(procDef());
+        prog_.procedures = prog_.arena.list(procs_);
+
+        auto* m = prog_.arena.make<ast::Main>();
+        m->body = block(0);
+        m->loc = loc();
+        prog_.main = m;
+
+        if (p_ != end_) throw Corrupt{};
+    }
+
+private:
+    const unsigned char* p_;
+    const unsigned char* const end_;
+    ast::FileId file_;
+    ast::Program& prog_;
+
+    std::vector<ast::Ident> names_;
+
+    // scratch stacks shared by the nested lists (same as FastParser)
+    std::vector<ast::ProcDef*> procs_;
+    std::vector<ast::Stmt*> stmts_;
+    std::vector<ast::Ident> idents_;
+
+    uint32_t prevLine_ = 0;
+
+    uint32_t fixed() {
+        if (end_ - p_ < 4) throw Corrupt{};
+        const uint32_t v = static_cast<uint32_t>(p_[0]) | static_cast<uint32_t>(p_[1]) << 8 |
+                           static_cast<uint32_t>(p_[2]) << 16 | static_cast<uint32_t>(p_[3]) << 24;
+        p_ += 4;
+        return v;
+    }
+
+    uint64_t varint() {
+        if (p_ < end_ && *p_ < 0x80) return *p_++; // most of them
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p_ == end_) throw Corrupt{};
+            const uint64_t b = *p_++;
+            v |= (b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        throw Corrupt{};
+    }
+
+    uint32_t word() {
+        const uint64_t v = varint();
+        if (v > 0xFFFFFFFFu) throw Corrupt{};
+        return static_cast<uint32_t>(v);
+    }
+
+    static int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+    // a list length: every element takes at least one byte
+    uint32_t count() {
+        const uint32_t n = word();
+        if (n > static_cast<size_t>(end_ - p_)) throw Corrupt{};
+        return n;
+    }
+
+    ast::Ident ident() {
+        const uint32_t i = word();
+        if (i == kNoIdent) return ast::Ident();
+        if (i >= names_.size()) throw Corrupt{};
+        return names_[i];
+    }
+
+    ast::List<ast::Ident> idents() {
+        const uint32_t n = count();
+        const size_t mark = idents_.size();
+        for (uint32_t i = 0; i < n; ++i) idents_.push_back(ident());
+        auto l = prog_.arena.list(idents_.data() + mark, n);
+        idents_.resize(mark);
+        return l;
+    }
+
+    ast::SourceRange loc() {
+        ast::SourceRange r;
+        const uint64_t first = varint();
+        r.file = (first & 1) ? file_ : ast::kNoFile;
+        r.start.line = static_cast<uint32_t>(prevLine_ + unzigzag(first >> 1));
+        r.start.col = word();
+        r.end.line = static_cast<uint32_t>(r.start.line + unzigzag(varint()));
+        r.end.col = word();
+        prevLine_ = r.start.line;
+        return r;
+    }
+
+    ast::Expr expr() {
+        const uint32_t kind = word();
+        if (kind == 0) {
+            ast::Value v;
+            const uint32_t k = word();
+            if (k > 1) throw Corrupt{};
+            v.kind = k == 0 ? ast::Value::Kind::Int : ast::Value::Kind::Bool;
+            v.intValue = static_cast<int>(unzigzag(varint()));
+            v.boolValue = word() != 0;
+            v.loc = loc();
+            return v;
+        }
+        if (kind != 1) throw Corrupt{};
+        ast::ExprVar x;
+        x.name = ident();
+        x.loc = loc();
+        return x;
+    }
+
+    ast::ProcExpr procExpr() {
+        ast::ProcExpr pe;
+        pe.process = ident();
+        pe.expr = expr();
+        pe.loc = loc();
+        return pe;
+    }
+
+    ast::ProcVar procVar() {
+        ast::ProcVar pv;
+        pv.process = ident();
+        pv.var = ident();
+        pv.loc = loc();
+        return pv;
+    }
+
+    ast::RaceId raceId() {
+        ast::RaceId r;
+        r.process = ident();
+        r.key = ident();
+        r.loc = loc();
+        return r;
+    }
+
+    // filled in place: the variants are large, copies would dominate
+    void interaction(ast::Interaction& out) {
+        switch (word()) {
+        case 0: {
+            auto& c = out.emplace<ast::Comm>();
+            c.from = procExpr();
+            c.to = procVar();
+            c.loc = loc();
+            return;
+        }
+        case 1: {
+            auto& s = out.emplace<ast::Select>();
+            s.from = ident();
+            s.to = ident();
+            s.label = ident();
+            s.loc = loc();
+            return;
+        }
+        case 2: {
+            auto& a = out.emplace<ast::Assign>();
+            a.target = procVar();
+            a.value = expr();
+            a.loc = loc();
+            return;
+        }
+        case 3: {
+            auto& r = out.emplace<ast::Race>();
+            r.id = raceId();
+            r.left = procExpr();
+            r.right = procExpr();
+            r.target = procVar();
+            r.loc = loc();
+            return;
+        }
+        case 4: {
+            auto& d = out.emplace<ast::Discharge>();
+            d.id = raceId();
+            d.source = ident();
+            d.target = procVar();
+            d.loc = loc();
+            return;
+        }
+        default:
+            throw Corrupt{};
+        }
+    }
+
+    void stmt(ast::Stmt& out, int depth) {
+        switch (word()) {
+        case 0: {
+            auto& s = out.emplace<ast::InteractionStmt>();
+            interaction(s.interaction);
+            s.loc = loc();
+            return;
+        }
+        case 1: {
+            auto& s = out.emplace<ast::CallStmt>();
+            s.proc = ident();
+            s.args = idents();
+            s.loc = loc();
+            return;
+        }
+        case 2: {
+            auto& s = out.emplace<ast::IfLocalStmt>();
+            s.condition = procExpr();
+            s.thenBlock = block(depth + 1);
+            s.elseBlock = block(depth + 1);
+            s.loc = loc();
+            return;
+        }
+        case 3: {
+            auto& s = out.emplace<ast::IfRaceStmt>();
+            s.condition = raceId();
+            s.thenBlock = block(depth + 1);
+            s.elseBlock = block(depth + 1);
+            s.loc = loc();
+            return;
+        }
+        default:
+            throw Corrupt{};
+        }
+    }
+
+    ast::Block* block(int depth) {
+        if (depth > kMaxDepth) throw Corrupt{};
+        auto* b = prog_.arena.make<ast::Block>();
+        const uint32_t n = count();
+        const size_t mark = stmts_.size();
+        for (uint32_t i = 0; i < n; ++i) {
+            ast::Stmt* st = prog_.arena.make<ast::Stmt>();
+            stmt(*st, depth);
+            stmts_.push_back(st);
+        }
+        b->statements = prog_.arena.list(stmts_.data() + mark, n);
+        stmts_.resize(mark);
+        b->loc = loc();
+        return b;
+    }
+
+    ast::ProcDef* procDef() {
+        auto* d = prog_.arena.make<ast::ProcDef>();
+        d->name = ident();
+        d->params = idents();
+        d->body = block(0);
+        d->loc = loc();
+        return d;
+    }
+};
+
+}
+
+std::string serialize(const ast::Program& program) {
+    Encoder enc;
+    enc.program(program);
+    return enc.finish();
+}
+
+std::unique_ptr<ast::Program> deserialize(std::string_view data, const std::string& file) {
+    auto prog = std::make_unique<ast::Program>();
+    try {
+        Decoder(data, file, *prog).program();
+    } catch (const Corrupt&) {
+        return nullptr;
+    }
+    return prog;
+}
+
+}
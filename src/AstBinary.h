@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "ast/Ast.h"
+
+namespace astbin {
+
+// Compact binary image of a Program (the --ast-cache files), loaded in a
+// single pass of bounds-checked reads into a fresh arena.
+//
+//   header   "RCAST\0\0\0", u32 version (kVersion), u32 ident count,
+//            u32 size of the node stream (u32: little endian)
+//   idents   (u32 len, bytes)*
+//   nodes    the Program, pre-order, every field a LEB128 varint:
+//              Program   loc, n, ProcDef*n, Main
+//              ProcDef   ident name, n, ident*n (params), Block, loc
+//              Main      Block, loc
+//              Block     n, Stmt*n, loc
+//              Stmt      kind (variant index), fields, loc; an interaction
+//                        is its variant index, fields, loc
+//              Expr      0, kind (0 int, 1 bool), int (zigzag), bool, loc
+//                        | 1, ident, loc
+//
+// An ident is an index in the ident table (0xFFFFFFFF: the empty Ident).
+// A loc is 4 varints: (zigzag(start line - previous loc's start line) << 1
+// | has file), start col, zigzag(end line - start line), end col. So most
+// fields take one byte and the image stays about as big as the source.
+// A Program always comes from one source, so the file name is not stored:
+// deserialize() takes it.
+static constexpr uint32_t kVersion = 1;
+
+std::string serialize(const ast::Program& program);
+
+// nullptr if `data` is not a well-formed version kVersion image
+std::unique_ptr<ast::Program> deserialize(std::string_view data, const std::string& file);
+
+}
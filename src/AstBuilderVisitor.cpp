@@ -8,9 +8,9 @@ std::unique_ptr<ast::Program> AstBuilderVisitor::build(RacingChoreoParser::Progr
     return buildProgram(ctx);
 }
 
-std::string AstBuilderVisitor::idText(antlr4::tree::TerminalNode* id) {
-    if (!id) return "";
-    return id->getText();
+ast::Ident AstBuilderVisitor::idText(antlr4::tree::TerminalNode* id) {
+    if (!id) return ast::Ident();
+    return prog_->idents.intern(id->getText());
 }
 
 ast::SourcePos AstBuilderVisitor::posFromToken(const antlr4::Token* tok) {
@@ -37,26 +37,31 @@ ast::SourceRange AstBuilderVisitor::locFrom(antlr4::ParserRuleContext* ctx) cons
 // ===== program =====
 std::unique_ptr<ast::Program> AstBuilderVisitor::buildProgram(RacingChoreoParser::ProgramContext* ctx) {
     auto prog = std::make_unique<ast::Program>();
+    prog_ = prog.get();
     prog->loc = locFrom(ctx);
 
+    std::vector<ast::ProcDef*> procs;
     for (auto* pd : ctx->procDef()) {
-        prog->procedures.push_back(buildProcDef(pd));
+        procs.push_back(buildProcDef(pd));
     }
+    prog->procedures = prog->arena.list(procs);
     prog->main = buildMain(ctx->mainDef());
+
+    prog_ = nullptr;
     return prog;
 }
 
 // ===== mainDef =====
-std::unique_ptr<ast::Main> AstBuilderVisitor::buildMain(RacingChoreoParser::MainDefContext* ctx) {
-    auto m = std::make_unique<ast::Main>();
+ast::Main* AstBuilderVisitor::buildMain(RacingChoreoParser::MainDefContext* ctx) {
+    auto* m = prog_->arena.make<ast::Main>();
     m->loc = locFrom(ctx);
     m->body = buildBlock(ctx->block());
     return m;
 }
 
 // ===== procDef =====
-std::unique_ptr<ast::ProcDef> AstBuilderVisitor::buildProcDef(RacingChoreoParser::ProcDefContext* ctx) {
-    auto p = std::make_unique<ast::ProcDef>();
+ast::ProcDef* AstBuilderVisitor::buildProcDef(RacingChoreoParser::ProcDefContext* ctx) {
+    auto* p = prog_->arena.make<ast::ProcDef>();
     p->loc = locFrom(ctx);
     p->name = buildProcName(ctx->procName());
     p->params = buildProcParams(ctx->procParams());
@@ -65,53 +70,51 @@ std::unique_ptr<ast::ProcDef> AstBuilderVisitor::buildProcDef(RacingChoreoParser
 }
 
 // ===== procParams / procArgs =====
-std::vector<ast::Process> AstBuilderVisitor::buildProcParams(RacingChoreoParser::ProcParamsContext* ctx) {
+ast::List<ast::Process> AstBuilderVisitor::buildProcParams(RacingChoreoParser::ProcParamsContext* ctx) {
     std::vector<ast::Process> res;
     for (auto* pr : ctx->process()) {
         res.push_back(buildProcess(pr));
     }
-    return res;
+    return prog_->arena.list(res);
 }
 
-std::vector<ast::Process> AstBuilderVisitor::buildProcArgs(RacingChoreoParser::ProcArgsContext* ctx) {
+ast::List<ast::Process> AstBuilderVisitor::buildProcArgs(RacingChoreoParser::ProcArgsContext* ctx) {
     std::vector<ast::Process> res;
     for (auto* pr : ctx->process()) {
         res.push_back(buildProcess(pr));
     }
-    return res;
+    return prog_->arena.list(res);
 }
 
 // ===== block =====
-std::unique_ptr<ast::Block> AstBuilderVisitor::buildBlock(RacingChoreoParser::BlockContext* ctx) {
-    auto b = std::make_unique<ast::Block>();
+ast::Block* AstBuilderVisitor::buildBlock(RacingChoreoParser::BlockContext* ctx) {
+    auto* b = prog_->arena.make<ast::Block>();
     b->loc = locFrom(ctx);
+    std::vector<ast::Stmt*> stmts;
     for (auto* s : ctx->stmt()) {
-        b->statements.push_back(buildStmt(s));
+        stmts.push_back(buildStmt(s));
     }
+    b->statements = prog_->arena.list(stmts);
     return b;
 }
 
 // ===== stmt =====
-std::unique_ptr<ast::Stmt> AstBuilderVisitor::buildStmt(RacingChoreoParser::StmtContext* ctx) {
+ast::Stmt* AstBuilderVisitor::buildStmt(RacingChoreoParser::StmtContext* ctx) {
     if (ctx->interactionStmt()) {
         ast::InteractionStmt is = buildInteractionStmt(ctx->interactionStmt());
-        auto st = ast::Stmt{ std::move(is) };
-        return std::make_unique<ast::Stmt>(std::move(st));
+        return prog_->arena.make<ast::Stmt>(std::move(is));
     }
     if (ctx->callStmt()) {
         ast::CallStmt cs = buildCallStmt(ctx->callStmt());
-        auto st = ast::Stmt{ std::move(cs) };
-        return std::make_unique<ast::Stmt>(std::move(st));
+        return prog_->arena.make<ast::Stmt>(std::move(cs));
     }
     if (ctx->ifLocalStmt()) {
         ast::IfLocalStmt s = buildIfLocalStmt(ctx->ifLocalStmt());
-        auto st = ast::Stmt{ std::move(s) };
-        return std::make_unique<ast::Stmt>(std::move(st));
+        return prog_->arena.make<ast::Stmt>(std::move(s));
     }
     if (ctx->ifRaceStmt()) {
         ast::IfRaceStmt s = buildIfRaceStmt(ctx->ifRaceStmt());
-        auto st = ast::Stmt{ std::move(s) };
-        return std::make_unique<ast::Stmt>(std::move(st));
+        return prog_->arena.make<ast::Stmt>(std::move(s));
     }
 
     throw std::runtime_error("Unknown stmt");
@@ -255,7 +258,7 @@ ast::RaceId AstBuilderVisitor::buildRaceId(RacingChoreoParser::RaceIdContext* ct
     ast::RaceId id;
     id.loc = locFrom(ctx);
     id.process = buildProcess(ctx->process());
-    id.key = ctx->raceKey()->getText();
+    id.key = prog_->idents.intern(ctx->raceKey()->getText());
     return id;
 }
 
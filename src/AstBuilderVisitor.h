@@ -11,16 +11,17 @@
 
 class AstBuilderVisitor final : public RacingChoreoBaseVisitor {
 public:
-    explicit AstBuilderVisitor(std::string file = "<unknown>")
-        : file_(std::move(file)) {}
+    explicit AstBuilderVisitor(const std::string& file = "<unknown>")
+        : file_(ast::SourceFiles::intern(file)) {}
 
     // entry point comodo: costruisce l'AST da un parse tree program()
     std::unique_ptr<ast::Program> build(RacingChoreoParser::ProgramContext* ctx);
 
 private:
-    std::string file_;
+    ast::FileId file_;
+    ast::Program* prog_ = nullptr; // program being built: owns arena and identifiers
 
-    static std::string idText(antlr4::tree::TerminalNode* id);
+    ast::Ident idText(antlr4::tree::TerminalNode* id);
 
     // location helpers
     ast::SourceRange locFrom(antlr4::ParserRuleContext* ctx) const;
@@ -28,11 +29,11 @@ private:
 
     // ---- build functions (mappano 1-1 le parser rules) ----
     std::unique_ptr<ast::Program> buildProgram(RacingChoreoParser::ProgramContext* ctx);
-    std::unique_ptr<ast::Main>    buildMain(RacingChoreoParser::MainDefContext* ctx);
-    std::unique_ptr<ast::ProcDef> buildProcDef(RacingChoreoParser::ProcDefContext* ctx);
-    std::unique_ptr<ast::Block>   buildBlock(RacingChoreoParser::BlockContext* ctx);
+    ast::Main*    buildMain(RacingChoreoParser::MainDefContext* ctx);
+    ast::ProcDef* buildProcDef(RacingChoreoParser::ProcDefContext* ctx);
+    ast::Block*   buildBlock(RacingChoreoParser::BlockContext* ctx);
 
-    std::unique_ptr<ast::Stmt> buildStmt(RacingChoreoParser::StmtContext* ctx);
+    ast::Stmt* buildStmt(RacingChoreoParser::StmtContext* ctx);
 
     ast::CallStmt     buildCallStmt(RacingChoreoParser::CallStmtContext* ctx);
     ast::IfLocalStmt  buildIfLocalStmt(RacingChoreoParser::IfLocalStmtContext* ctx);
@@ -52,8 +53,8 @@ private:
     ast::Expr     buildExpr(RacingChoreoParser::ExprContext* ctx);
     ast::RaceId   buildRaceId(RacingChoreoParser::RaceIdContext* ctx);
 
-    std::vector<ast::Process> buildProcParams(RacingChoreoParser::ProcParamsContext* ctx);
-    std::vector<ast::Process> buildProcArgs(RacingChoreoParser::ProcArgsContext* ctx);
+    ast::List<ast::Process> buildProcParams(RacingChoreoParser::ProcParamsContext* ctx);
+    ast::List<ast::Process> buildProcArgs(RacingChoreoParser::ProcArgsContext* ctx);
 
     // leaf rules
     ast::Process  buildProcess(RacingChoreoParser::ProcessContext* ctx);
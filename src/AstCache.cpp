@@ -0,0 +1,74 @@
+#include "AstCache.h"
+
+uint64_t AstCache::hash(std::string_view text) {
+    // FNV-1a, 64 bit
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+std::string AstCache::key(const std::string& name, std::string_view text, int variant) {
+    std::string k = std::to_string(variant);
+    k += ':';
+    k += std::to_string(text.size());
+    k += ':';
+    k += std::to_string(hash(text));
+    k += ':';
+    k += name;
+    return k;
+}
+
+AstCache::Entry AstCache::find(const std::string& name, std::string_view text, int variant) {
+    const std::string k = key(name, text, variant);
+
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = index_.find(k);
+    if (it == index_.end()) {
+        ++misses_;
+        return {};
+    }
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->entry;
+}
+
+void AstCache::insert(const std::string& name, std::string_view text, int variant, Entry entry) {
+    if (!entry.program) return;
+
+    Slot slot;
+    slot.key = key(name, text, variant);
+    slot.bytes = entry.program->arena.bytesReserved();
+    slot.entry = std::move(entry);
+    if (slot.bytes > maxBytes_) return; // would evict everything else
+
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = index_.find(slot.key);
+    if (it != index_.end()) {
+        bytes_ -= it->second->bytes;
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+
+    bytes_ += slot.bytes;
+    lru_.push_front(std::move(slot));
+    index_[lru_.front().key] = lru_.begin();
+
+    while (bytes_ > maxBytes_ && !lru_.empty()) {
+        bytes_ -= lru_.back().bytes;
+        index_.erase(lru_.back().key);
+        lru_.pop_back();
+    }
+}
+
+AstCache::Stats AstCache::stats() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    Stats s;
+    s.hits = hits_;
+    s.misses = misses_;
+    s.entries = lru_.size();
+    s.bytes = bytes_;
+    return s;
+}
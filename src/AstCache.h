@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "ast/Ast.h"
+
+// In-memory cache of parsed programs, keyed by source name + a 64-bit hash
+// of the source text (the name is part of the key because it ends up in
+// every SourceRange). Only syntactically valid programs are stored; they
+// are shared read-only between callers. Evicts least recently used entries
+// once the arenas of the cached programs exceed the byte budget.
+//
+// `variant` separates entries built under different settings (e.g. the
+// --parser-mode, which decides the reported parser stage).
+//
+// Thread-safe.
+class AstCache final {
+public:
+    struct Entry {
+        std::shared_ptr<const ast::Program> program;
+        std::string stage; // parser stage that produced it
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    explicit AstCache(size_t maxBytes = 256u << 20) : maxBytes_(maxBytes) {}
+
+    static uint64_t hash(std::string_view text);
+
+    // nullptr program on a miss
+    Entry find(const std::string& name, std::string_view text, int variant);
+    void insert(const std::string& name, std::string_view text, int variant, Entry entry);
+
+    Stats stats() const;
+
+private:
+    struct Slot {
+        std::string key;
+        Entry entry;
+        size_t bytes = 0;
+    };
+
+    size_t maxBytes_;
+
+    mutable std::mutex mu_;
+    std::list<Slot> lru_; // most recently used first
+    std::unordered_map<std::string, std::list<Slot>::iterator> index_;
+    size_t bytes_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+
+    static std::string key(const std::string& name, std::string_view text, int variant);
+};
@@ -0,0 +1,77 @@
+#include "AstDiskCache.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include "AstBinary.h"
+#include "AstCache.h"
+#include "SourceText.h"
+
+namespace fs = std::filesystem;
+
+static std::string hex64(uint64_t v) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+    return buf;
+}
+
+AstDiskCache::AstDiskCache(std::string dir, std::string toolVersion)
+    : dir_(std::move(dir)), toolVersion_(std::move(toolVersion)) {
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (!fs::is_directory(dir_, ec)) throw std::runtime_error("Cannot create AST cache directory: " + dir_);
+}
+
+std::string AstDiskCache::pathFor(std::string_view text) const {
+    // version of the tool and of the image format, then the text
+    const std::string salt = toolVersion_ + "/" + std::to_string(astbin::kVersion) + "/" +
+                             hex64(AstCache::hash(text));
+    return (fs::path(dir_) / (hex64(AstCache::hash(salt)) + "-" + std::to_string(text.size()) + ".rcast")).string();
+}
+
+std::unique_ptr<ast::Program> AstDiskCache::load(std::string_view text, const std::string& file) const {
+    const std::string path = pathFor(text);
+    std::error_code ec;
+    if (!fs::is_regular_file(path, ec)) return nullptr;
+
+    try {
+        const SourceText image = SourceText::fromFile(path);
+        return astbin::deserialize(image.text(), file);
+    } catch (const std::exception&) {
+        return nullptr; // removed meanwhile, unreadable: a miss
+    }
+}
+
+void AstDiskCache::store(std::string_view text, const ast::Program& program) const {
+    static std::atomic<uint64_t> counter{ 0 };
+
+    const std::string path = pathFor(text);
+    const std::string tmp = path + ".tmp" +
+        std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+        std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "." +
+        std::to_string(counter++);
+
+    const std::string image = astbin::serialize(program);
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return;
+        out.write(image.data(), static_cast<std::streamsize>(image.size()));
+        if (!out) {
+            out.close();
+            std::error_code ec;
+            fs::remove(tmp, ec);
+            return;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) fs::remove(tmp, ec);
+}
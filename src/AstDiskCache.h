@@ -0,0 +1,33 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "ast/Ast.h"
+
+// On-disk cache of parsed programs (--ast-cache DIR): one astbin image per
+// source text, named after the tool version and a hash of the text, so a
+// new release or an edited file simply misses. The source name is not part
+// of the key: the same text under another path loads with that path in
+// its locations.
+//
+// Files are written under a temporary name and renamed into place, so
+// concurrent runs (and --batch threads) never read a partial image;
+// unreadable or damaged files count as misses and get rewritten.
+class AstDiskCache final {
+public:
+    // creates `dir` if needed; throws std::runtime_error if it cannot
+    AstDiskCache(std::string dir, std::string toolVersion);
+
+    // nullptr on a miss
+    std::unique_ptr<ast::Program> load(std::string_view text, const std::string& file) const;
+
+    // best effort: a cache that cannot be written is just a slower cache
+    void store(std::string_view text, const ast::Program& program) const;
+
+    std::string pathFor(std::string_view text) const;
+
+private:
+    std::string dir_;
+    std::string toolVersion_;
+};
@@ -1,262 +1,223 @@
 #include "AstJson.h"
-#include "Json.h"
 
 #include <sstream>
 #include <variant>
-#include <memory>
-
-using std::string;
 
 namespace astjson {
 
-// ---------- helpers: serialize leaf/nodes to string using json::Writer ----------
-static string serializeExpr(const ast::Expr& e);
-static string serializeProcExpr(const ast::ProcExpr& e);
-static string serializeProcVar(const ast::ProcVar& v);
-static string serializeRaceId(const ast::RaceId& id);
-static string serializeInteraction(const ast::Interaction& in);
-static string serializeStmt(const ast::Stmt& st);
-static string serializeBlock(const ast::Block& b);
-static string serializeMain(const ast::Main& m);
-static string serializeProcDef(const ast::ProcDef& p);
-
-static string serializeLoc(const ast::SourceRange& loc) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
-    w.beginObject();
-    w.keyString("file", loc.file);
-    w.keyInt("line", static_cast<int>(loc.start.line));
-    w.keyInt("col", static_cast<int>(loc.start.col));
-    w.endObject();
-    return ss.str();
-}
+namespace {
 
-static string serializeExpr(const ast::Expr& e) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
+// One pass over the tree, straight into the Writer. Every node is a
+// detached object (json::Writer::beginDetachedObject): the layout of the
+// first serializer, which built each node as a string with a Writer of
+// its own and spliced it into its parent, and that `ast --json` keeps.
+class Emitter final {
+public:
+    explicit Emitter(json::Writer& w) : w_(w) {}
 
-    w.beginObject();
-    std::visit([&](auto&& node) {
-        using T = std::decay_t<decltype(node)>;
-        if constexpr (std::is_same_v<T, ast::ExprVar>) {
-            w.keyString("kind", "Var");
-            w.keyString("name", node.name);
-        } else if constexpr (std::is_same_v<T, ast::Value>) {
-            w.keyString("kind", "Value");
-            if (node.kind == ast::Value::Kind::Int) {
-                w.keyString("type", "int");
-                w.keyInt("value", node.intValue);
-            } else {
-                w.keyString("type", "bool");
-                w.keyBool("value", node.boolValue);
-            }
-        }
-    }, e);
-    // Expr non ha loc nel tuo AST: quindi niente "loc" qui
-    w.endObject();
-    return ss.str();
-}
-
-static string serializeProcExpr(const ast::ProcExpr& e) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
+    void program(const ast::Program& program) {
+        w_.keyString("kind", "Program");
 
-    w.beginObject();
-    w.keyString("kind", "ProcExpr");
-    w.keyString("process", e.process);
-    w.keyRaw("expr", serializeExpr(e.expr));
-    w.keyRaw("loc", serializeLoc(e.loc));
-    w.endObject();
+        w_.beginArray("procedures");
+        for (const auto& p : program.procedures) {
+            w_.elementObjectBegin();
+            procDef("node", *p);
+            w_.elementObjectEnd();
+        }
+        w_.endArray();
 
-    return ss.str();
-}
+        const int outer = w_.beginDetachedObject("main");
+        w_.keyString("kind", "Main");
+        block("body", *program.main->body);
+        loc(program.main->loc);
+        w_.endDetachedObject(outer);
 
-static string serializeProcVar(const ast::ProcVar& v) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
+        loc(program.loc);
+    }
 
-    w.beginObject();
-    w.keyString("kind", "ProcVar");
-    w.keyString("process", v.process);
-    w.keyString("var", v.var);
-    w.keyRaw("loc", serializeLoc(v.loc));
-    w.endObject();
+private:
+    json::Writer& w_;
 
-    return ss.str();
-}
+    void loc(const ast::SourceRange& loc) {
+        const int outer = w_.beginDetachedObject("loc");
+        w_.keyString("file", loc.fileName());
+        w_.keyInt("line", static_cast<int>(loc.start.line));
+        w_.keyInt("col", static_cast<int>(loc.start.col));
+        w_.endDetachedObject(outer);
+    }
 
-static string serializeRaceId(const ast::RaceId& id) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
+    void expr(const char* key, const ast::Expr& e) {
+        const int outer = w_.beginDetachedObject(key);
+        std::visit([&](auto&& node) {
+            using T = std::decay_t<decltype(node)>;
+            if constexpr (std::is_same_v<T, ast::ExprVar>) {
+                w_.keyString("kind", "Var");
+                w_.keyString("name", node.name);
+            } else if constexpr (std::is_same_v<T, ast::Value>) {
+                w_.keyString("kind", "Value");
+                if (node.kind == ast::Value::Kind::Int) {
+                    w_.keyString("type", "int");
+                    w_.keyInt("value", node.intValue);
+                } else {
+                    w_.keyString("type", "bool");
+                    w_.keyBool("value", node.boolValue);
+                }
+            }
+        }, e);
+        // Expr non ha loc nel tuo AST: quindi niente "loc" qui
+        w_.endDetachedObject(outer);
+    }
 
-    w.beginObject();
-    w.keyString("kind", "RaceId");
-    w.keyString("process", id.process);
-    w.keyString("key", id.key);
-    w.keyRaw("loc", serializeLoc(id.loc));
-    w.endObject();
+    void procExpr(const char* key, const ast::ProcExpr& e) {
+        const int outer = w_.beginDetachedObject(key);
+        w_.keyString("kind", "ProcExpr");
+        w_.keyString("process", e.process);
+        expr("expr", e.expr);
+        loc(e.loc);
+        w_.endDetachedObject(outer);
+    }
 
-    return ss.str();
-}
+    void procVar(const char* key, const ast::ProcVar& v) {
+        const int outer = w_.beginDetachedObject(key);
+        w_.keyString("kind", "ProcVar");
+        w_.keyString("process", v.process);
+        w_.keyString("var", v.var);
+        loc(v.loc);
+        w_.endDetachedObject(outer);
+    }
 
-static string serializeInteraction(const ast::Interaction& in) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
+    void raceId(const char* key, const ast::RaceId& id) {
+        const int outer = w_.beginDetachedObject(key);
+        w_.keyString("kind", "RaceId");
+        w_.keyString("process", id.process);
+        w_.keyString("key", id.key);
+        loc(id.loc);
+        w_.endDetachedObject(outer);
+    }
 
-    w.beginObject();
-    std::visit([&](auto&& node) {
-        using T = std::decay_t<decltype(node)>;
-
-        if constexpr (std::is_same_v<T, ast::Comm>) {
-            w.keyString("kind", "Comm");
-            w.keyRaw("from", serializeProcExpr(node.from));
-            w.keyRaw("to", serializeProcVar(node.to));
-            w.keyRaw("loc", serializeLoc(node.loc));
-        } else if constexpr (std::is_same_v<T, ast::Select>) {
-            w.keyString("kind", "Select");
-            w.keyString("from", node.from);
-            w.keyString("to", node.to);
-            w.keyString("label", node.label);
-            w.keyRaw("loc", serializeLoc(node.loc));
-        } else if constexpr (std::is_same_v<T, ast::Assign>) {
-            w.keyString("kind", "Assign");
-            w.keyRaw("target", serializeProcVar(node.target));
-            w.keyRaw("value", serializeExpr(node.value));
-            w.keyRaw("loc", serializeLoc(node.loc));
-        } else if constexpr (std::is_same_v<T, ast::Race>) {
-            w.keyString("kind", "Race");
-            w.keyRaw("id", serializeRaceId(node.id));
-            w.keyRaw("left", serializeProcExpr(node.left));
-            w.keyRaw("right", serializeProcExpr(node.right));
-            w.keyRaw("target", serializeProcVar(node.target));
-            w.keyRaw("loc", serializeLoc(node.loc));
-        } else if constexpr (std::is_same_v<T, ast::Discharge>) {
-            w.keyString("kind", "Discharge");
-            w.keyRaw("id", serializeRaceId(node.id));
-            w.keyString("source", node.source);
-            w.keyRaw("target", serializeProcVar(node.target));
-            w.keyRaw("loc", serializeLoc(node.loc));
-        }
-    }, in);
-    w.endObject();
+    void interaction(const char* key, const ast::Interaction& in) {
+        const int outer = w_.beginDetachedObject(key);
+        std::visit([&](auto&& node) {
+            using T = std::decay_t<decltype(node)>;
+
+            if constexpr (std::is_same_v<T, ast::Comm>) {
+                w_.keyString("kind", "Comm");
+                procExpr("from", node.from);
+                procVar("to", node.to);
+                loc(node.loc);
+            } else if constexpr (std::is_same_v<T, ast::Select>) {
+                w_.keyString("kind", "Select");
+                w_.keyString("from", node.from);
+                w_.keyString("to", node.to);
+                w_.keyString("label", node.label);
+                loc(node.loc);
+            } else if constexpr (std::is_same_v<T, ast::Assign>) {
+                w_.keyString("kind", "Assign");
+                procVar("target", node.target);
+                expr("value", node.value);
+                loc(node.loc);
+            } else if constexpr (std::is_same_v<T, ast::Race>) {
+                w_.keyString("kind", "Race");
+                raceId("id", node.id);
+                procExpr("left", node.left);
+                procExpr("right", node.right);
+                procVar("target", node.target);
+                loc(node.loc);
+            } else if constexpr (std::is_same_v<T, ast::Discharge>) {
+                w_.keyString("kind", "Discharge");
+                raceId("id", node.id);
+                w_.keyString("source", node.source);
+                procVar("target", node.target);
+                loc(node.loc);
+            }
+        }, in);
+        w_.endDetachedObject(outer);
+    }
 
-    return ss.str();
-}
+    void stmt(const char* key, const ast::Stmt& st) {
+        const int outer = w_.beginDetachedObject(key);
+        std::visit([&](auto&& node) {
+            using T = std::decay_t<decltype(node)>;
+
+            if constexpr (std::is_same_v<T, ast::InteractionStmt>) {
+                w_.keyString("kind", "InteractionStmt");
+                interaction("interaction", node.interaction);
+                loc(node.loc);
+            } else if constexpr (std::is_same_v<T, ast::CallStmt>) {
+                w_.keyString("kind", "CallStmt");
+                w_.keyString("proc", node.proc);
+
+                w_.beginArray("args");
+                for (const auto& a : node.args) w_.elementString(a);
+                w_.endArray();
+
+                loc(node.loc);
+            } else if constexpr (std::is_same_v<T, ast::IfLocalStmt>) {
+                w_.keyString("kind", "IfLocalStmt");
+                procExpr("condition", node.condition);
+                block("then", *node.thenBlock);
+                block("else", *node.elseBlock);
+                loc(node.loc);
+            } else if constexpr (std::is_same_v<T, ast::IfRaceStmt>) {
+                w_.keyString("kind", "IfRaceStmt");
+                raceId("condition", node.condition);
+                block("then", *node.thenBlock);
+                block("else", *node.elseBlock);
+                loc(node.loc);
+            }
+        }, st);
+        w_.endDetachedObject(outer);
+    }
 
-static string serializeStmt(const ast::Stmt& st) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
+    void block(const char* key, const ast::Block& b) {
+        const int outer = w_.beginDetachedObject(key);
+        w_.keyString("kind", "Block");
 
-    w.beginObject();
-    std::visit([&](auto&& node) {
-        using T = std::decay_t<decltype(node)>;
-
-        if constexpr (std::is_same_v<T, ast::InteractionStmt>) {
-            w.keyString("kind", "InteractionStmt");
-            w.keyRaw("interaction", serializeInteraction(node.interaction));
-            w.keyRaw("loc", serializeLoc(node.loc));
-        } else if constexpr (std::is_same_v<T, ast::CallStmt>) {
-            w.keyString("kind", "CallStmt");
-            w.keyString("proc", node.proc);
-
-            w.beginArray("args");
-            for (const auto& a : node.args) w.elementString(a);
-            w.endArray();
-
-            w.keyRaw("loc", serializeLoc(node.loc));
-        } else if constexpr (std::is_same_v<T, ast::IfLocalStmt>) {
-            w.keyString("kind", "IfLocalStmt");
-            w.keyRaw("condition", serializeProcExpr(node.condition));
-            w.keyRaw("then", serializeBlock(*node.thenBlock));
-            w.keyRaw("else", serializeBlock(*node.elseBlock));
-            w.keyRaw("loc", serializeLoc(node.loc));
-        } else if constexpr (std::is_same_v<T, ast::IfRaceStmt>) {
-            w.keyString("kind", "IfRaceStmt");
-            w.keyRaw("condition", serializeRaceId(node.condition));
-            w.keyRaw("then", serializeBlock(*node.thenBlock));
-            w.keyRaw("else", serializeBlock(*node.elseBlock));
-            w.keyRaw("loc", serializeLoc(node.loc));
+        w_.beginArray("statements");
+        for (const auto& st : b.statements) {
+            w_.elementObjectBegin();
+            stmt("node", *st);
+            w_.elementObjectEnd();
         }
-    }, st);
-    w.endObject();
+        w_.endArray();
 
-    return ss.str();
-}
+        loc(b.loc);
+        w_.endDetachedObject(outer);
+    }
 
-static string serializeBlock(const ast::Block& b) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
+    void procDef(const char* key, const ast::ProcDef& p) {
+        const int outer = w_.beginDetachedObject(key);
+        w_.keyString("kind", "ProcDef");
+        w_.keyString("name", p.name);
 
-    w.beginObject();
-    w.keyString("kind", "Block");
+        w_.beginArray("params");
+        for (const auto& x : p.params) w_.elementString(x);
+        w_.endArray();
 
-    w.beginArray("statements");
-    for (const auto& st : b.statements) {
-        w.elementObjectBegin();
-        w.keyRaw("node", serializeStmt(*st));
-        w.elementObjectEnd();
+        block("body", *p.body);
+        loc(p.loc);
+        w_.endDetachedObject(outer);
     }
-    w.endArray();
+};
 
-    w.keyRaw("loc", serializeLoc(b.loc));
-    w.endObject();
-
-    return ss.str();
 }
 
-static string serializeProcDef(const ast::ProcDef& p) {
+// ---------- public entry ----------
+std::string serialize(const ast::Program& program) {
     std::ostringstream ss;
     json::Writer w(ss, 2);
 
     w.beginObject();
-    w.keyString("kind", "ProcDef");
-    w.keyString("name", p.name);
-
-    w.beginArray("params");
-    for (const auto& x : p.params) w.elementString(x);
-    w.endArray();
-
-    w.keyRaw("body", serializeBlock(*p.body));
-    w.keyRaw("loc", serializeLoc(p.loc));
+    Emitter(w).program(program);
     w.endObject();
 
     return ss.str();
 }
 
-static string serializeMain(const ast::Main& m) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
-
-    w.beginObject();
-    w.keyString("kind", "Main");
-    w.keyRaw("body", serializeBlock(*m.body));
-    w.keyRaw("loc", serializeLoc(m.loc));
-    w.endObject();
-
-    return ss.str();
+void write(json::Writer& w, const char* key, const ast::Program& program) {
+    const int outer = w.beginDetachedObject(key);
+    Emitter(w).program(program);
+    w.endDetachedObject(outer);
 }
 
-// ---------- public entry ----------
-std::string serialize(const ast::Program& program) {
-    std::ostringstream ss;
-    json::Writer w(ss, 2);
-
-    w.beginObject();
-    w.keyString("kind", "Program");
-
-    w.beginArray("procedures");
-    for (const auto& p : program.procedures) {
-        w.elementObjectBegin();
-        w.keyRaw("node", serializeProcDef(*p));
-        w.elementObjectEnd();
-    }
-    w.endArray();
-
-    w.keyRaw("main", serializeMain(*program.main));
-    w.keyRaw("loc", serializeLoc(program.loc));
-    w.endObject();
-
-    return ss.str();
 }
-
-} 
\ No newline at end of file
@@ -1,10 +1,14 @@
 #pragma once
 #include <string>
 #include "ast/Ast.h"
+#include "Json.h"
 
 namespace astjson {
 
 // Serializza l'AST Program in JSON (string già pronta, indentata).
 std::string serialize(const ast::Program& program);
 
+// Same JSON, written straight to `w` as the value of `key`, in one pass.
+void write(json::Writer& w, const char* key, const ast::Program& program);
+
 } 
\ No newline at end of file
@@ -14,7 +14,7 @@ void AstPrinter::indent(std::ostream& os, int level) {
 
 void AstPrinter::printLoc(std::ostream& os, const ast::SourceRange& loc, bool withLoc) {
     if (!withLoc) return;
-    os << " @" << loc.file << ":" << loc.start.line << ":" << loc.start.col;
+    os << " @" << loc.fileName() << ":" << loc.start.line << ":" << loc.start.col;
 }
 
 void AstPrinter::printProgram(std::ostream& os, const ast::Program& n, int level, bool withLoc) {
@@ -0,0 +1,549 @@
+#include "FastParser.h"
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+
+enum class Tok : uint8_t {
+    Id, Int,
+    Main, Proc, Call, If, Else, Race, Discharge, True, False,
+    Arrow, Assign, Dot, Comma, Colon, Semi,
+    LParen, RParen, LBrace, RBrace, LBrack, RBrack,
+    Eof
+};
+
+struct Token {
+    Tok kind = Tok::Eof;
+    uint32_t line = 0;
+    uint32_t col = 0;
+    const char* text = nullptr;
+    uint32_t len = 0;
+};
+
+// thrown on anything the fast path does not accept; parse() turns it into nullptr
+struct Bail {};
+
+inline bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+inline bool isIdChar(char c) { return isAlpha(c) || isDigit(c) || c == '_'; }
+
+// Same token rules as the ANTLR lexer: keywords win over ID on equal length,
+// WS and comments are skipped. Lines are 1-based, columns 0-based (ANTLR
+// charPositionInLine); only '\n' starts a new line.
+class Lexer final {
+public:
+    Lexer(const char* begin, const char* end, ast::SourcePos at = { 1, 0 })
+        : p_(begin), end_(end), line_(at.line), col_(at.col) {}
+
+    // position of the next character (after the last token returned)
+    ast::SourcePos pos() const { return { line_, col_ }; }
+    const char* cursor() const { return p_; }
+
+    // a // comment ran into `end` before its newline: in a larger text it
+    // may go on past it
+    bool commentCut() const { return commentCut_; }
+
+    Token next() {
+        skipTrivia();
+
+        Token t;
+        t.line = line_;
+        t.col = col_;
+        t.text = p_;
+        if (p_ == end_) return t;
+
+        const char c = *p_;
+        if (isAlpha(c)) {
+            const char* q = p_ + 1;
+            while (q != end_ && isIdChar(*q)) ++q;
+            t.len = static_cast<uint32_t>(q - p_);
+            t.kind = keyword(p_, t.len);
+        } else if (isDigit(c)) {
+            const char* q = p_ + 1;
+            while (q != end_ && isDigit(*q)) ++q;
+            t.len = static_cast<uint32_t>(q - p_);
+            t.kind = Tok::Int;
+        } else {
+            t.len = 1;
+            switch (c) {
+            case '-':
+                if (p_ + 1 == end_ || p_[1] != '>') throw Bail{};
+                t.kind = Tok::Arrow;
+                t.len = 2;
+                break;
+            case '=': t.kind = Tok::Assign; break;
+            case '.': t.kind = Tok::Dot; break;
+            case ',': t.kind = Tok::Comma; break;
+            case ':': t.kind = Tok::Colon; break;
+            case ';': t.kind = Tok::Semi; break;
+            case '(': t.kind = Tok::LParen; break;
+            case ')': t.kind = Tok::RParen; break;
+            case '{': t.kind = Tok::LBrace; break;
+            case '}': t.kind = Tok::RBrace; break;
+            case '[': t.kind = Tok::LBrack; break;
+            case ']': t.kind = Tok::RBrack; break;
+            default:
+                throw Bail{}; // token recognition error
+            }
+        }
+
+        p_ += t.len;
+        col_ += t.len;
+        return t;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+    uint32_t line_;
+    uint32_t col_;
+    bool commentCut_ = false;
+
+    // Columns count code points in ANTLR; non-ASCII text can only occur in
+    // comments, and is left to the ANTLR path instead of decoding UTF-8 here.
+    void advance(char c) {
+        if (static_cast<unsigned char>(c) >= 0x80) throw Bail{};
+        if (c == '\n') {
+            ++line_;
+            col_ = 0;
+        } else {
+            ++col_;
+        }
+    }
+
+    void skipTrivia() {
+        while (p_ != end_) {
+            const char c = *p_;
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                advance(c);
+                ++p_;
+            } else if (c == '/' && p_ + 1 != end_ && p_[1] == '/') {
+                while (p_ != end_ && *p_ != '\n' && *p_ != '\r') advance(*p_++);
+                commentCut_ = (p_ == end_);
+            } else if (c == '/' && p_ + 1 != end_ && p_[1] == '*') {
+                const char* q = p_ + 2;
+                while (q + 1 < end_ && !(q[0] == '*' && q[1] == '/')) ++q;
+                if (q + 1 >= end_) throw Bail{}; // unterminated comment
+                q += 2;
+                while (p_ != q) advance(*p_++);
+            } else {
+                return;
+            }
+        }
+    }
+
+    static Tok keyword(const char* s, uint32_t n) {
+        auto is = [&](const char* kw) { return std::strlen(kw) == n && std::memcmp(s, kw, n) == 0; };
+        switch (s[0]) {
+        case 'm': if (is("main")) return Tok::Main; break;
+        case 'p': if (is("proc")) return Tok::Proc; break;
+        case 'c': if (is("call")) return Tok::Call; break;
+        case 'i': if (is("if")) return Tok::If; break;
+        case 'e': if (is("else")) return Tok::Else; break;
+        case 'r': if (is("race")) return Tok::Race; break;
+        case 'd': if (is("discharge")) return Tok::Discharge; break;
+        case 't': if (is("true")) return Tok::True; break;
+        case 'f': if (is("false")) return Tok::False; break;
+        default: break;
+        }
+        return Tok::Id;
+    }
+};
+
+// One function per grammar rule. Every location is [first token, last
+// consumed token], exactly like ctx->getStart()/getStop() in the visitor.
+class Parser final {
+public:
+    Parser(ast::FileId file, std::string_view text)
+        : file_(file), lex_(text.data(), text.data() + text.size()) {}
+
+    // a single top-level definition, built into an existing program
+    Parser(ast::FileId file, std::string_view text, const FastParser::TopLevel& def, ast::Program& into)
+        : file_(file), lex_(text.data() + def.begin, text.data() + def.end, def.start), prog_(&into) {}
+
+    ast::ProcDef* procDefOnly() {
+        ast::ProcDef* p = procDef();
+        expect(Tok::Eof);
+        return p;
+    }
+
+    ast::Main* mainDefOnly() {
+        ast::Main* m = mainDef();
+        expect(Tok::Eof);
+        return m;
+    }
+
+    std::unique_ptr<ast::Program> program() {
+        auto prog = std::make_unique<ast::Program>();
+        prog_ = prog.get();
+        const Token start = peek();
+
+        std::vector<ast::ProcDef*> procs;
+        while (peek().kind == Tok::Proc) procs.push_back(procDef());
+        prog->procedures = prog->arena.list(procs);
+        prog->main = mainDef();
+        expect(Tok::Eof);
+
+        prog->loc = loc(start);
+        return prog;
+    }
+
+    // tokens consumed so far, EOF included (the count of ANTLR's stream)
+    size_t tokens() const { return taken_; }
+
+private:
+    ast::FileId file_;
+    Lexer lex_;
+    ast::Program* prog_ = nullptr;
+
+    // statement lists of the blocks being parsed, innermost last; reused so
+    // nested blocks do not allocate a vector each
+    std::vector<ast::Stmt*> stmts_;
+    std::vector<ast::Process> procs_;
+
+    // lookahead ring (the grammar needs at most 4 tokens: p . x = / ->)
+    static constexpr size_t kLookahead = 4;
+    Token buf_[kLookahead];
+    size_t head_ = 0;
+    size_t count_ = 0;
+    size_t taken_ = 0;
+    Token prev_;
+
+    const Token& peek(size_t k = 0) {
+        while (count_ <= k) {
+            buf_[(head_ + count_) % kLookahead] = lex_.next();
+            ++count_;
+        }
+        return buf_[(head_ + k) % kLookahead];
+    }
+
+    Token take() {
+        peek();
+        prev_ = buf_[head_];
+        head_ = (head_ + 1) % kLookahead;
+        --count_;
+        ++taken_;
+        return prev_;
+    }
+
+    Token expect(Tok kind) {
+        if (peek().kind != kind) throw Bail{};
+        return take();
+    }
+
+    ast::Ident id() {
+        const Token t = expect(Tok::Id);
+        return prog_->idents.intern(std::string_view(t.text, t.len));
+    }
+
+    ast::SourceRange loc(const Token& start) const {
+        ast::SourceRange r;
+        r.file = file_;
+        r.start.line = start.line;
+        r.start.col = start.col;
+        r.end.line = prev_.line;
+        r.end.col = prev_.col;
+        return r;
+    }
+
+    // ===== procedures =====
+    ast::Main* mainDef() {
+        auto* m = prog_->arena.make<ast::Main>();
+        const Token start = expect(Tok::Main);
+        m->body = block();
+        m->loc = loc(start);
+        return m;
+    }
+
+    ast::ProcDef* procDef() {
+        auto* p = prog_->arena.make<ast::ProcDef>();
+        const Token start = expect(Tok::Proc);
+        p->name = id();
+        expect(Tok::LParen);
+        p->params = processList();
+        expect(Tok::RParen);
+        p->body = block();
+        p->loc = loc(start);
+        return p;
+    }
+
+    // procParams / procArgs
+    ast::List<ast::Process> processList() {
+        procs_.clear();
+        procs_.push_back(id());
+        while (peek().kind == Tok::Comma) {
+            take();
+            procs_.push_back(id());
+        }
+        return prog_->arena.list(procs_);
+    }
+
+    ast::Block* block() {
+        auto* b = prog_->arena.make<ast::Block>();
+        const Token start = expect(Tok::LBrace);
+        const size_t mark = stmts_.size();
+        while (peek().kind != Tok::RBrace) {
+            ast::Stmt* st = prog_->arena.make<ast::Stmt>(stmt());
+            stmts_.push_back(st);
+        }
+        take();
+        b->statements = prog_->arena.list(stmts_.data() + mark, stmts_.size() - mark);
+        stmts_.resize(mark);
+        b->loc = loc(start);
+        return b;
+    }
+
+    // ===== statements =====
+    ast::Stmt stmt() {
+        const Token start = peek();
+        switch (start.kind) {
+        case Tok::Call: {
+            take();
+            ast::CallStmt c;
+            c.proc = id();
+            expect(Tok::LParen);
+            c.args = processList();
+            expect(Tok::RParen);
+            expect(Tok::Semi);
+            c.loc = loc(start);
+            return ast::Stmt{ std::move(c) };
+        }
+        case Tok::If:
+            // if ( p [ k ] ...  vs  if ( p . e ...
+            if (peek(3).kind == Tok::LBrack) return ast::Stmt{ ifRaceStmt() };
+            return ast::Stmt{ ifLocalStmt() };
+        default: {
+            ast::InteractionStmt s;
+            s.interaction = interaction();
+            expect(Tok::Semi);
+            s.loc = loc(start);
+            return ast::Stmt{ std::move(s) };
+        }
+        }
+    }
+
+    ast::IfLocalStmt ifLocalStmt() {
+        ast::IfLocalStmt s;
+        const Token start = expect(Tok::If);
+        expect(Tok::LParen);
+        s.condition = procExpr();
+        expect(Tok::RParen);
+        s.thenBlock = block();
+        expect(Tok::Else);
+        s.elseBlock = block();
+        s.loc = loc(start);
+        return s;
+    }
+
+    ast::IfRaceStmt ifRaceStmt() {
+        ast::IfRaceStmt s;
+        const Token start = expect(Tok::If);
+        expect(Tok::LParen);
+        s.condition = raceId();
+        expect(Tok::RParen);
+        s.thenBlock = block();
+        expect(Tok::Else);
+        s.elseBlock = block();
+        s.loc = loc(start);
+        return s;
+    }
+
+    // ===== interactions =====
+    ast::Interaction interaction() {
+        const Token start = peek();
+        switch (start.kind) {
+        case Tok::Race: {
+            take();
+            ast::Race r;
+            r.id = raceId();
+            expect(Tok::Colon);
+            r.left = procExpr();
+            expect(Tok::Comma);
+            r.right = procExpr();
+            expect(Tok::Arrow);
+            r.target = procVar();
+            r.loc = loc(start);
+            return ast::Interaction{ std::move(r) };
+        }
+        case Tok::Discharge: {
+            take();
+            ast::Discharge d;
+            d.id = raceId();
+            expect(Tok::Colon);
+            d.source = id();
+            expect(Tok::Arrow);
+            d.target = procVar();
+            d.loc = loc(start);
+            return ast::Interaction{ std::move(d) };
+        }
+        case Tok::Id:
+            break;
+        default:
+            throw Bail{};
+        }
+
+        // p -> q [l]  |  p.x = e  |  p.e -> q.x
+        if (peek(1).kind == Tok::Arrow) {
+            ast::Select s;
+            s.from = id();
+            expect(Tok::Arrow);
+            s.to = id();
+            expect(Tok::LBrack);
+            s.label = id();
+            expect(Tok::RBrack);
+            s.loc = loc(start);
+            return ast::Interaction{ std::move(s) };
+        }
+        if (peek(3).kind == Tok::Assign) {
+            ast::Assign a;
+            a.target = procVar();
+            expect(Tok::Assign);
+            a.value = expr();
+            a.loc = loc(start);
+            return ast::Interaction{ std::move(a) };
+        }
+        ast::Comm c;
+        c.from = procExpr();
+        expect(Tok::Arrow);
+        c.to = procVar();
+        c.loc = loc(start);
+        return ast::Interaction{ std::move(c) };
+    }
+
+    // ===== procExpr / procVar / expr / raceId =====
+    ast::ProcExpr procExpr() {
+        ast::ProcExpr pe;
+        const Token start = peek();
+        pe.process = id();
+        expect(Tok::Dot);
+        pe.expr = expr();
+        pe.loc = loc(start);
+        return pe;
+    }
+
+    ast::ProcVar procVar() {
+        ast::ProcVar pv;
+        const Token start = peek();
+        pv.process = id();
+        expect(Tok::Dot);
+        pv.var = id();
+        pv.loc = loc(start);
+        return pv;
+    }
+
+    ast::Expr expr() {
+        const Token t = take();
+        switch (t.kind) {
+        case Tok::Id: {
+            ast::ExprVar v;
+            v.name = prog_->idents.intern(std::string_view(t.text, t.len));
+            v.loc = loc(t);
+            return ast::Expr{ std::move(v) };
+        }
+        case Tok::Int:
+        case Tok::True:
+        case Tok::False: {
+            ast::Value val;
+            val.loc = loc(t);
+            if (t.kind == Tok::Int) {
+                val.kind = ast::Value::Kind::Int;
+                val.intValue = intValue(t);
+            } else {
+                val.kind = ast::Value::Kind::Bool;
+                val.boolValue = (t.kind == Tok::True);
+            }
+            return ast::Expr{ std::move(val) };
+        }
+        default:
+            throw Bail{};
+        }
+    }
+
+    // std::stoi semantics; out of range is left to the ANTLR path (which throws)
+    static int intValue(const Token& t) {
+        int64_t v = 0;
+        for (uint32_t i = 0; i < t.len; ++i) {
+            v = v * 10 + (t.text[i] - '0');
+            if (v > std::numeric_limits<int>::max()) throw Bail{};
+        }
+        return static_cast<int>(v);
+    }
+
+    ast::RaceId raceId() {
+        ast::RaceId r;
+        const Token start = peek();
+        r.process = id();
+        expect(Tok::LBrack);
+        r.key = id();
+        expect(Tok::RBrack);
+        r.loc = loc(start);
+        return r;
+    }
+};
+
+} // namespace
+
+bool FastParser::splitTopLevel(std::string_view text, size_t begin, size_t end, ast::SourcePos at,
+                               std::vector<TopLevel>& out, ast::SourcePos& endPos) {
+    try {
+        Lexer lex(text.data() + begin, text.data() + end, at);
+        for (;;) {
+            const Token first = lex.next();
+            if (first.kind == Tok::Eof) {
+                if (lex.commentCut() && end != text.size()) return false;
+                endPos = { first.line, first.col };
+                return true;
+            }
+            if (first.kind != Tok::Proc && first.kind != Tok::Main) return false;
+
+            TopLevel def;
+            def.begin = static_cast<size_t>(first.text - text.data());
+            def.start = { first.line, first.col };
+            def.isMain = (first.kind == Tok::Main);
+
+            // up to the '}' closing the body
+            int depth = 0;
+            for (bool opened = false; !opened || depth > 0;) {
+                const Token t = lex.next();
+                if (t.kind == Tok::Eof) return false;
+                if (t.kind == Tok::LBrace) { ++depth; opened = true; }
+                else if (t.kind == Tok::RBrace && --depth < 0) return false;
+            }
+            def.end = static_cast<size_t>(lex.cursor() - text.data());
+            def.stop = lex.pos();
+            out.push_back(def);
+        }
+    } catch (const Bail&) {
+        return false;
+    }
+}
+
+ast::ProcDef* FastParser::parseProcDef(std::string_view text, const TopLevel& def, ast::Program& program) const {
+    try {
+        return Parser(ast::SourceFiles::intern(file_), text, def, program).procDefOnly();
+    } catch (const Bail&) {
+        return nullptr;
+    }
+}
+
+ast::Main* FastParser::parseMain(std::string_view text, const TopLevel& def, ast::Program& program) const {
+    try {
+        return Parser(ast::SourceFiles::intern(file_), text, def, program).mainDefOnly();
+    } catch (const Bail&) {
+        return nullptr;
+    }
+}
+
+std::unique_ptr<ast::Program> FastParser::parse(std::string_view text, size_t* tokenCount) const {
+    try {
+        Parser parser(ast::SourceFiles::intern(file_), text);
+        auto prog = parser.program();
+        if (tokenCount) *tokenCount = parser.tokens();
+        return prog;
+    } catch (const Bail&) {
+        return nullptr;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast/Ast.h"
+
+// Hand-written lexer + recursive-descent parser for grammar/RacingChoreo.g4.
+// Builds ast::Program in a single pass, without the ANTLR CST.
+//
+// It only handles well-formed input: on the first lexical or syntax error
+// (or anything it cannot reproduce exactly, e.g. non-ASCII text, an INT
+// out of range) parse() returns nullptr and the caller re-parses with
+// ANTLR, which reports the usual diagnostics. For accepted input the AST,
+// locations included, is identical to AstBuilderVisitor's.
+class FastParser final {
+public:
+    explicit FastParser(std::string file = "<unknown>")
+        : file_(std::move(file)) {}
+
+    // tokenCount, if given, receives the number of tokens (EOF included)
+    std::unique_ptr<ast::Program> parse(std::string_view text, size_t* tokenCount = nullptr) const;
+
+    // ----- pieces for IncrementalParser -----
+    // A top-level definition, `proc ... { }` or `main { }`.
+    struct TopLevel {
+        size_t begin = 0;    // byte offset of `proc` / `main`
+        size_t end = 0;      // one past the closing '}'
+        ast::SourcePos start; // position of begin
+        ast::SourcePos stop;  // position of end
+        bool isMain = false;
+    };
+
+    // Splits text[begin, end), whose first character is at `at`, into
+    // top-level definitions (tokens only, no AST); endPos is the position
+    // of `end`. false unless the range is whole definitions separated by
+    // whitespace and comments, and no // comment reaches `end` short of the
+    // end of the text.
+    static bool splitTopLevel(std::string_view text, size_t begin, size_t end, ast::SourcePos at,
+                              std::vector<TopLevel>& out, ast::SourcePos& endPos);
+
+    // Parses one definition found by splitTopLevel into `program` (its
+    // arena and identifiers). nullptr if it is not well-formed.
+    ast::ProcDef* parseProcDef(std::string_view text, const TopLevel& def, ast::Program& program) const;
+    ast::Main* parseMain(std::string_view text, const TopLevel& def, ast::Program& program) const;
+
+private:
+    std::string file_;
+};
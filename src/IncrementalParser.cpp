@@ -0,0 +1,308 @@
+#include "IncrementalParser.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <unordered_set>
+#include <variant>
+
+namespace {
+
+// ----- moving reused definitions to other lines -----
+void shift(ast::SourceRange& r, int32_t d) {
+    r.start.line = static_cast<uint32_t>(static_cast<int32_t>(r.start.line) + d);
+    r.end.line = static_cast<uint32_t>(static_cast<int32_t>(r.end.line) + d);
+}
+
+void shiftExpr(ast::Expr& e, int32_t d) {
+    std::visit([&](auto& n) { shift(n.loc, d); }, e);
+}
+
+void shiftProcExpr(ast::ProcExpr& pe, int32_t d) {
+    shiftExpr(pe.expr, d);
+    shift(pe.loc, d);
+}
+
+void shiftBlock(ast::Block& b, int32_t d);
+
+void shiftStmt(ast::Stmt& st, int32_t d) {
+    std::visit([&](auto& node) {
+        using T = std::decay_t<decltype(node)>;
+
+        if constexpr (std::is_same_v<T, ast::InteractionStmt>) {
+            std::visit([&](auto& in) {
+                using I = std::decay_t<decltype(in)>;
+                if constexpr (std::is_same_v<I, ast::Comm>) {
+                    shiftProcExpr(in.from, d);
+                    shift(in.to.loc, d);
+                } else if constexpr (std::is_same_v<I, ast::Assign>) {
+                    shift(in.target.loc, d);
+                    shiftExpr(in.value, d);
+                } else if constexpr (std::is_same_v<I, ast::Race>) {
+                    shift(in.id.loc, d);
+                    shiftProcExpr(in.left, d);
+                    shiftProcExpr(in.right, d);
+                    shift(in.target.loc, d);
+                } else if constexpr (std::is_same_v<I, ast::Discharge>) {
+                    shift(in.id.loc, d);
+                    shift(in.target.loc, d);
+                }
+                shift(in.loc, d);
+            }, node.interaction);
+        } else if constexpr (std::is_same_v<T, ast::IfLocalStmt>) {
+            shiftProcExpr(node.condition, d);
+            shiftBlock(*node.thenBlock, d);
+            shiftBlock(*node.elseBlock, d);
+        } else if constexpr (std::is_same_v<T, ast::IfRaceStmt>) {
+            shift(node.condition.loc, d);
+            shiftBlock(*node.thenBlock, d);
+            shiftBlock(*node.elseBlock, d);
+        }
+        shift(node.loc, d);
+    }, st);
+}
+
+void shiftBlock(ast::Block& b, int32_t d) {
+    for (ast::Stmt* st : b.statements) shiftStmt(*st, d);
+    shift(b.loc, d);
+}
+
+// ----- call sites -----
+void collectCalls(const ast::Block& b, std::vector<ast::Ident>& out) {
+    for (const ast::Stmt* st : b.statements) {
+        if (const auto* c = std::get_if<ast::CallStmt>(st)) {
+            if (std::find(out.begin(), out.end(), c->proc) == out.end()) out.push_back(c->proc);
+        } else if (const auto* s = std::get_if<ast::IfLocalStmt>(st)) {
+            collectCalls(*s->thenBlock, out);
+            collectCalls(*s->elseBlock, out);
+        } else if (const auto* s = std::get_if<ast::IfRaceStmt>(st)) {
+            collectCalls(*s->thenBlock, out);
+            collectCalls(*s->elseBlock, out);
+        }
+    }
+}
+
+} // namespace
+
+IncrementalParser::IncrementalParser(std::string file)
+    : file_(file), parser_(std::move(file)) {}
+
+std::vector<ValidationError> IncrementalParser::errors() const {
+    std::vector<ValidationError> all = tableErrors_;
+    for (const auto& d : defs_) all.insert(all.end(), d.errors.begin(), d.errors.end());
+    return all;
+}
+
+bool IncrementalParser::parseDef(Def& d, std::string_view text) {
+    d.callees.clear();
+    d.errors.clear();
+    if (d.range.isMain) {
+        d.proc = nullptr;
+        d.main = parser_.parseMain(text, d.range, *program_);
+        if (!d.main) return false;
+        collectCalls(*d.main->body, d.callees);
+    } else {
+        d.main = nullptr;
+        d.proc = parser_.parseProcDef(text, d.range, *program_);
+        if (!d.proc) return false;
+        collectCalls(*d.proc->body, d.callees);
+    }
+    ++stats_.reparsed;
+    return true;
+}
+
+void IncrementalParser::validateDef(Def& d) {
+    d.errors = validator_.validateBody(d.proc ? *d.proc->body : *d.main->body);
+    ++stats_.revalidated;
+}
+
+void IncrementalParser::rebuildProgramLists() {
+    std::vector<ast::ProcDef*> procs;
+    procs.reserve(defs_.size());
+    for (const auto& d : defs_) {
+        if (d.proc) procs.push_back(d.proc);
+    }
+    program_->procedures = program_->arena.list(procs);
+    program_->main = defs_.back().main;
+}
+
+bool IncrementalParser::parseFull() {
+    stats_.full = true;
+    program_ = std::make_unique<ast::Program>();
+    defs_.clear();
+    tableErrors_.clear();
+
+    std::vector<FastParser::TopLevel> found;
+    bool ok = FastParser::splitTopLevel(text_, 0, text_.size(), { 1, 0 }, found, eof_)
+              && !found.empty() && found.back().isMain;
+    for (size_t i = 0; ok && i + 1 < found.size(); ++i) ok = !found[i].isMain;
+
+    defs_.resize(found.size());
+    for (size_t i = 0; ok && i < found.size(); ++i) {
+        defs_[i].range = found[i];
+        ok = parseDef(defs_[i], text_);
+    }
+    if (!ok) {
+        program_.reset();
+        defs_.clear();
+        return false;
+    }
+
+    rebuildProgramLists();
+    program_->loc.file = ast::SourceFiles::intern(file_);
+    program_->loc.start = defs_.front().range.start;
+    program_->loc.end = eof_;
+
+    tableErrors_ = validator_.buildProcTable(*program_);
+    for (auto& d : defs_) validateDef(d);
+
+    compactBytes_ = program_->arena.bytesReserved();
+    return true;
+}
+
+bool IncrementalParser::update(std::string text) {
+    stats_ = Stats{};
+
+    auto full = [&] {
+        text_ = std::move(text);
+        return parseFull();
+    };
+    if (!program_) return full();
+
+    const std::string_view oldText = text_;
+    const std::string_view newText = text;
+    if (oldText == newText) return true;
+
+    // the edit replaced old [pre, oldEditEnd) with new [pre, newSize - suf)
+    const size_t common = std::min(oldText.size(), newText.size());
+    const size_t pre = static_cast<size_t>(
+        std::mismatch(oldText.begin(), oldText.begin() + common, newText.begin()).first - oldText.begin());
+    const size_t suf = static_cast<size_t>(
+        std::mismatch(oldText.rbegin(), oldText.rbegin() + (common - pre), newText.rbegin()).first - oldText.rbegin());
+    const size_t oldEditEnd = oldText.size() - suf;
+    const auto toNew = [&](size_t oldOffset) { return oldOffset - oldText.size() + newText.size(); };
+
+    // Definitions [first, next) touch the edit. One starting right at
+    // oldEditEnd is included: inserted text may extend its first token.
+    size_t first = static_cast<size_t>(std::partition_point(defs_.begin(), defs_.end(),
+        [&](const Def& d) { return d.range.end <= pre; }) - defs_.begin());
+    size_t next = static_cast<size_t>(std::partition_point(defs_.begin() + first, defs_.end(),
+        [&](const Def& d) { return d.range.begin <= oldEditEnd; }) - defs_.begin());
+
+    // re-lex from the end of the last definition kept before the edit to the
+    // start of the first one kept after it
+    std::vector<FastParser::TopLevel> found;
+    ast::SourcePos endPos;
+    for (;;) {
+        const size_t regionBegin = first > 0 ? defs_[first - 1].range.end : 0;
+        const ast::SourcePos regionAt = first > 0 ? defs_[first - 1].range.stop : ast::SourcePos{ 1, 0 };
+        const size_t regionEnd = next < defs_.size() ? toNew(defs_[next].range.begin) : newText.size();
+
+        found.clear();
+        if (!FastParser::splitTopLevel(newText, regionBegin, regionEnd, regionAt, found, endPos)) return full();
+
+        // a reused definition may move to another line, but its columns
+        // must stay the same
+        if (next < defs_.size() && endPos.col != defs_[next].range.start.col) {
+            ++next;
+            continue;
+        }
+        break;
+    }
+
+    // still procDef* mainDef: main is the last definition
+    const bool mainReused = next < defs_.size();
+    if (first > 0 && defs_[first - 1].range.isMain) return full();
+    if (!mainReused && (found.empty() || !found.back().isMain)) return full();
+    for (size_t i = 0; i < found.size(); ++i) {
+        if (found[i].isMain && (mainReused || i + 1 != found.size())) return full();
+    }
+
+    std::vector<Def> fresh(found.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+        fresh[i].range = found[i];
+        if (!parseDef(fresh[i], newText)) return full();
+    }
+
+    // names whose callers have to be checked again
+    bool tableChanged = (fresh.size() != next - first);
+    for (size_t i = 0; !tableChanged && i < fresh.size(); ++i) {
+        const ast::ProcDef* a = defs_[first + i].proc;
+        const ast::ProcDef* b = fresh[i].proc;
+        tableChanged = (a == nullptr) != (b == nullptr) ||
+                       (a && (a->name != b->name || a->params.size() != b->params.size()));
+    }
+    std::unordered_set<const std::string*> changedNames;
+    if (tableChanged) {
+        for (size_t i = first; i < next; ++i) {
+            if (defs_[i].proc) changedNames.insert(&defs_[i].proc->name.str());
+        }
+        for (const auto& d : fresh) {
+            if (d.proc) changedNames.insert(&d.proc->name.str());
+        }
+    }
+
+    // definitions after the edit: new offsets, and new lines if the edit
+    // added or removed some
+    const int32_t lineDelta = mainReused
+        ? static_cast<int32_t>(endPos.line) - static_cast<int32_t>(defs_[next].range.start.line)
+        : 0;
+    for (size_t i = next; i < defs_.size(); ++i) {
+        Def& d = defs_[i];
+        d.range.begin = toNew(d.range.begin);
+        d.range.end = toNew(d.range.end);
+        if (lineDelta == 0) continue;
+
+        d.range.start.line = static_cast<uint32_t>(static_cast<int32_t>(d.range.start.line) + lineDelta);
+        d.range.stop.line = static_cast<uint32_t>(static_cast<int32_t>(d.range.stop.line) + lineDelta);
+        if (d.proc) {
+            shift(d.proc->loc, lineDelta);
+            shiftBlock(*d.proc->body, lineDelta);
+        } else {
+            shift(d.main->loc, lineDelta);
+            shiftBlock(*d.main->body, lineDelta);
+        }
+        for (auto& e : d.errors) e.line = static_cast<uint32_t>(static_cast<int32_t>(e.line) + lineDelta);
+    }
+    if (mainReused) {
+        eof_.line = static_cast<uint32_t>(static_cast<int32_t>(eof_.line) + lineDelta);
+    } else {
+        eof_ = endPos;
+    }
+
+    // splice
+    const bool sameCount = (fresh.size() == next - first);
+    const size_t freshCount = fresh.size();
+    defs_.erase(defs_.begin() + static_cast<ptrdiff_t>(first), defs_.begin() + static_cast<ptrdiff_t>(next));
+    defs_.insert(defs_.begin() + static_cast<ptrdiff_t>(first),
+                 std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+
+    if (sameCount) {
+        // procDefs come first, so definition i is procedures[i]
+        for (size_t i = first; i < first + freshCount; ++i) {
+            if (defs_[i].proc) program_->procedures[i] = defs_[i].proc;
+            else program_->main = defs_[i].main;
+        }
+    } else {
+        rebuildProgramLists();
+    }
+    program_->loc.start = defs_.front().range.start;
+    program_->loc.end = eof_;
+
+    // validation: the table when it may differ (duplicates point at
+    // locations that may have moved), then the bodies that need it
+    if (tableChanged || !tableErrors_.empty()) tableErrors_ = validator_.buildProcTable(*program_);
+    for (size_t i = 0; i < defs_.size(); ++i) {
+        Def& d = defs_[i];
+        bool redo = (i >= first && i < first + freshCount);
+        for (size_t k = 0; !redo && k < d.callees.size(); ++k) {
+            redo = changedNames.count(&d.callees[k].str()) != 0;
+        }
+        if (redo) validateDef(d);
+    }
+
+    text_ = std::move(text);
+
+    // spliced-out definitions stay in the arena until the next full parse
+    if (program_->arena.bytesReserved() > 2 * compactBytes_ + (1u << 20)) return parseFull();
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FastParser.h"
+#include "Validation.h"
+#include "ast/Ast.h"
+
+// Keeps the AST and the validation errors of one document up to date
+// across edits (editor integration, `serve` documents).
+//
+// update() diffs the new text against the previous one, re-lexes only the
+// stretch between the nearest unchanged top-level definitions, re-parses
+// the procDef/mainDef found there and splices them into the Program. The
+// definitions after the edit are reused; when the edit adds or removes
+// lines their locations are shifted in place. Validation is redone for the
+// re-parsed bodies and, when a procedure's name or arity changed, for the
+// bodies calling it; the other bodies keep their errors.
+//
+// The result is the same Program and error list that FastParser + Validator
+// produce for the whole text. Input FastParser does not accept (syntax
+// errors included) makes update() return false; the caller then goes
+// through the regular pipeline for diagnostics.
+class IncrementalParser final {
+public:
+    struct Stats {
+        bool full = false;      // everything was (re)parsed
+        size_t reparsed = 0;    // top-level definitions parsed by this update
+        size_t revalidated = 0; // bodies validated by this update
+    };
+
+    explicit IncrementalParser(std::string file = "<unknown>");
+
+    bool update(std::string text);
+
+    // valid after a successful update()
+    const ast::Program& program() const { return *program_; }
+    std::vector<ValidationError> errors() const;
+
+    const Stats& lastStats() const { return stats_; }
+
+private:
+    struct Def {
+        FastParser::TopLevel range;
+        ast::ProcDef* proc = nullptr; // null for main
+        ast::Main* main = nullptr;
+        std::vector<ast::Ident> callees; // distinct procedures called by the body
+        std::vector<ValidationError> errors;
+    };
+
+    std::string file_;
+    FastParser parser_;
+    Validator validator_;
+
+    std::string text_;
+    std::unique_ptr<ast::Program> program_;
+    std::vector<Def> defs_;                 // in source order, main last
+    std::vector<ValidationError> tableErrors_; // buildProcTable()
+    ast::SourcePos eof_;
+    size_t compactBytes_ = 0; // arena size right after the last full parse
+
+    Stats stats_;
+
+    bool parseFull();
+    bool parseDef(Def& d, std::string_view text);
+    void validateDef(Def& d);
+    void rebuildProgramLists();
+};
@@ -1,13 +1,23 @@
 #pragma once
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
 #include <ostream>
 #include <string>
 
 namespace json {
 
-inline std::string escape(const std::string& s) {
-    std::string out;
-    out.reserve(s.size() + 8);
-    for (char c : s) {
+// Appends `s` to `out` as the body of a JSON string. Runs of characters
+// that need no escape are copied in one go.
+inline void escapeTo(std::string& out, const char* s, size_t n) {
+    static const char* hex = "0123456789abcdef";
+    size_t run = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out.append(s + run, i - run);
+        run = i + 1;
         switch (c) {
         case '\\': out += "\\\\"; break;
         case '"':  out += "\\\""; break;
@@ -15,69 +25,157 @@ inline std::string escape(const std::string& s) {
         case '\r': out += "\\r"; break;
         case '\t': out += "\\t"; break;
         default:
-            if (static_cast<unsigned char>(c) < 0x20) {
-                static const char* hex = "0123456789abcdef";
-                out += "\\u00";
-                out += hex[(c >> 4) & 0xF];
-                out += hex[c & 0xF];
-            } else {
-                out += c;
-            }
+            out += "\\u00";
+            out += hex[(c >> 4) & 0xF];
+            out += hex[c & 0xF];
         }
     }
+    out.append(s + run, n - run);
+}
+
+inline std::string escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 8);
+    escapeTo(out, s.data(), s.size());
     return out;
 }
 
+// Collects the document in a buffer of its own and hands it to the stream
+// in large blocks: when the buffer fills, when the outermost object or
+// array is closed, on flush() and in the destructor. Write to the stream
+// directly only after one of those.
+//
+// indentSpaces 0 is the compact layout (--json-compact): no newlines and
+// no spaces between tokens.
 class Writer {
 public:
     explicit Writer(std::ostream& os, int indentSpaces = 2)
-        : os_(os), indentSpaces_(indentSpaces) {}
+        : os_(os), indentSpaces_(indentSpaces), pretty_(indentSpaces > 0) {
+        buf_.reserve(kBufferSize + 256);
+    }
+    ~Writer() { flush(); }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    void flush() {
+        if (buf_.empty()) return;
+        os_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+        buf_.clear();
+    }
+
+    void beginObject() { writeIndent(); open('{'); }
+    void endObject()   { close('}'); }
 
-    void beginObject() { writeIndent(); os_ << "{\n"; ++level_; first_ = true; }
-    void endObject()   { os_ << "\n"; --level_; writeIndent(); os_ << "}"; first_ = false; }
+    // Start an object as the value of `key`; endObject() closes it
+    void beginObject(const char* key) { keyName(key); open('{'); }
 
-    void beginArray(const char* key) { keyName(key); os_ << "[\n"; ++level_; first_ = true; }
-    void endArray() { os_ << "\n"; --level_; writeIndent(); os_ << "]"; first_ = false; }
+    void beginArray(const char* key) { keyName(key); open('['); }
+    void endArray() { close(']'); }
 
     // Start an array as value (no key) (for nested arrays)
-    void arrayValueBegin() { elementSep(); writeIndent(); os_ << "[\n"; ++level_; first_ = true; }
-    void arrayValueEnd()   { os_ << "\n"; --level_; writeIndent(); os_ << "]"; first_ = false; }
+    void arrayValueBegin() { elementSep(); writeIndent(); open('['); }
+    void arrayValueEnd()   { close(']'); }
 
-    void keyBool(const char* key, bool v) { keyName(key); os_ << (v ? "true" : "false"); }
-    void keyInt(const char* key, int v)   { keyName(key); os_ << v; }
-    void keyString(const char* key, const std::string& v) { keyName(key); os_ << "\"" << escape(v) << "\""; }
+    void keyBool(const char* key, bool v) { keyName(key); boolValue(v); }
+    void keyInt(const char* key, int64_t v)   { keyName(key); intValue(v); }
+    void keyUInt(const char* key, uint64_t v) { keyName(key); intValue(v); }
+    void keyString(const char* key, const std::string& v) { keyName(key); stringValue(v); }
 
     // Allows embedding pre-serialized JSON (use carefully)
-    void keyRaw(const char* key, const std::string& rawJson) { keyName(key); os_ << rawJson; }
+    void keyRaw(const char* key, const std::string& rawJson) { keyName(key); buf_ += rawJson; }
+
+    // Starts an object as the value of `key`, laid out as if it were a
+    // separate Writer's output passed to keyRaw(): its members are indented
+    // from the left margin, not from the enclosing level. Pass the returned
+    // level to endDetachedObject().
+    int beginDetachedObject(const char* key) {
+        keyName(key);
+        buf_ += '{';
+        if (pretty_) buf_ += '\n';
+        const int outer = level_;
+        level_ = 1;
+        first_ = true;
+        return outer;
+    }
+    void endDetachedObject(int outerLevel) {
+        if (pretty_) buf_ += '\n';
+        buf_ += '}';
+        level_ = outerLevel;
+        first_ = false;
+    }
 
     // array element helpers
-    void elementString(const std::string& v) { elementSep(); writeIndent(); os_ << "\"" << escape(v) << "\""; }
-    void elementInt(int v) { elementSep(); writeIndent(); os_ << v; }
-    void elementBool(bool v) { elementSep(); writeIndent(); os_ << (v ? "true" : "false"); }
+    void elementString(const std::string& v) { elementSep(); writeIndent(); stringValue(v); }
+    void elementInt(int64_t v) { elementSep(); writeIndent(); intValue(v); }
+    void elementBool(bool v) { elementSep(); writeIndent(); boolValue(v); }
 
-    void elementObjectBegin() { elementSep(); writeIndent(); os_ << "{\n"; ++level_; first_ = true; }
-    void elementObjectEnd()   { os_ << "\n"; --level_; writeIndent(); os_ << "}"; first_ = false; }
+    void elementObjectBegin() { elementSep(); writeIndent(); open('{'); }
+    void elementObjectEnd()   { close('}'); }
 
 private:
+    static constexpr size_t kBufferSize = 64 * 1024;
+
     std::ostream& os_;
     int indentSpaces_ = 2;
+    bool pretty_ = true;
     int level_ = 0;
     bool first_ = true;
+    std::string buf_;
 
     void writeIndent() {
-        for (int i = 0; i < level_ * indentSpaces_; ++i) os_ << ' ';
+        if (pretty_) buf_.append(static_cast<size_t>(level_ * indentSpaces_), ' ');
+    }
+
+    void open(char c) {
+        buf_ += c;
+        if (pretty_) buf_ += '\n';
+        ++level_;
+        first_ = true;
+    }
+
+    void close(char c) {
+        if (pretty_) buf_ += '\n';
+        --level_;
+        writeIndent();
+        buf_ += c;
+        first_ = false;
+        if (level_ == 0) flush();
     }
 
+    // every member and element starts here: the place to hand a full
+    // buffer to the stream
     void elementSep() {
-        if (!first_) os_ << ",\n";
+        if (buf_.size() >= kBufferSize) flush();
+        if (!first_) {
+            buf_ += ',';
+            if (pretty_) buf_ += '\n';
+        }
         first_ = false;
     }
 
     void keyName(const char* key) {
         elementSep();
         writeIndent();
-        os_ << "\"" << key << "\": ";
+        buf_ += '"';
+        buf_ += key;
+        buf_ += pretty_ ? "\": " : "\":";
+    }
+
+    void boolValue(bool v) { buf_ += v ? "true" : "false"; }
+
+    template <typename Int>
+    void intValue(Int v) {
+        char tmp[24];
+        const auto r = std::to_chars(tmp, tmp + sizeof tmp, v);
+        buf_.append(tmp, static_cast<size_t>(r.ptr - tmp));
+    }
+
+    void stringValue(const std::string& v) {
+        buf_ += '"';
+        escapeTo(buf_, v.data(), v.size());
+        buf_ += '"';
     }
 };
 
-} 
\ No newline at end of file
+}
@@ -0,0 +1,236 @@
+#pragma once
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Json.h"
+
+namespace json {
+
+// Minimal reader for request objects (`rc_parser serve`). Numbers keep
+// their source text; \u escapes are decoded to UTF-8.
+class Value {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolValue = false;
+    std::string text; // String: the string; Number: the literal
+    std::vector<Value> items;
+    std::map<std::string, Value> members;
+
+    bool isString() const { return type == Type::String; }
+    bool isArray() const  { return type == Type::Array; }
+    bool isObject() const { return type == Type::Object; }
+
+    // nullptr if not an object or no such member
+    const Value* find(const std::string& key) const {
+        if (type != Type::Object) return nullptr;
+        auto it = members.find(key);
+        return it == members.end() ? nullptr : &it->second;
+    }
+
+    // back to (compact) JSON text
+    std::string dump() const {
+        switch (type) {
+        case Type::Null:   return "null";
+        case Type::Bool:   return boolValue ? "true" : "false";
+        case Type::Number: return text;
+        case Type::String: return "\"" + escape(text) + "\"";
+        case Type::Array: {
+            std::string out = "[";
+            for (size_t i = 0; i < items.size(); ++i) {
+                if (i) out += ",";
+                out += items[i].dump();
+            }
+            return out + "]";
+        }
+        case Type::Object: {
+            std::string out = "{";
+            for (const auto& kv : members) {
+                if (out.size() > 1) out += ",";
+                out += "\"" + escape(kv.first) + "\":" + kv.second.dump();
+            }
+            return out + "}";
+        }
+        }
+        return "null";
+    }
+};
+
+class Reader {
+public:
+    explicit Reader(const std::string& s) : s_(s) {}
+
+    // throws std::runtime_error on malformed input
+    Value parseDocument() {
+        Value v = parseValue(0);
+        skipWs();
+        if (pos_ != s_.size()) fail("trailing characters");
+        return v;
+    }
+
+private:
+    static constexpr int kMaxDepth = 256;
+
+    const std::string& s_;
+    size_t pos_ = 0;
+
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error("Invalid JSON at offset " + std::to_string(pos_) + ": " + what);
+    }
+
+    bool at(char c) const { return pos_ < s_.size() && s_[pos_] == c; }
+
+    void skipWs() {
+        while (pos_ < s_.size() && (s_[pos_] == ' ' || s_[pos_] == '\t' || s_[pos_] == '\n' || s_[pos_] == '\r')) ++pos_;
+    }
+
+    bool consume(const std::string& lit) {
+        if (s_.compare(pos_, lit.size(), lit) != 0) return false;
+        pos_ += lit.size();
+        return true;
+    }
+
+    Value parseValue(int depth) {
+        if (depth > kMaxDepth) fail("nesting too deep");
+        skipWs();
+        if (pos_ >= s_.size()) fail("unexpected end");
+
+        Value v;
+        if (at('{')) {
+            v.type = Value::Type::Object;
+            ++pos_;
+            skipWs();
+            if (at('}')) { ++pos_; return v; }
+            for (;;) {
+                skipWs();
+                if (!at('"')) fail("expected a key");
+                std::string key = parseString();
+                skipWs();
+                if (!at(':')) fail("expected ':'");
+                ++pos_;
+                v.members[std::move(key)] = parseValue(depth + 1);
+                skipWs();
+                if (at(',')) { ++pos_; continue; }
+                if (at('}')) { ++pos_; return v; }
+                fail("expected ',' or '}'");
+            }
+        }
+        if (at('[')) {
+            v.type = Value::Type::Array;
+            ++pos_;
+            skipWs();
+            if (at(']')) { ++pos_; return v; }
+            for (;;) {
+                v.items.push_back(parseValue(depth + 1));
+                skipWs();
+                if (at(',')) { ++pos_; continue; }
+                if (at(']')) { ++pos_; return v; }
+                fail("expected ',' or ']'");
+            }
+        }
+        if (at('"')) {
+            v.type = Value::Type::String;
+            v.text = parseString();
+            return v;
+        }
+        if (consume("true"))  { v.type = Value::Type::Bool; v.boolValue = true; return v; }
+        if (consume("false")) { v.type = Value::Type::Bool; return v; }
+        if (consume("null"))  return v;
+
+        // number: -?digits[.digits][(e|E)[+-]digits]
+        if (!at('-') && !(s_[pos_] >= '0' && s_[pos_] <= '9')) fail("unexpected character");
+        const size_t start = pos_;
+        auto digits = [&] {
+            const size_t from = pos_;
+            while (pos_ < s_.size() && s_[pos_] >= '0' && s_[pos_] <= '9') ++pos_;
+            if (pos_ == from) fail("malformed number");
+        };
+        if (at('-')) ++pos_;
+        digits();
+        if (at('.')) { ++pos_; digits(); }
+        if (at('e') || at('E')) {
+            ++pos_;
+            if (at('+') || at('-')) ++pos_;
+            digits();
+        }
+        v.type = Value::Type::Number;
+        v.text = s_.substr(start, pos_ - start);
+        return v;
+    }
+
+    unsigned hex4() {
+        if (pos_ + 4 > s_.size()) fail("bad \\u escape");
+        unsigned cp = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char h = s_[pos_++];
+            cp <<= 4;
+            if (h >= '0' && h <= '9') cp |= static_cast<unsigned>(h - '0');
+            else if (h >= 'a' && h <= 'f') cp |= static_cast<unsigned>(h - 'a' + 10);
+            else if (h >= 'A' && h <= 'F') cp |= static_cast<unsigned>(h - 'A' + 10);
+            else fail("bad \\u escape");
+        }
+        return cp;
+    }
+
+    static void appendUtf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string parseString() {
+        ++pos_; // opening quote
+        std::string out;
+        for (;;) {
+            if (pos_ >= s_.size()) fail("unterminated string");
+            const char c = s_[pos_++];
+            if (c == '"') return out;
+            if (c != '\\') { out += c; continue; }
+
+            if (pos_ >= s_.size()) fail("unterminated string");
+            switch (s_[pos_++]) {
+            case '"':  out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/':  out += '/'; break;
+            case 'b':  out += '\b'; break;
+            case 'f':  out += '\f'; break;
+            case 'n':  out += '\n'; break;
+            case 'r':  out += '\r'; break;
+            case 't':  out += '\t'; break;
+            case 'u': {
+                unsigned cp = hex4();
+                if (cp >= 0xD800 && cp < 0xDC00 && s_.compare(pos_, 2, "\\u") == 0) {
+                    pos_ += 2;
+                    const unsigned lo = hex4();
+                    if (lo < 0xDC00 || lo >= 0xE000) fail("bad surrogate pair");
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                appendUtf8(out, cp);
+                break;
+            }
+            default: fail("bad escape");
+            }
+        }
+    }
+};
+
+inline Value parse(const std::string& text) {
+    return Reader(text).parseDocument();
+}
+
+}
@@ -0,0 +1,128 @@
+#include "RunStats.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <type_traits>
+#include <variant>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#define RC_HAVE_GETRUSAGE 1
+#endif
+
+namespace {
+
+// microseconds with nanosecond digits
+std::string micros(int64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%lld.%03lld", static_cast<long long>(ns / 1000),
+                  static_cast<long long>(ns % 1000));
+    return buf;
+}
+
+template <class Entries, class Value>
+void put(Entries& entries, const std::string& name, Value v, bool add) {
+    for (auto& e : entries) {
+        if (e.first == name) {
+            e.second = add ? e.second + v : v;
+            return;
+        }
+    }
+    entries.emplace_back(name, v);
+}
+
+uint64_t countBlock(const ast::Block& b);
+
+uint64_t countProcExpr(const ast::ProcExpr&) { return 2; } // + its Expr
+
+uint64_t countInteraction(const ast::Interaction& in) {
+    return std::visit([](auto&& node) -> uint64_t {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, ast::Comm>) return 1 + countProcExpr(node.from) + 1;
+        else if constexpr (std::is_same_v<T, ast::Select>) return 1;
+        else if constexpr (std::is_same_v<T, ast::Assign>) return 1 + 1 + 1;
+        else if constexpr (std::is_same_v<T, ast::Race>) {
+            return 1 + 1 + countProcExpr(node.left) + countProcExpr(node.right) + 1;
+        } else return 1 + 1 + 1; // Discharge: RaceId, ProcVar
+    }, in);
+}
+
+uint64_t countStmt(const ast::Stmt& st) {
+    return std::visit([](auto&& node) -> uint64_t {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, ast::InteractionStmt>) return 1 + countInteraction(node.interaction);
+        else if constexpr (std::is_same_v<T, ast::CallStmt>) return 1;
+        else if constexpr (std::is_same_v<T, ast::IfLocalStmt>) {
+            return 1 + countProcExpr(node.condition) + countBlock(*node.thenBlock) + countBlock(*node.elseBlock);
+        } else {
+            return 1 + 1 + countBlock(*node.thenBlock) + countBlock(*node.elseBlock);
+        }
+    }, st);
+}
+
+uint64_t countBlock(const ast::Block& b) {
+    uint64_t n = 1;
+    for (const ast::Stmt* st : b.statements) n += countStmt(*st);
+    return n;
+}
+
+}
+
+void RunStats::addTime(const std::string& phase, std::chrono::nanoseconds d) {
+    put(times_, phase, static_cast<int64_t>(d.count()), true);
+}
+
+void RunStats::setCount(const std::string& name, uint64_t value) {
+    put(counts_, name, value, false);
+}
+
+void RunStats::writeJson(json::Writer& w, const char* key) const {
+    w.beginObject(key);
+    w.beginObject("timeUs");
+    for (const auto& t : times_) w.keyRaw(t.first.c_str(), micros(t.second));
+    w.endObject();
+    for (const auto& c : counts_) w.keyUInt(c.first.c_str(), c.second);
+    if (const uint64_t kb = peakRssKb()) w.keyUInt("peakRssKb", kb);
+    w.endObject();
+}
+
+void RunStats::writeText(std::ostream& os) const {
+    os << "Stats:\n";
+    for (const auto& t : times_) {
+        os << "  " << t.first << std::string(t.first.size() < 12 ? 12 - t.first.size() : 1, ' ')
+           << micros(t.second) << " us\n";
+    }
+    for (const auto& c : counts_) {
+        os << "  " << c.first << std::string(c.first.size() < 12 ? 12 - c.first.size() : 1, ' ')
+           << c.second << "\n";
+    }
+    if (const uint64_t kb = peakRssKb()) os << "  peakRssKb   " << kb << "\n";
+}
+
+uint64_t RunStats::countNodes(const ast::Program& program) {
+    uint64_t n = 1 + 1 + countBlock(*program.main->body); // Program, Main
+    for (const ast::ProcDef* p : program.procedures) n += 1 + countBlock(*p->body);
+    return n;
+}
+
+uint64_t RunStats::peakRssKb() {
+#if defined(__linux__)
+    std::ifstream f("/proc/self/status");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::strtoull(line.c_str() + 6, nullptr, 10);
+    }
+#endif
+#if RC_HAVE_GETRUSAGE
+    struct rusage ru {};
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#if defined(__APPLE__)
+        return static_cast<uint64_t>(ru.ru_maxrss) / 1024; // bytes there
+#else
+        return static_cast<uint64_t>(ru.ru_maxrss);
+#endif
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Json.h"
+#include "ast/Ast.h"
+
+// --stats: wall time of each phase of a command (steady_clock) and a few
+// size counters. Reported as a "stats" object in JSON output, on stderr
+// otherwise. Phases and counters are listed in the order they were first
+// recorded; a phase that runs more than once (a failed fast parse, then
+// ANTLR) accumulates. The report ends with the process peak RSS where
+// the platform has it. Not thread safe: one instance per command run.
+class RunStats final {
+public:
+    // Adds the time from construction to stop() (or destruction) to a
+    // phase. A null RunStats makes it a no-op, so call sites need no
+    // --stats check.
+    class Timer final {
+    public:
+        Timer(RunStats* stats, const char* phase)
+            : stats_(stats), phase_(phase) {
+            if (stats_) start_ = std::chrono::steady_clock::now();
+        }
+        ~Timer() { stop(); }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        void stop() {
+            if (!stats_) return;
+            stats_->addTime(phase_, std::chrono::steady_clock::now() - start_);
+            stats_ = nullptr;
+        }
+
+    private:
+        RunStats* stats_;
+        const char* phase_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    void addTime(const std::string& phase, std::chrono::nanoseconds d);
+    void setCount(const std::string& name, uint64_t value);
+
+    // "<key>": {"timeUs": {"<phase>": us, ...}, "<counter>": n, ...,
+    // "peakRssKb": n} as a member of the writer's current object; times
+    // have nanosecond digits
+    void writeJson(json::Writer& w, const char* key) const;
+
+    // one "  name  value" line per entry, under a "Stats:" title
+    void writeText(std::ostream& os) const;
+
+    // nodes of the tree, one per object with a "kind" in the AST JSON
+    static uint64_t countNodes(const ast::Program& program);
+
+    // Peak resident set size of this process so far, in KiB; 0 if unknown.
+    // Linux: VmHWM, which (unlike getrusage) starts over at exec, so a
+    // parent's memory is not counted. Other POSIX systems: getrusage.
+    static uint64_t peakRssKb();
+
+private:
+    std::vector<std::pair<std::string, int64_t>> times_; // ns
+    std::vector<std::pair<std::string, uint64_t>> counts_;
+};
@@ -0,0 +1,202 @@
+#include "Server.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "Json.h"
+#include "JsonReader.h"
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define RC_HAVE_UNIX_SOCKETS 1
+#endif
+
+namespace {
+
+// One request stream: serializes the writes of its responses and counts
+// the requests still being handled.
+struct Stream {
+    std::function<void(const std::string&)> write;
+
+    std::mutex mu;
+    std::condition_variable idle;
+    size_t pending = 0;
+
+    void done(const std::string& response) {
+        std::lock_guard<std::mutex> lock(mu);
+        write(response);
+        if (--pending == 0) idle.notify_all();
+    }
+
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(mu);
+        idle.wait(lock, [&] { return pending == 0; });
+    }
+};
+
+}
+
+Server::Server(Handler handler, unsigned threads)
+    : handler_(std::move(handler)) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i) workers_.emplace_back([this] { workerLoop(); });
+}
+
+Server::~Server() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+void Server::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        queue_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void Server::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
+
+// The answer to a request whose handler threw: the shape of the handler's
+// own errors, with the request's "id" when it has one.
+static std::string errorResponse(const std::string& request, const std::string& message) {
+    std::string id = "null";
+    try {
+        const json::Value req = json::Reader(request).parseDocument();
+        if (const json::Value* v = req.find("id")) id = v->dump();
+    } catch (const std::exception&) {
+    }
+    std::string m = message;
+    while (!m.empty() && m.back() == '\n') m.pop_back();
+    return "{\"id\":" + id + ",\"exitCode\":2,\"error\":\"" + json::escape(m) + "\"}";
+}
+
+static void dispatch(Server::Handler& handler, const std::shared_ptr<Stream>& stream,
+                     std::string request, const std::function<void(std::function<void()>)>& submit) {
+    if (request.empty() || request == "\r") return;
+    {
+        std::lock_guard<std::mutex> lock(stream->mu);
+        ++stream->pending;
+    }
+    submit([&handler, stream, request = std::move(request)] {
+        std::string response;
+        try {
+            response = handler(request);
+        } catch (const std::exception& ex) {
+            response = errorResponse(request, ex.what());
+        }
+        stream->done(response);
+    });
+}
+
+void Server::serveStream(std::istream& in, std::ostream& out) {
+    auto stream = std::make_shared<Stream>();
+    stream->write = [&out](const std::string& response) { out << response << "\n" << std::flush; };
+
+    auto submitFn = [this](std::function<void()> t) { submit(std::move(t)); };
+    std::string line;
+    while (std::getline(in, line)) dispatch(handler_, stream, std::move(line), submitFn);
+
+    stream->waitIdle();
+}
+
+#if RC_HAVE_UNIX_SOCKETS
+
+static void writeAll(int fd, const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        const ssize_t n = ::send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return; // client went away: drop the response
+        off += static_cast<size_t>(n);
+    }
+}
+
+void Server::serveUnixSocket(const std::string& path) {
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Socket path too long: " + path);
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    struct stat st {};
+    if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) ::unlink(path.c_str());
+
+    const int lfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) throw std::runtime_error(std::string("Cannot create socket: ") + std::strerror(errno));
+    if (::bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(lfd, 64) < 0) {
+        const std::string why = std::strerror(errno);
+        ::close(lfd);
+        throw std::runtime_error("Cannot listen on " + path + ": " + why);
+    }
+
+    auto submitFn = [this](std::function<void()> t) { submit(std::move(t)); };
+
+    for (;;) {
+        const int fd = ::accept(lfd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            const std::string why = std::strerror(errno);
+            ::close(lfd);
+            throw std::runtime_error("accept failed: " + why);
+        }
+
+        // one reader thread per connection; the requests themselves run on
+        // the shared pool
+        std::thread([this, fd, submitFn] {
+            auto stream = std::make_shared<Stream>();
+            stream->write = [fd](const std::string& response) { writeAll(fd, response + "\n"); };
+
+            std::string buf;
+            size_t searched = 0; // buf[0, searched) has no '\n'
+            char chunk[64 * 1024];
+            for (;;) {
+                const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                buf.append(chunk, static_cast<size_t>(n));
+
+                size_t start = 0;
+                for (size_t nl; (nl = buf.find('\n', std::max(start, searched))) != std::string::npos; start = nl + 1) {
+                    dispatch(handler_, stream, buf.substr(start, nl - start), submitFn);
+                }
+                buf.erase(0, start);
+                searched = buf.size();
+            }
+            if (!buf.empty()) dispatch(handler_, stream, std::move(buf), submitFn);
+
+            stream->waitIdle();
+            ::close(fd);
+        }).detach();
+    }
+}
+
+#else
+
+void Server::serveUnixSocket(const std::string& path) {
+    (void)path;
+    throw std::runtime_error("--socket is not supported on this platform");
+}
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Request loop of `rc_parser serve`: newline-delimited requests in,
+// one response line per request out. What a request means is up to the
+// handler; Server only does the transport and runs the handler on a pool
+// of worker threads, so responses come back in completion order (the
+// handler is expected to echo a request id).
+class Server final {
+public:
+    // request line (without "\n") -> response line (without "\n")
+    using Handler = std::function<std::string(const std::string& request)>;
+
+    Server(Handler handler, unsigned threads); // threads 0 = all hardware threads
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Serves the requests read from `in` until EOF, then waits for the
+    // pending ones to be answered.
+    void serveStream(std::istream& in, std::ostream& out);
+
+    // Listens on a Unix domain socket at `path` (an existing socket file is
+    // replaced); every connection is a request stream as above. Does not
+    // return unless setting up the socket fails (std::runtime_error).
+    void serveUnixSocket(const std::string& path);
+
+    unsigned threads() const { return static_cast<unsigned>(workers_.size()); }
+
+private:
+    Handler handler_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+
+    void submit(std::function<void()> task);
+    void workerLoop();
+};
@@ -0,0 +1,120 @@
+#include "SourceText.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RC_HAVE_MMAP 1
+#endif
+
+SourceText SourceText::fromFile(const std::string& path) {
+#if RC_HAVE_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open file: " + path);
+
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        const size_t size = static_cast<size_t>(st.st_size);
+        void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            ::close(fd);
+            ::madvise(p, size, MADV_SEQUENTIAL);
+            SourceText s;
+            s.map_ = p;
+            s.data_ = static_cast<const char*>(p);
+            s.size_ = size;
+            return s;
+        }
+    }
+    ::close(fd);
+    // empty file, pipe/FIFO or mmap refused: read it normally
+#endif
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open file: " + path);
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return fromString(ss.str());
+}
+
+SourceText SourceText::fromStdin() {
+    std::ostringstream ss;
+    ss << std::cin.rdbuf();
+    return fromString(ss.str());
+}
+
+SourceText SourceText::fromString(std::string text) {
+    SourceText s;
+    s.owned_ = std::move(text);
+    s.data_ = s.owned_.data();
+    s.size_ = s.owned_.size();
+    return s;
+}
+
+SourceText::SourceText(SourceText&& other) noexcept {
+    *this = std::move(other);
+}
+
+SourceText& SourceText::operator=(SourceText&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+
+    map_ = std::exchange(other.map_, nullptr);
+    owned_ = std::move(other.owned_);
+    size_ = std::exchange(other.size_, 0);
+    // a short owned_ is stored inline: re-point at our copy
+    data_ = map_ ? other.data_ : owned_.data();
+    other.data_ = "";
+    other.owned_.clear();
+
+    lineStarts_ = std::move(other.lineStarts_);
+    indexed_ = std::exchange(other.indexed_, false);
+    other.lineStarts_.clear();
+    return *this;
+}
+
+SourceText::~SourceText() {
+    release();
+}
+
+void SourceText::release() {
+#if RC_HAVE_MMAP
+    if (map_) ::munmap(map_, size_);
+#endif
+    map_ = nullptr;
+}
+
+void SourceText::buildIndex() const {
+    lineStarts_.clear();
+    size_t start = 0;
+    while (start < size_) {
+        const void* nl = std::memchr(data_ + start, '\n', size_ - start);
+        if (!nl) break;
+        lineStarts_.push_back(start);
+        start = static_cast<size_t>(static_cast<const char*>(nl) - data_) + 1;
+    }
+    if (start < size_) lineStarts_.push_back(start);
+    indexed_ = true;
+}
+
+size_t SourceText::lineCount() const {
+    if (!indexed_) buildIndex();
+    return lineStarts_.size();
+}
+
+std::string_view SourceText::line(size_t n) const {
+    if (n == 0 || n > lineCount()) return {};
+
+    const size_t start = lineStarts_[n - 1];
+    const void* nl = std::memchr(data_ + start, '\n', size_ - start);
+    size_t end = nl ? static_cast<size_t>(static_cast<const char*>(nl) - data_) : size_;
+    if (end > start && data_[end - 1] == '\r') --end;
+    return { data_ + start, end - start };
+}
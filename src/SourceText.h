@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Contents of an input file, memory-mapped read-only when possible (stdin,
+// empty files and platforms without mmap fall back to an owned buffer).
+// text() is handed to the parsers as is, without copies.
+//
+// The line index is only built on the first line() call, i.e. when a
+// diagnostic actually needs to show a source line.
+class SourceText final {
+public:
+    static SourceText fromFile(const std::string& path); // throws std::runtime_error
+    static SourceText fromStdin();
+    static SourceText fromString(std::string text);
+
+    SourceText() = default;
+    SourceText(SourceText&& other) noexcept;
+    SourceText& operator=(SourceText&& other) noexcept;
+    SourceText(const SourceText&) = delete;
+    SourceText& operator=(const SourceText&) = delete;
+    ~SourceText();
+
+    std::string_view text() const { return { data_, size_ }; }
+
+    // Number of lines, and line n (1-based) without its "\n" / "\r\n".
+    // A last line without terminator counts only if non-empty.
+    size_t lineCount() const;
+    std::string_view line(size_t n) const;
+
+private:
+    const char* data_ = "";
+    size_t size_ = 0;
+
+    void* map_ = nullptr; // mmap'd region (size_ bytes), if any
+    std::string owned_;   // otherwise the text lives here
+
+    mutable std::vector<size_t> lineStarts_; // empty until first used
+    mutable bool indexed_ = false;
+
+    void buildIndex() const;
+    void release();
+};
@@ -7,7 +7,7 @@ using namespace std;
 
 void Validator::addError(const ast::SourceRange& loc, const std::string& msg) {
     ValidationError e;
-    e.file = loc.file;
+    e.file = loc.fileName();
     e.line = loc.start.line;
     e.col  = loc.start.col;
     e.message = msg;
@@ -85,3 +85,15 @@ std::vector<ValidationError> Validator::validate(const ast::Program& program) {
     validateProgramBody(program);
     return errors_;
 }
+
+std::vector<ValidationError> Validator::buildProcTable(const ast::Program& program) {
+    errors_.clear();
+    validateProcTable(program);
+    return std::move(errors_);
+}
+
+std::vector<ValidationError> Validator::validateBody(const ast::Block& body) {
+    errors_.clear();
+    validateBlock(body);
+    return std::move(errors_);
+}
@@ -17,6 +17,12 @@ class Validator final {
 public:
     std::vector<ValidationError> validate(const ast::Program& program);
 
+    // The two halves of validate(), for callers that re-check only part of
+    // a program (IncrementalParser): validate() is buildProcTable() followed
+    // by validateBody() of every procedure body, then of main's.
+    std::vector<ValidationError> buildProcTable(const ast::Program& program);
+    std::vector<ValidationError> validateBody(const ast::Block& body);
+
 private:
     void validateProcTable(const ast::Program& program);
     void validateProgramBody(const ast::Program& program);
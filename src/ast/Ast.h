@@ -1,7 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <memory>
+#include <new>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -9,16 +19,146 @@
 
 namespace ast {
 
+// ===== Memory =====
+// Every node of a Program lives in its Arena (bump allocation, a few large
+// chunks). Nodes hold no strings or vectors, only Idents, Lists and node
+// pointers, so they are trivially destructible and the whole tree is
+// released at once together with the Program.
+template <class T>
+class List final {
+public:
+    List() = default;
+
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    T& operator[](size_t i) { return data_[i]; } // in-place splicing (IncrementalParser)
+
+private:
+    friend class Arena;
+
+    T* data_ = nullptr;
+    uint32_t size_ = 0;
+};
+
+class Arena final {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        size_t pad = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+        if (pad + size > left_) {
+            grow(size + align);
+            pad = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+        }
+        void* p = cur_ + pad;
+        cur_ += pad + size;
+        left_ -= pad + size;
+        return p;
+    }
+
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena nodes are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T{ std::forward<Args>(args)... };
+    }
+
+    template <class T>
+    List<T> list(const T* first, size_t n) {
+        static_assert(std::is_trivially_copyable_v<T>, "arena lists are copied bytewise");
+        List<T> l;
+        if (n == 0) return l;
+        l.data_ = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        std::memcpy(static_cast<void*>(l.data_), first, n * sizeof(T));
+        l.size_ = static_cast<uint32_t>(n);
+        return l;
+    }
+
+    template <class T>
+    List<T> list(const std::vector<T>& v) { return list(v.data(), v.size()); }
+
+    size_t bytesReserved() const { return reserved_; }
+
+private:
+    static constexpr size_t kChunk = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* cur_ = nullptr;
+    size_t left_ = 0;
+    size_t reserved_ = 0;
+
+    void grow(size_t atLeast) {
+        // chunks double up to 1 MiB, so big programs need few of them
+        size_t n = chunks_.empty() ? kChunk : std::min<size_t>(reserved_, 16 * kChunk);
+        if (n < atLeast) n = atLeast;
+        chunks_.push_back(std::make_unique<char[]>(n));
+        cur_ = chunks_.back().get();
+        left_ = n;
+        reserved_ += n;
+    }
+};
+
 // ===== Identifiers =====
-using Process  = std::string;
-using Var      = std::string;
-using Label    = std::string;
-using ProcName = std::string;
+// Handle to a name interned in the Program's IdentPool: 8 bytes, compares
+// by pointer (only meaningful between Idents of the same Program), and
+// reads as a const std::string&.
+class Ident final {
+public:
+    Ident() = default;
+
+    const std::string& str() const { return *s_; }
+    operator const std::string&() const { return *s_; }
+    bool empty() const { return s_->empty(); }
+
+    friend bool operator==(Ident a, Ident b) { return a.s_ == b.s_; }
+    friend bool operator!=(Ident a, Ident b) { return a.s_ != b.s_; }
+
+private:
+    friend class IdentPool;
+    explicit Ident(const std::string* s) : s_(s) {}
+
+    static const std::string* emptyName() {
+        static const std::string empty;
+        return &empty;
+    }
+
+    const std::string* s_ = emptyName();
+};
+
+inline std::ostream& operator<<(std::ostream& os, Ident id) { return os << id.str(); }
+
+class IdentPool final {
+public:
+    Ident intern(std::string_view s) {
+        auto it = index_.find(s);
+        if (it != index_.end()) return Ident(it->second);
+
+        names_.emplace_back(s);
+        const std::string* name = &names_.back();
+        index_.emplace(std::string_view(*name), name);
+        return Ident(name);
+    }
+
+    size_t size() const { return names_.size(); }
+
+private:
+    std::deque<std::string> names_; // stable addresses
+    std::unordered_map<std::string_view, const std::string*> index_;
+};
+
+using Process  = Ident;
+using Var      = Ident;
+using Label    = Ident;
+using ProcName = Ident;
 
 // ===== Values & Expressions =====
 struct Value {
     enum class Kind { Int, Bool };
-    Kind kind;
+    Kind kind = Kind::Int;
     int intValue = 0;
     bool boolValue = false;
 
@@ -51,7 +191,7 @@ struct ProcVar {
 // ===== RaceId =====
 struct RaceId {
     Process process;
-    std::string key;
+    Ident key;
 
     SourceRange loc;
 };
@@ -107,23 +247,23 @@ struct InteractionStmt {
 
 struct CallStmt {
     ProcName proc;
-    std::vector<Process> args;
+    List<Process> args;
 
     SourceRange loc;
 };
 
 struct IfLocalStmt {
     ProcExpr condition;
-    std::unique_ptr<struct Block> thenBlock;
-    std::unique_ptr<struct Block> elseBlock;
+    struct Block* thenBlock = nullptr;
+    struct Block* elseBlock = nullptr;
 
     SourceRange loc;
 };
 
 struct IfRaceStmt {
     RaceId condition;
-    std::unique_ptr<struct Block> thenBlock;
-    std::unique_ptr<struct Block> elseBlock;
+    struct Block* thenBlock = nullptr;
+    struct Block* elseBlock = nullptr;
 
     SourceRange loc;
 };
@@ -137,7 +277,7 @@ using Stmt = std::variant<
 
 // ===== Block =====
 struct Block {
-    std::vector<std::unique_ptr<Stmt>> statements;
+    List<Stmt*> statements;
 
     SourceRange loc;
 };
@@ -145,23 +285,27 @@ struct Block {
 // ===== Procedures & Program =====
 struct ProcDef {
     ProcName name;
-    std::vector<Process> params;
-    std::unique_ptr<Block> body;
+    List<Process> params;
+    Block* body = nullptr;
 
     SourceRange loc;
 };
 
 struct Main {
-    std::unique_ptr<Block> body;
+    Block* body = nullptr;
 
     SourceRange loc;
 };
 
+// Owns the whole tree: not copyable, keep it behind a unique_ptr.
 struct Program {
-    std::vector<std::unique_ptr<ProcDef>> procedures;
-    std::unique_ptr<Main> main;
+    List<ProcDef*> procedures;
+    Main* main = nullptr;
 
     SourceRange loc;
+
+    Arena arena;
+    IdentPool idents;
 };
 
 } 
\ No newline at end of file
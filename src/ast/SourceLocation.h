@@ -1,18 +1,63 @@
 #pragma once
 #include <cstdint>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 namespace ast {
 
+using FileId = uint32_t;
+
+static constexpr FileId kNoFile = 0; // empty name: no location
+
+// Names of the source files seen by this process, so that a SourceRange
+// carries a 4-byte id instead of its own copy of the name. Append-only and
+// thread-safe; references returned by name() stay valid forever.
+class SourceFiles final {
+public:
+    static FileId intern(const std::string& name) {
+        Table& t = table();
+        std::lock_guard<std::mutex> lock(t.mu);
+        auto it = t.ids.find(name);
+        if (it != t.ids.end()) return it->second;
+
+        const FileId id = static_cast<FileId>(t.names.size());
+        t.names.push_back(name);
+        t.ids.emplace(name, id);
+        return id;
+    }
+
+    static const std::string& name(FileId id) {
+        Table& t = table();
+        std::lock_guard<std::mutex> lock(t.mu);
+        return t.names[id];
+    }
+
+private:
+    struct Table {
+        std::mutex mu;
+        std::deque<std::string> names{ std::string() }; // kNoFile
+        std::unordered_map<std::string, FileId> ids{ { std::string(), kNoFile } };
+    };
+
+    static Table& table() {
+        static Table t;
+        return t;
+    }
+};
+
 struct SourcePos {
   uint32_t line = 0;
   uint32_t col  = 0;
 };
 
 struct SourceRange {
-  std::string file;
+  FileId file = kNoFile;
   SourcePos start;
   SourcePos end;
+
+  const std::string& fileName() const { return SourceFiles::name(file); }
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,326 @@
+#include "gen/Generator.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace gen {
+
+namespace {
+
+// mt19937_64 is specified bit for bit; the std distributions are not, so
+// draws are reduced by hand to keep the output the same on every platform.
+class Rng final {
+public:
+    explicit Rng(uint64_t seed) : g_(seed) {}
+
+    uint64_t below(uint64_t n) { return n ? g_() % n : 0; }
+    bool percent(uint32_t p) { return below(100) < p; }
+
+private:
+    std::mt19937_64 g_;
+};
+
+struct Proc {
+    std::string name;
+    uint32_t arity = 1;
+    uint32_t level = 0;
+    bool recursive = false;
+    std::vector<uint32_t> calls; // callees (next level), mandatory ones first
+};
+
+class Generator final {
+public:
+    explicit Generator(const GenOptions& opt)
+        : opt_(opt), rng_(opt.seed) {
+        processes_ = std::max<uint32_t>(opt.processes, 2);
+        vars_ = std::max<uint32_t>(opt.vars, 1);
+        recDepth_ = std::min(std::max<uint32_t>(opt.recursionDepth, 1), processes_);
+    }
+
+    std::string run() {
+        planProcedures();
+
+        header();
+
+        // main's initialization first, the rest shared by all the bodies
+        const uint32_t init = processes_ * (vars_ + 1);
+        const uint32_t rest = opt_.statements > init ? opt_.statements - init : 0;
+        share_ = rest / static_cast<uint32_t>(procs_.size() + 1);
+
+        for (uint32_t i = 0; i < procs_.size(); ++i) procDef(i);
+        mainDef();
+        return std::move(out_);
+    }
+
+private:
+    const GenOptions& opt_;
+    Rng rng_;
+    std::string out_;
+
+    uint32_t processes_ = 0;
+    uint32_t vars_ = 0;
+    uint32_t recDepth_ = 0;
+    uint32_t share_ = 0;    // statement budget of each body
+    uint32_t raceKeys_ = 0;
+
+    std::vector<Proc> procs_;
+    std::vector<uint32_t> mainCalls_;
+
+    // processes visible in the body being written
+    std::vector<std::string> params_;
+
+    // ---------- plan ----------
+    void planProcedures() {
+        const uint32_t levels = std::max<uint32_t>(1, std::min(opt_.callDepth, std::max(opt_.procedures, 1u)));
+        std::vector<std::vector<uint32_t>> byLevel(levels);
+
+        for (uint32_t i = 0; i < opt_.procedures; ++i) {
+            Proc p;
+            p.name = "f" + std::to_string(i);
+            p.arity = 1 + static_cast<uint32_t>(rng_.below(std::max<uint32_t>(opt_.maxArity, 1)));
+            p.level = static_cast<uint32_t>(uint64_t(i) * levels / opt_.procedures);
+            byLevel[p.level].push_back(static_cast<uint32_t>(procs_.size()));
+            procs_.push_back(std::move(p));
+        }
+        for (uint32_t i = 0; i < opt_.recursive; ++i) {
+            Proc p;
+            p.name = "rec" + std::to_string(i);
+            p.arity = recDepth_;
+            p.recursive = true;
+            p.level = (i % levels);
+            byLevel[p.level].push_back(static_cast<uint32_t>(procs_.size()));
+            procs_.push_back(std::move(p));
+        }
+
+        // every procedure gets one caller on the level above (main for level 0)
+        for (uint32_t l = 0; l < levels; ++l) {
+            const std::vector<uint32_t>* callers = l ? &byLevel[l - 1] : nullptr;
+            for (size_t k = 0; k < byLevel[l].size(); ++k) {
+                if (!callers) {
+                    mainCalls_.push_back(byLevel[l][k]);
+                } else if (!callers->empty()) {
+                    procs_[(*callers)[k % callers->size()]].calls.push_back(byLevel[l][k]);
+                } else {
+                    mainCalls_.push_back(byLevel[l][k]); // a level with no procedure above
+                }
+            }
+        }
+
+        // then up to callsPerBody, to random procedures of the next level
+        auto extra = [&](std::vector<uint32_t>& calls, uint32_t next) {
+            if (next >= levels || byLevel[next].empty()) return;
+            while (calls.size() < opt_.callsPerBody) {
+                calls.push_back(byLevel[next][rng_.below(byLevel[next].size())]);
+            }
+        };
+        extra(mainCalls_, 0);
+        for (auto& p : procs_) extra(p.calls, p.level + 1);
+    }
+
+    // ---------- text ----------
+    void line(int indent, const std::string& s) {
+        out_.append(static_cast<size_t>(indent) * 2, ' ');
+        out_ += s;
+        out_ += '\n';
+    }
+
+    void header() {
+        out_ += "// rc_gen --seed " + std::to_string(opt_.seed) +
+                " --processes " + std::to_string(opt_.processes) +
+                " --vars " + std::to_string(opt_.vars) +
+                " --statements " + std::to_string(opt_.statements) +
+                " --procedures " + std::to_string(opt_.procedures) +
+                " --max-arity " + std::to_string(opt_.maxArity) +
+                " --call-depth " + std::to_string(opt_.callDepth) +
+                " --calls " + std::to_string(opt_.callsPerBody) +
+                " --recursive " + std::to_string(opt_.recursive) +
+                " --recursion-depth " + std::to_string(opt_.recursionDepth) +
+                " --if-depth " + std::to_string(opt_.ifDepth) +
+                " --if-percent " + std::to_string(opt_.ifPercent) +
+                " --race-percent " + std::to_string(opt_.racePercent) +
+                " --discharge-percent " + std::to_string(opt_.dischargePercent) + "\n\n";
+    }
+
+    std::string global(uint64_t i) const { return "p" + std::to_string(i); }
+
+    // a process of the current body: mostly parameters inside procedures
+    std::string process() {
+        if (!params_.empty() && rng_.percent(80)) return params_[rng_.below(params_.size())];
+        return global(rng_.below(processes_));
+    }
+
+    std::string otherProcess(const std::string& p) {
+        for (int tries = 0; tries < 8; ++tries) {
+            std::string q = process();
+            if (q != p) return q;
+        }
+        return p == global(0) ? global(1) : global(0);
+    }
+
+    std::string intVar() { return "x" + std::to_string(rng_.below(vars_)); }
+    std::string intValue() { return std::to_string(rng_.below(100)); }
+
+    // ---------- statements ----------
+    // one statement, nested ones included if it is an if; returns its size
+    uint32_t statement(int indent, uint32_t budget, uint32_t depth) {
+        if (depth < opt_.ifDepth && budget >= 3 && rng_.percent(opt_.ifPercent)) {
+            const uint32_t inner = std::min<uint32_t>(budget - 1, 2 + static_cast<uint32_t>(rng_.below(8)));
+            const uint32_t thenSize = 1 + static_cast<uint32_t>(rng_.below(inner - 1));
+            line(indent, "if (" + process() + ".b) {");
+            const uint32_t a = block(indent + 1, thenSize, depth + 1);
+            line(indent, "} else {");
+            const uint32_t b = block(indent + 1, inner - thenSize, depth + 1);
+            line(indent, "}");
+            return 1 + a + b;
+        }
+
+        const uint64_t kind = rng_.below(100);
+        const std::string p = process();
+        if (kind < 30) {
+            line(indent, p + "." + intVar() + " = " + intValue() + ";");
+        } else if (kind < 40) {
+            line(indent, p + ".b = " + (rng_.percent(50) ? "true" : "false") + ";");
+        } else if (kind < 60) {
+            line(indent, p + "." + intVar() + " -> " + otherProcess(p) + "." + intVar() + ";");
+        } else if (kind < 75) {
+            line(indent, p + "." + intValue() + " -> " + otherProcess(p) + "." + intVar() + ";");
+        } else {
+            line(indent, p + " -> " + otherProcess(p) + "[L" + std::to_string(rng_.below(4)) + "];");
+        }
+        return 1;
+    }
+
+    uint32_t block(int indent, uint32_t budget, uint32_t depth) {
+        uint32_t used = 0;
+        while (used < budget) used += statement(indent, budget - used, depth);
+        return used;
+    }
+
+    // arguments of a call from the current body; for a recursive callee
+    // distinct globals, whose go flags are set first
+    uint32_t callStmt(int indent, uint32_t callee) {
+        const Proc& p = procs_[callee];
+        std::vector<std::string> args;
+        uint32_t size = 1;
+
+        if (p.recursive) {
+            std::vector<uint32_t> pick(processes_);
+            for (uint32_t i = 0; i < processes_; ++i) pick[i] = i;
+            for (uint32_t i = 0; i < p.arity; ++i) {
+                std::swap(pick[i], pick[i + rng_.below(processes_ - i)]);
+                args.push_back(global(pick[i]));
+                line(indent, args.back() + ".go = true;");
+                ++size;
+            }
+        } else {
+            for (uint32_t i = 0; i < p.arity; ++i) args.push_back(process());
+        }
+
+        std::string s = "call " + p.name + "(";
+        for (size_t i = 0; i < args.size(); ++i) s += (i ? ", " : "") + args[i];
+        line(indent, s + ");");
+        return size;
+    }
+
+    // race on distinct processes, then maybe branch on it and discharge
+    // the loser (left wins when the then-branch is taken)
+    uint32_t raceGroup(int indent) {
+        const std::string owner = global(rng_.below(processes_));
+        const std::string left = global(rng_.below(processes_));
+        std::string right = global(rng_.below(processes_ - 1));
+        if (right == left) right = global(processes_ - 1);
+
+        const std::string id = owner + "[k" + std::to_string(raceKeys_++) + "]";
+        line(indent, "race " + id + " : " + left + "." + intVar() + " , " + right + "." + intVar() +
+                     " -> " + owner + "." + intVar() + ";");
+        if (!rng_.percent(opt_.dischargePercent)) return 1;
+
+        const std::string target = owner + "." + intVar();
+        line(indent, "if (" + id + ") {");
+        line(indent + 1, "discharge " + id + " : " + right + " -> " + target + ";");
+        line(indent, "} else {");
+        line(indent + 1, "discharge " + id + " : " + left + " -> " + target + ";");
+        line(indent, "}");
+        return 4;
+    }
+
+    // top level of a body: `budget` statements with the calls (and race
+    // groups) at random positions among them
+    void body(const std::vector<uint32_t>& calls, uint32_t races, uint32_t budget) {
+        size_t nextCall = 0;
+        uint32_t used = 0;
+        for (;;) {
+            const uint64_t pending = (calls.size() - nextCall) + races;
+            if (pending == 0 && used >= budget) break;
+
+            const uint32_t left = used < budget ? budget - used : 0;
+            if (pending > 0 && rng_.below(left + pending) < pending) {
+                if (rng_.below(pending) < races) {
+                    used += raceGroup(1);
+                    --races;
+                } else {
+                    used += callStmt(1, calls[nextCall++]);
+                }
+                continue;
+            }
+            used += statement(1, left, 0);
+        }
+    }
+
+    void procDef(uint32_t index) {
+        const Proc& p = procs_[index];
+        params_.clear();
+        for (uint32_t i = 0; i < p.arity; ++i) params_.push_back((p.recursive ? "r" : "q") + std::to_string(i));
+
+        std::string sig = "proc " + p.name + "(";
+        for (size_t i = 0; i < params_.size(); ++i) sig += (i ? ", " : "") + params_[i];
+        line(0, sig + ") {");
+
+        if (!p.recursive) {
+            body(p.calls, 0, share_);
+        } else {
+            body(p.calls, 0, share_ > 4 ? share_ - 4 : 0);
+
+            // r0 goes last: with D distinct flags set, D + 1 activations
+            std::string rotated;
+            for (size_t i = 1; i <= params_.size(); ++i) {
+                rotated += (i > 1 ? ", " : "") + params_[i % params_.size()];
+            }
+            line(1, "if (r0.go) {");
+            line(2, "r0.go = false;");
+            line(2, "call " + p.name + "(" + rotated + ");");
+            line(1, "} else {");
+            block(2, 1, opt_.ifDepth);
+            line(1, "}");
+        }
+        line(0, "}");
+        line(0, "");
+    }
+
+    void mainDef() {
+        params_.clear();
+        line(0, "main {");
+
+        // every variable a statement may read
+        for (uint32_t i = 0; i < processes_; ++i) {
+            for (uint32_t v = 0; v < vars_; ++v) line(1, global(i) + ".x" + std::to_string(v) + " = " + intValue() + ";");
+            line(1, global(i) + ".b = " + (rng_.percent(50) ? "true" : "false") + ";");
+        }
+
+        const uint32_t groupSize = 1 + 3 * opt_.dischargePercent / 100;
+        const uint32_t races = share_ * std::min<uint32_t>(opt_.racePercent, 100) / 100 / std::max<uint32_t>(groupSize, 1);
+        const uint32_t raceStmts = races * groupSize;
+        body(mainCalls_, races, share_ > raceStmts ? share_ - raceStmts : 0);
+
+        line(0, "}");
+    }
+};
+
+}
+
+std::string generate(const GenOptions& opt) {
+    return Generator(opt).run();
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace gen {
+
+// Knobs of the synthetic program generator (rc_gen, rc_bench, perf tests).
+struct GenOptions {
+    uint64_t seed = 1;
+
+    uint32_t processes = 8;        // global processes p0..pN-1
+    uint32_t vars = 3;             // int variables x0..xN-1 per process (plus bool b)
+    uint32_t statements = 1000;    // total statements, main and procedures (approximate)
+
+    uint32_t procedures = 8;       // non-recursive procedures
+    uint32_t maxArity = 3;         // each takes 1..maxArity parameters
+    uint32_t callDepth = 3;        // levels of the call graph below main
+    uint32_t callsPerBody = 2;     // calls in a body, to the next level (each procedure is called at least once)
+
+    uint32_t recursive = 1;        // recursive procedures
+    uint32_t recursionDepth = 4;   // self calls per call of a recursive procedure (at most processes)
+
+    uint32_t ifDepth = 2;          // nesting of if (p.b) { } else { }
+    uint32_t ifPercent = 10;       // share of statements that open an if
+
+    uint32_t racePercent = 10;     // share of main's statements in race groups
+    uint32_t dischargePercent = 50; // race groups that also branch on the race and discharge it
+};
+
+// A program of the RacingChoreo.g4 grammar that passes validation and
+// runs without runtime errors under any race policy:
+//
+//  - main first initializes every variable of every process;
+//  - the procedures form a DAG of callDepth levels (a body only calls
+//    the next level), so runs end, and each one is called at least once;
+//  - a recursive procedure recN(r0..rD-1) calls recN(r1..rD-1, r0)
+//    while r0.go holds, clearing it first; its call sites set the D
+//    flags, so each call nests D+1 activations (D = recursionDepth);
+//  - races are only in main (a race key can be resolved once per run),
+//    with distinct keys; the discharge after `if (s[k])` names the loser.
+//
+// Steps executed grow with callsPerBody^callDepth: raise simulate
+// --max-steps for large settings. The same options and seed always give
+// the same text.
+std::string generate(const GenOptions& opt);
+
+}
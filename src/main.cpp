@@ -1,9 +1,20 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
+#include <initializer_list>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <stdexcept>
+#include <thread>
 
 #include "antlr4-runtime.h"
 #include "RacingChoreoLexer.h"
@@ -12,15 +23,29 @@
 #include "ErrorListener.h"
 #include "ast/Ast.h"
 #include "AstBuilderVisitor.h"
+#include "FastParser.h"
 #include "AstPrinter.h"
 #include "Json.h"
 #include "AstJson.h"
 #include "Validation.h"
+#include "SourceText.h"
+#include "AstCache.h"
+#include "AstDiskCache.h"
+#include "JsonReader.h"
+#include "Server.h"
+#include "IncrementalParser.h"
+#include "RunStats.h"
 
 // Simulator
 #include "sim/Simulator.h"
+#include "sim/Compiler.h"
 #include "sim/SimOptions.h"
 #include "sim/SimulationResult.h"
+#include "sim/Explorer.h"
+#include "sim/MonteCarlo.h"
+#include "sim/Profiler.h"
+#include "sim/TraceFormat.h"
+#include "sim/TraceSink.h"
 #include "runtime/Value.h"
 #include "runtime/Store.h"
 #include "runtime/Trace.h"
@@ -28,40 +53,6 @@
 
 static constexpr const char* RC_PARSER_VERSION = "4.0.0";
 
-// -------------------- IO helpers --------------------
-static std::string readFileToString(const std::string& path) {
-    std::ifstream in(path, std::ios::binary);
-    if (!in) throw std::runtime_error("Cannot open file: " + path);
-    std::ostringstream ss;
-    ss << in.rdbuf();
-    return ss.str();
-}
-
-static std::string readStdinToString() {
-    std::ostringstream ss;
-    ss << std::cin.rdbuf();
-    return ss.str();
-}
-
-static std::vector<std::string> splitLines(const std::string& text) {
-    std::vector<std::string> lines;
-    std::string current;
-    for (char c : text) {
-        if (c == '\n') {
-            if (!current.empty() && current.back() == '\r') current.pop_back();
-            lines.push_back(current);
-            current.clear();
-        } else {
-            current.push_back(c);
-        }
-    }
-    if (!current.empty()) {
-        if (!current.empty() && current.back() == '\r') current.pop_back();
-        lines.push_back(current);
-    }
-    return lines;
-}
-
 // -------------------- CLI help --------------------
 static void printUsage(std::ostream& os) {
     os
@@ -69,17 +60,32 @@ static void printUsage(std::ostream& os) {
         << "Usage:\n"
         << "  rc_parser --help | -h\n"
         << "  rc_parser --version\n"
-        << "  rc_parser parse     <file.rc> [--quiet] [--print-tree] [--json]\n"
+        << "  rc_parser parse     <file.rc> [--quiet] [--print-tree] [--json] [--parser-mode M]\n"
         << "  rc_parser tokens    <file.rc> [--quiet] [--json]\n"
-        << "  rc_parser ast       <file.rc> [--quiet] [--print-tree] [--with-loc] [--json]\n"
+        << "  rc_parser ast       <file.rc> [--quiet] [--print-tree] [--with-loc] [--json] [--parser-mode M]\n"
         << "  rc_parser simulate  <file.rc> [--quiet] [--json] [--trace|--no-trace] [--final-store] [--final-races]\n"
+        << "  rc_parser simulate  <file.rc> --runs N [--threads T] [--seed S] [--quiet] [--json]\n"
+        << "  rc_parser explore   <file.rc> [--quiet] [--json] [--threads N] [--max-paths N] [--max-sequences N]\n"
+        << "  rc_parser parse|ast|simulate --batch <file|dir>... [--threads N] [--ndjson]\n"
+        << "  rc_parser serve     [--socket PATH] [--threads N] [--cache-mb N] [--ast-cache DIR]\n"
         << "  rc_parser <cmd>     --stdin   [options]\n"
         << "  rc_parser <cmd>     --        (alias of --stdin)\n\n"
         << "Options (common):\n"
         << "  --quiet       No output (only exit code)\n"
         << "  --print-tree  Print ANTLR parse tree (CST)\n"
         << "  --with-loc    Include source locations in AST pretty print\n"
-        << "  --json        Emit JSON\n\n"
+        << "  --json        Emit JSON\n"
+        << "  --json-compact  Emit JSON on one line, without indentation\n"
+        << "  --stats       Time per phase (read, lex, parse, build, validate, compile,\n"
+        << "                simulate, emit, ...) and counters (tokens, AST nodes, steps,\n"
+        << "                trace events, store size, races): a \"stats\" object with --json,\n"
+        << "                on stderr otherwise\n"
+        << "  --parser-mode M  parse/ast: auto (hand-written parser, then ANTLR SLL, then LL;\n"
+        << "                default), sll (ANTLR SLL, then LL) or ll (ANTLR LL only).\n"
+        << "                JSON output reports the stage used as \"parserStage\"\n"
+        << "  --ast-cache DIR  parse/ast/simulate/explore: keep parsed programs in DIR, keyed by\n"
+        << "                the source text and the rc_parser version; a hit skips parsing\n"
+        << "                (parserStage \"cache\")\n\n"
         << "Notes:\n"
         << "  Exit codes: 0 OK, 1 syntax/lexical/validation/runtime error, 2 usage/io error\n";
 }
@@ -93,16 +99,55 @@ static void printSimUsage(std::ostream& os) {
         << "Options:\n"
         << "  --quiet            No output (only exit code)\n"
         << "  --json             Emit JSON result\n"
+        << "  --json-compact     Emit JSON result on one line, without indentation\n"
         << "  --trace            Print step-by-step trace (default)\n"
         << "  --no-trace         Disable trace output\n"
+        << "  --trace-format F   F = text|ndjson|binary (default text); binary needs --trace-out\n"
+        << "  --trace-out FILE   Write the trace to FILE (with --json the \"trace\" array stays empty)\n"
         << "  --final-store      Print final store (Sigma)\n"
         << "  --final-races      Print final race memory M\n"
         << "  --seed N           Seed for random race policy\n"
         << "  --race MODE        MODE = left|right|random\n"
         << "  --max-steps N      Max executed steps (default 100000)\n"
         << "  --max-call-depth N Max call depth (default 1000)\n"
+        << "  --profile          Print steps and time per procedure (inclusive/self) and the\n"
+        << "                    hottest statements after the run (\"profile\" with --json)\n"
+        << "  --profile-out FILE Write the call stacks in collapsed format (\"main;f;g 42\",\n"
+        << "                    weighted by steps) for flamegraph.pl/speedscope; implies --profile\n"
+        << "  --init P.X=V       Initialize store entry (repeatable), V=int|true|false\n"
+        << "                    Example: --init c.req=5 --init w1.req=5 --init w2.req=5\n"
+        << "  --ast-cache DIR    Load/store the parsed program in DIR (see rc_parser --help)\n"
+        << "  --stats            Time per phase and counters (see rc_parser --help)\n\n"
+        << "Monte Carlo mode:\n"
+        << "  --runs N           Run N times with random races (seeds derived from --seed)\n"
+        << "                    and print histograms of final stores, runtime errors and\n"
+        << "                    race winners instead of traces\n"
+        << "  --threads T        Worker threads for --runs, 0 = all hardware threads (default 1)\n";
+}
+
+static void printExploreUsage(std::ostream& os) {
+    os
+        << "rc_parser explore - exhaustive race-outcome exploration\n\n"
+        << "Runs the program once for every combination of race winners and\n"
+        << "reports the distinct final stores / runtime errors, with the winner\n"
+        << "sequences leading to each.\n\n"
+        << "Usage:\n"
+        << "  rc_parser explore --help\n"
+        << "  rc_parser explore <file.rc> [--stdin|--] [options]\n\n"
+        << "Options:\n"
+        << "  --quiet            No output (only exit code)\n"
+        << "  --json             Emit JSON result\n"
+        << "  --json-compact     Emit JSON result on one line, without indentation\n"
+        << "  --threads N        Worker threads, 0 = all hardware threads (default 1);\n"
+        << "                    the report does not depend on N unless --max-paths is hit\n"
+        << "  --max-paths N      Stop after N complete paths, 0 = no limit (default 1000000)\n"
+        << "  --max-sequences N  Winner sequences listed per outcome, 0 = all (default 10)\n"
+        << "  --max-steps N      Max executed steps per path (default 100000)\n"
+        << "  --max-call-depth N Max call depth (default 1000)\n"
         << "  --init P.X=V       Initialize store entry (repeatable), V=int|true|false\n"
-        << "                    Example: --init c.req=5 --init w1.req=5 --init w2.req=5\n";
+        << "  --ast-cache DIR    Load/store the parsed program in DIR (see rc_parser --help)\n"
+        << "  --stats            Time per phase and counters (see rc_parser --help)\n\n"
+        << "Exit code is 1 if any path ends with a runtime error.\n";
 }
 
 static void printVersion(std::ostream& os) {
@@ -111,7 +156,7 @@ static void printVersion(std::ostream& os) {
 
 // -------------------- Diagnostics --------------------
 static void printPrettyError(const ErrorListener::SyntaxError& err,
-                             const std::vector<std::string>& lines) {
+                             const SourceText& source) {
     std::cerr << err.file << ":" << err.line << ":" << err.column
               << ": error: " << err.message;
 
@@ -120,9 +165,9 @@ static void printPrettyError(const ErrorListener::SyntaxError& err,
     }
     std::cerr << "\n";
 
-    if (err.line == 0 || err.line > lines.size()) return;
+    if (err.line == 0 || err.line > source.lineCount()) return;
 
-    const std::string& srcLine = lines[err.line - 1];
+    const std::string_view srcLine = source.line(err.line);
     std::cerr << "  " << srcLine << "\n";
 
     std::cerr << "  ";
@@ -133,13 +178,13 @@ static void printPrettyError(const ErrorListener::SyntaxError& err,
 }
 
 static void printPrettyValidationError(const ValidationError& err,
-                                       const std::vector<std::string>& lines) {
+                                       const SourceText& source) {
     std::cerr << err.file << ":" << err.line << ":" << err.col
               << ": error: " << err.message << "\n";
 
-    if (err.line == 0 || err.line > lines.size()) return;
+    if (err.line == 0 || err.line > source.lineCount()) return;
 
-    const std::string& srcLine = lines[err.line - 1];
+    const std::string_view srcLine = source.line(err.line);
     std::cerr << "  " << srcLine << "\n";
 
     std::cerr << "  ";
@@ -150,17 +195,17 @@ static void printPrettyValidationError(const ValidationError& err,
 }
 
 static int printSyntaxErrorsAndFail(const ErrorListener& errorListener,
-                                   const std::vector<std::string>& lines) {
+                                   const SourceText& source) {
     for (const auto& err : errorListener.errors()) {
-        printPrettyError(err, lines);
+        printPrettyError(err, source);
     }
     return 1;
 }
 
 static int printValidationErrorsAndFail(const std::vector<ValidationError>& errs,
-                                       const std::vector<std::string>& lines) {
+                                       const SourceText& source) {
     for (const auto& e : errs) {
-        printPrettyValidationError(e, lines);
+        printPrettyValidationError(e, source);
     }
     return 1;
 }
@@ -204,27 +249,50 @@ static void printJsonHeader(json::Writer& w,
 }
 
 // -------------------- Pipeline --------------------
-struct Pipeline {
-    std::string filePath;
-    std::string input;
-    std::vector<std::string> lines;
+// --parser-mode: where parsing starts. Each stage hands over to the next
+// one on failure; only the last (full LL) reports syntax errors.
+//   auto  FastParser -> ANTLR SLL (bail on first error) -> ANTLR LL
+//   sll   ANTLR SLL -> ANTLR LL
+//   ll    ANTLR LL only
+enum class ParserMode { Auto, Sll, Ll };
+enum class ParserStage { Fast, Sll, Ll, Cache };
+
+static const char* parserStageName(ParserStage s) {
+    switch (s) {
+    case ParserStage::Fast: return "fast";
+    case ParserStage::Sll:  return "sll";
+    case ParserStage::Ll:   return "ll";
+    case ParserStage::Cache: return "cache";
+    }
+    return "?";
+}
+
+static ParserStage parserStageFromName(const std::string& s) {
+    if (s == "fast") return ParserStage::Fast;
+    if (s == "sll") return ParserStage::Sll;
+    if (s == "cache") return ParserStage::Cache;
+    return ParserStage::Ll;
+}
+
+static bool parseParserMode(const std::string& s, ParserMode& out) {
+    if (s == "auto") out = ParserMode::Auto;
+    else if (s == "sll") out = ParserMode::Sll;
+    else if (s == "ll") out = ParserMode::Ll;
+    else return false;
+    return true;
+}
 
+struct AntlrFrontend {
     antlr4::ANTLRInputStream inputStream;
     RacingChoreoLexer lexer;
     antlr4::CommonTokenStream tokens;
     RacingChoreoParser parser;
 
-    ErrorListener errorListener;
-
-    Pipeline(const std::string& file, const std::string& text)
-        : filePath(file),
-          input(text),
-          lines(splitLines(text)),
-          inputStream(input),
+    AntlrFrontend(std::string_view input, ErrorListener& errorListener)
+        : inputStream(input),
           lexer(&inputStream),
           tokens(&lexer),
-          parser(&tokens),
-          errorListener(filePath) {
+          parser(&tokens) {
         lexer.removeErrorListeners();
         parser.removeErrorListeners();
         lexer.addErrorListener(&errorListener);
@@ -232,108 +300,331 @@ struct Pipeline {
     }
 };
 
+struct Pipeline {
+    std::string filePath;
+    const SourceText& source; // not copied; line index built on demand
+
+    ErrorListener errorListener;
+
+    // set when the input went through ANTLR (--print-tree, or fallback)
+    RacingChoreoParser::ProgramContext* tree = nullptr;
+
+    // stage that produced the result (or the errors)
+    ParserStage stage = ParserStage::Fast;
+
+    // optional, shared between pipelines (`serve`)
+    AstCache* astCache = nullptr;
+
+    // optional, --ast-cache
+    AstDiskCache* diskCache = nullptr;
+
+    // optional, --stats
+    RunStats* stats = nullptr;
+
+    Pipeline(const std::string& file, const SourceText& text, AstCache* cache = nullptr,
+             AstDiskCache* disk = nullptr)
+        : filePath(file),
+          source(text),
+          errorListener(filePath),
+          astCache(cache),
+          diskCache(disk) {}
+
+    // created on first use: the fast path never needs it
+    AntlrFrontend& antlr() {
+        if (!antlr_) antlr_ = std::make_unique<AntlrFrontend>(source.text(), errorListener);
+        return *antlr_;
+    }
+
+    // Builds the AST, trying the stages selected by `mode` in order (see
+    // ParserMode). wantCst skips FastParser (and the caches) so that `tree`
+    // is available. nullptr if there are syntax errors.
+    //
+    // A program found in the disk cache reports the stage "cache": it was
+    // valid when stored, and every stage builds the same AST for it.
+    std::shared_ptr<const ast::Program> buildAst(ParserMode mode = ParserMode::Auto, bool wantCst = false) {
+        const bool useCache = astCache && !wantCst;
+        if (useCache) {
+            AstCache::Entry hit = astCache->find(filePath, source.text(), static_cast<int>(mode));
+            if (hit.program) {
+                stage = parserStageFromName(hit.stage);
+                if (stats) stats->setCount("astNodes", RunStats::countNodes(*hit.program));
+                return hit.program;
+            }
+        }
+
+        std::shared_ptr<const ast::Program> prog;
+        if (diskCache && !wantCst) {
+            RunStats::Timer t(stats, "cache");
+            prog = diskCache->load(source.text(), filePath);
+            if (prog) stage = ParserStage::Cache;
+        }
+        if (!prog) {
+            prog = parse(mode, wantCst);
+            if (diskCache && !wantCst && prog) {
+                RunStats::Timer t(stats, "cache");
+                diskCache->store(source.text(), *prog);
+            }
+        }
+        if (stats && prog) stats->setCount("astNodes", RunStats::countNodes(*prog));
+        if (useCache && prog) {
+            astCache->insert(filePath, source.text(), static_cast<int>(mode), { prog, parserStageName(stage) });
+        }
+        return prog;
+    }
+
+private:
+    std::unique_ptr<AntlrFrontend> antlr_;
+
+    std::unique_ptr<ast::Program> parse(ParserMode mode, bool wantCst) {
+        if (mode == ParserMode::Auto && !wantCst) {
+            stage = ParserStage::Fast;
+            RunStats::Timer t(stats, "parse");
+            size_t tokens = 0;
+            if (auto prog = FastParser(filePath).parse(source.text(), &tokens)) {
+                if (stats) stats->setCount("tokens", tokens);
+                return prog;
+            }
+        }
+
+        // ANTLR lexes on demand: its time is part of "parse"
+        {
+            RunStats::Timer t(stats, "parse");
+            tree = (mode == ParserMode::Ll) ? nullptr : parseSll();
+            if (!tree) tree = parseLl();
+        }
+        if (stats) stats->setCount("tokens", antlr().tokens.size());
+        if (errorListener.hasErrors()) return nullptr;
+
+        RunStats::Timer t(stats, "build");
+        AstBuilderVisitor builder(filePath);
+        return builder.build(tree);
+    }
+
+    // SLL prediction, no recovery and no parser diagnostics: enough for any
+    // valid input in this grammar, and much cheaper than full LL. nullptr
+    // on the first syntax error. Lexer errors still go to errorListener
+    // (tokens are buffered, so the LL pass does not report them twice).
+    RacingChoreoParser::ProgramContext* parseSll() {
+        stage = ParserStage::Sll;
+        AntlrFrontend& fe = antlr();
+        fe.parser.getInterpreter<antlr4::atn::ParserATNSimulator>()
+            ->setPredictionMode(antlr4::atn::PredictionMode::SLL);
+        fe.parser.setErrorHandler(std::make_shared<antlr4::BailErrorStrategy>());
+        fe.parser.removeErrorListeners();
+        try {
+            return fe.parser.program();
+        } catch (const antlr4::ParseCancellationException&) {
+            return nullptr;
+        }
+    }
+
+    // full LL with the default error strategy: the reference diagnostics
+    RacingChoreoParser::ProgramContext* parseLl() {
+        stage = ParserStage::Ll;
+        AntlrFrontend& fe = antlr();
+        fe.parser.getInterpreter<antlr4::atn::ParserATNSimulator>()
+            ->setPredictionMode(antlr4::atn::PredictionMode::LL);
+        fe.parser.setErrorHandler(std::make_shared<antlr4::DefaultErrorStrategy>());
+        fe.parser.removeErrorListeners();
+        fe.parser.addErrorListener(&errorListener);
+        fe.parser.reset();
+        return fe.parser.program();
+    }
+};
+
+// --ast-cache DIR (parse, ast, simulate, explore, --batch and serve).
+// Returns false if argv[i] is something else; on a missing value sets
+// ok = false.
+static bool parseAstCacheOption(int argc, char** argv, int& i, std::string& dir,
+                                std::ostream& err, bool& ok) {
+    if (std::string(argv[i]) != "--ast-cache") return false;
+    if (i + 1 >= argc) {
+        err << "Missing value for --ast-cache\n";
+        ok = false;
+        return true;
+    }
+    dir = argv[++i];
+    return true;
+}
+
 // -------------------- Run options (parser/ast/tokens) --------------------
 struct RunOptions {
     bool quiet = false;
     bool printTree = false;
     bool withLoc = false;
     bool json = false;
+    bool jsonCompact = false;
+    ParserMode parserMode = ParserMode::Auto;
+    std::string astCacheDir; // parse/ast
+    bool stats = false;
+};
+
+static RunOptions parseRunOptions(const std::string& command, int argc, char** argv, int startIndex,
+                                  std::ostream& err, bool& ok) {
+    RunOptions opt;
+    ok = true;
+
+    for (int i = startIndex; i < argc; ++i) {
+        const std::string a = argv[i];
+        if (a == "--quiet") opt.quiet = true;
+        else if (a == "--print-tree") opt.printTree = true;
+        else if (a == "--with-loc") opt.withLoc = true;
+        else if (a == "--json") opt.json = true;
+        else if (a == "--json-compact") opt.json = opt.jsonCompact = true;
+        else if (a == "--stats") opt.stats = true;
+        else if (a == "--parser-mode" && command != "tokens") {
+            if (i + 1 >= argc || !parseParserMode(argv[++i], opt.parserMode)) {
+                err << "Invalid --parser-mode: expected auto|sll|ll\n";
+                ok = false;
+                return opt;
+            }
+        }
+        else if (command != "tokens" && parseAstCacheOption(argc, argv, i, opt.astCacheDir, err, ok)) {
+            if (!ok) return opt;
+        }
+        else {
+            err << "Unknown option: " << a << "\n";
+            ok = false;
+            return opt;
+        }
+    }
+    return opt;
+}
+
+// Where a command writes its report, and the AST cache its Pipeline may
+// use. The CLI writes to std::cout without a cache; `serve` captures each
+// response and shares one cache between requests. `stats` is set with
+// --stats.
+struct RunContext {
+    std::ostream& out;
+    AstCache* astCache = nullptr;
+    AstDiskCache* diskCache = nullptr;
+    RunStats* stats = nullptr;
 };
 
+// Writer indentation for --json / --json-compact
+static int jsonIndent(bool compact) {
+    return compact ? 0 : 2;
+}
+
+// Ends the "emit" phase and, with --stats, adds the "stats" object. It is
+// the last key, so that "emit" covers the writing of all the others.
+static void printJsonStats(json::Writer& w, RunStats::Timer& emit, const RunStats* stats) {
+    emit.stop();
+    if (stats) stats->writeJson(w, "stats");
+}
+
 // -------------------- Commands: parse/tokens/ast --------------------
 static int runParseFromText(const std::string& sourceName,
-                            const std::string& text,
-                            const RunOptions& opt) {
-    Pipeline p(sourceName, text);
-    auto* tree = p.parser.program();
-
-    if (p.errorListener.hasErrors()) {
+                            const SourceText& text,
+                            const RunOptions& opt,
+                            const RunContext& ctx) {
+    Pipeline p(sourceName, text, ctx.astCache, ctx.diskCache);
+    p.stats = ctx.stats;
+    auto astProgram = p.buildAst(opt.parserMode, opt.printTree);
+
+    if (!astProgram) {
         if (opt.json) {
-            json::Writer w(std::cout, 2);
+            RunStats::Timer emit(ctx.stats, "emit");
+            json::Writer w(ctx.out, jsonIndent(opt.jsonCompact));
             w.beginObject();
             printJsonHeader(w, "parse", sourceName, false);
+            w.keyString("parserStage", parserStageName(p.stage));
             printJsonErrors(w, p.errorListener);
 
             w.beginArray("validationErrors");
             w.endArray();
 
+            printJsonStats(w, emit, ctx.stats);
             w.endObject();
-            std::cout << "\n";
+            ctx.out << "\n";
             return 1;
         }
-        return printSyntaxErrorsAndFail(p.errorListener, p.lines);
+        return printSyntaxErrorsAndFail(p.errorListener, p.source);
     }
 
-    AstBuilderVisitor builder(sourceName);
-    auto astProgram = builder.build(tree);
-
+    RunStats::Timer validateTime(ctx.stats, "validate");
     Validator validator;
     auto vErrors = validator.validate(*astProgram);
     const bool ok = vErrors.empty();
+    validateTime.stop();
 
     if (opt.json) {
-        json::Writer w(std::cout, 2);
+        RunStats::Timer emit(ctx.stats, "emit");
+        json::Writer w(ctx.out, jsonIndent(opt.jsonCompact));
         w.beginObject();
         printJsonHeader(w, "parse", sourceName, ok);
+        w.keyString("parserStage", parserStageName(p.stage));
         printJsonErrors(w, p.errorListener);
         printJsonValidationErrors(w, vErrors);
 
         if (opt.printTree) {
-            w.keyString("cst", antlr4::tree::Trees::toStringTree(tree, &p.parser));
+            w.keyString("cst", antlr4::tree::Trees::toStringTree(p.tree, &p.antlr().parser));
         }
 
+        printJsonStats(w, emit, ctx.stats);
         w.endObject();
-        std::cout << "\n";
+        ctx.out << "\n";
         return ok ? 0 : 1;
     }
 
+    RunStats::Timer emit(ctx.stats, "emit");
     if (!ok) {
-        return printValidationErrorsAndFail(vErrors, p.lines);
+        return printValidationErrorsAndFail(vErrors, p.source);
     }
 
     if (opt.printTree) {
-        std::cout << antlr4::tree::Trees::toStringTree(tree, &p.parser) << "\n";
+        ctx.out << antlr4::tree::Trees::toStringTree(p.tree, &p.antlr().parser) << "\n";
         return 0;
     }
 
     if (!opt.quiet) {
-        std::cout << "Parse OK\n";
+        ctx.out << "Parse OK\n";
     }
     return 0;
 }
 
 static int runTokensFromText(const std::string& sourceName,
-                             const std::string& text,
-                             const RunOptions& opt) {
-    Pipeline p(sourceName, text);
-    p.tokens.fill();
+                             const SourceText& text,
+                             const RunOptions& opt,
+                             const RunContext& ctx) {
+    Pipeline p(sourceName, text, ctx.astCache, ctx.diskCache);
+    AntlrFrontend& fe = p.antlr();
+    {
+        RunStats::Timer t(ctx.stats, "lex");
+        fe.tokens.fill();
+    }
+    if (ctx.stats) ctx.stats->setCount("tokens", fe.tokens.size());
 
     if (p.errorListener.hasErrors()) {
         if (opt.json) {
-            json::Writer w(std::cout, 2);
+            RunStats::Timer emit(ctx.stats, "emit");
+            json::Writer w(ctx.out, jsonIndent(opt.jsonCompact));
             w.beginObject();
             printJsonHeader(w, "tokens", sourceName, false);
             printJsonErrors(w, p.errorListener);
+            printJsonStats(w, emit, ctx.stats);
             w.endObject();
-            std::cout << "\n";
+            ctx.out << "\n";
             return 1;
         }
-        return printSyntaxErrorsAndFail(p.errorListener, p.lines);
+        return printSyntaxErrorsAndFail(p.errorListener, p.source);
     }
 
     if (opt.json) {
-        json::Writer w(std::cout, 2);
+        RunStats::Timer emit(ctx.stats, "emit");
+        json::Writer w(ctx.out, jsonIndent(opt.jsonCompact));
         w.beginObject();
         printJsonHeader(w, "tokens", sourceName, true);
         printJsonErrors(w, p.errorListener);
 
         w.beginArray("tokens");
-        for (antlr4::Token* t : p.tokens.getTokens()) {
+        for (antlr4::Token* t : fe.tokens.getTokens()) {
             w.elementObjectBegin();
             w.keyInt("line", static_cast<int>(t->getLine()));
             w.keyInt("column", static_cast<int>(t->getCharPositionInLine()));
 
-            const auto typeView = p.lexer.getVocabulary().getSymbolicName(t->getType());
+            const auto typeView = fe.lexer.getVocabulary().getSymbolicName(t->getType());
             const std::string typeName(typeView.begin(), typeView.end());
             w.keyString("type", typeName.empty() ? "<UNKNOWN>" : typeName);
 
@@ -342,19 +633,21 @@ static int runTokensFromText(const std::string& sourceName,
         }
         w.endArray();
 
+        printJsonStats(w, emit, ctx.stats);
         w.endObject();
-        std::cout << "\n";
+        ctx.out << "\n";
         return 0;
     }
 
     if (opt.quiet) return 0;
 
-    for (antlr4::Token* t : p.tokens.getTokens()) {
-        const auto typeView = p.lexer.getVocabulary().getSymbolicName(t->getType());
+    RunStats::Timer emit(ctx.stats, "emit");
+    for (antlr4::Token* t : fe.tokens.getTokens()) {
+        const auto typeView = fe.lexer.getVocabulary().getSymbolicName(t->getType());
         const std::string typeName(typeView.begin(), typeView.end());
         const std::string tokenText = t->getText();
 
-        std::cout << t->getLine() << ":" << t->getCharPositionInLine()
+        ctx.out << t->getLine() << ":" << t->getCharPositionInLine()
                   << "  " << (typeName.empty() ? "<UNKNOWN>" : typeName)
                   << "  \"" << tokenText << "\"\n";
     }
@@ -363,64 +656,72 @@ static int runTokensFromText(const std::string& sourceName,
 }
 
 static int runAstFromText(const std::string& sourceName,
-                          const std::string& text,
-                          const RunOptions& opt) {
-    Pipeline p(sourceName, text);
-    auto* tree = p.parser.program();
-
-    if (p.errorListener.hasErrors()) {
+                          const SourceText& text,
+                          const RunOptions& opt,
+                          const RunContext& ctx) {
+    Pipeline p(sourceName, text, ctx.astCache, ctx.diskCache);
+    p.stats = ctx.stats;
+    auto astProgram = p.buildAst(opt.parserMode, opt.printTree);
+
+    if (!astProgram) {
         if (opt.json) {
-            json::Writer w(std::cout, 2);
+            RunStats::Timer emit(ctx.stats, "emit");
+            json::Writer w(ctx.out, jsonIndent(opt.jsonCompact));
             w.beginObject();
             printJsonHeader(w, "ast", sourceName, false);
+            w.keyString("parserStage", parserStageName(p.stage));
             printJsonErrors(w, p.errorListener);
 
             w.beginArray("validationErrors");
             w.endArray();
 
+            printJsonStats(w, emit, ctx.stats);
             w.endObject();
-            std::cout << "\n";
+            ctx.out << "\n";
             return 1;
         }
-        return printSyntaxErrorsAndFail(p.errorListener, p.lines);
+        return printSyntaxErrorsAndFail(p.errorListener, p.source);
     }
 
-    AstBuilderVisitor builder(sourceName);
-    auto astProgram = builder.build(tree);
-
+    RunStats::Timer validateTime(ctx.stats, "validate");
     Validator validator;
     auto vErrors = validator.validate(*astProgram);
     const bool ok = vErrors.empty();
+    validateTime.stop();
 
     if (opt.json) {
-        json::Writer w(std::cout, 2);
+        RunStats::Timer emit(ctx.stats, "emit");
+        json::Writer w(ctx.out, jsonIndent(opt.jsonCompact));
         w.beginObject();
         printJsonHeader(w, "ast", sourceName, ok);
+        w.keyString("parserStage", parserStageName(p.stage));
         printJsonErrors(w, p.errorListener);
         printJsonValidationErrors(w, vErrors);
 
         if (opt.printTree) {
-            w.keyString("cst", antlr4::tree::Trees::toStringTree(tree, &p.parser));
+            w.keyString("cst", antlr4::tree::Trees::toStringTree(p.tree, &p.antlr().parser));
         }
 
-        w.keyRaw("ast", astjson::serialize(*astProgram));
+        astjson::write(w, "ast", *astProgram);
 
+        printJsonStats(w, emit, ctx.stats);
         w.endObject();
-        std::cout << "\n";
+        ctx.out << "\n";
         return ok ? 0 : 1;
     }
 
+    RunStats::Timer emit(ctx.stats, "emit");
     if (!ok) {
-        return printValidationErrorsAndFail(vErrors, p.lines);
+        return printValidationErrorsAndFail(vErrors, p.source);
     }
 
     if (opt.printTree) {
-        std::cout << antlr4::tree::Trees::toStringTree(tree, &p.parser) << "\n";
+        ctx.out << antlr4::tree::Trees::toStringTree(p.tree, &p.antlr().parser) << "\n";
         return 0;
     }
 
     if (!opt.quiet) {
-        AstPrinter::print(std::cout, *astProgram, opt.withLoc);
+        AstPrinter::print(ctx.out, *astProgram, opt.withLoc);
     }
     return 0;
 }
@@ -429,6 +730,23 @@ static int runAstFromText(const std::string& sourceName,
 struct SimCliOptions {
     sim::SimOptions simOpt;
     bool help = false;
+
+    // Monte Carlo mode when runs > 0
+    uint64_t runs = 0;
+    unsigned threads = 1;
+    bool threadsSet = false;
+
+    // trace streaming: --trace-format text|ndjson|binary, --trace-out FILE
+    std::string traceFormat = "text";
+    std::string traceOut;
+
+    // --profile: hot-spot table (or "profile" in JSON); --profile-out FILE:
+    // collapsed stacks for flame graphs (implies --profile)
+    bool profile = false;
+    std::string profileOut;
+
+    std::string astCacheDir;
+    bool stats = false;
 };
 
 static bool parseU64(const std::string& s, uint64_t& out) {
@@ -497,6 +815,43 @@ static bool parseInitBinding(const std::string& s, sim::InitBinding& out) {
     return true;
 }
 
+// Options shared by simulate and explore. Returns false if `a` is not one
+// of them; on a bad value sets ok = false.
+static bool parseCommonSimOption(int argc, char** argv, int& i, sim::SimOptions& simOpt,
+                                 std::ostream& err, bool& ok) {
+    const std::string a = argv[i];
+
+    if (a == "--quiet") {
+        simOpt.quiet = true;
+    } else if (a == "--json") {
+        simOpt.json = true;
+    } else if (a == "--json-compact") {
+        simOpt.json = simOpt.jsonCompact = true;
+    } else if (a == "--max-steps") {
+        if (i + 1 >= argc) { err << "Missing value for --max-steps\n"; ok = false; return true; }
+        uint64_t v = 0;
+        if (!parseU64(argv[++i], v)) { err << "Invalid --max-steps value\n"; ok = false; return true; }
+        simOpt.maxSteps = v;
+    } else if (a == "--max-call-depth") {
+        if (i + 1 >= argc) { err << "Missing value for --max-call-depth\n"; ok = false; return true; }
+        uint64_t v = 0;
+        if (!parseU64(argv[++i], v)) { err << "Invalid --max-call-depth value\n"; ok = false; return true; }
+        simOpt.maxCallDepth = v;
+    } else if (a == "--init") {
+        if (i + 1 >= argc) { err << "Missing value for --init\n"; ok = false; return true; }
+        sim::InitBinding b;
+        if (!parseInitBinding(argv[++i], b)) {
+            err << "Invalid --init format: expected P.X=V with V=int|true|false\n";
+            ok = false;
+            return true;
+        }
+        simOpt.init.push_back(std::move(b));
+    } else {
+        return false;
+    }
+    return true;
+}
+
 static SimCliOptions parseSimOptions(int argc, char** argv, int startIndex, std::ostream& err, bool& ok) {
     SimCliOptions opt;
     ok = true;
@@ -506,10 +861,12 @@ static SimCliOptions parseSimOptions(int argc, char** argv, int startIndex, std:
 
         if (a == "--help" || a == "-h") {
             opt.help = true;
-        } else if (a == "--quiet") {
-            opt.simOpt.quiet = true;
-        } else if (a == "--json") {
-            opt.simOpt.json = true;
+        } else if (parseCommonSimOption(argc, argv, i, opt.simOpt, err, ok)) {
+            if (!ok) return opt;
+        } else if (parseAstCacheOption(argc, argv, i, opt.astCacheDir, err, ok)) {
+            if (!ok) return opt;
+        } else if (a == "--stats") {
+            opt.stats = true;
         } else if (a == "--trace") {
             opt.simOpt.trace = true;
         } else if (a == "--no-trace") {
@@ -530,25 +887,34 @@ static SimCliOptions parseSimOptions(int argc, char** argv, int startIndex, std:
             else if (mode == "right") opt.simOpt.racePolicy = sim::RacePolicy::Right;
             else if (mode == "random") opt.simOpt.racePolicy = sim::RacePolicy::Random;
             else { err << "Invalid --race mode: " << mode << "\n"; ok = false; return opt; }
-        } else if (a == "--max-steps") {
-            if (i + 1 >= argc) { err << "Missing value for --max-steps\n"; ok = false; return opt; }
+        } else if (a == "--runs") {
+            if (i + 1 >= argc) { err << "Missing value for --runs\n"; ok = false; return opt; }
             uint64_t v = 0;
-            if (!parseU64(argv[++i], v)) { err << "Invalid --max-steps value\n"; ok = false; return opt; }
-            opt.simOpt.maxSteps = v;
-        } else if (a == "--max-call-depth") {
-            if (i + 1 >= argc) { err << "Missing value for --max-call-depth\n"; ok = false; return opt; }
+            if (!parseU64(argv[++i], v) || v == 0) { err << "Invalid --runs value\n"; ok = false; return opt; }
+            opt.runs = v;
+        } else if (a == "--threads") {
+            if (i + 1 >= argc) { err << "Missing value for --threads\n"; ok = false; return opt; }
             uint64_t v = 0;
-            if (!parseU64(argv[++i], v)) { err << "Invalid --max-call-depth value\n"; ok = false; return opt; }
-            opt.simOpt.maxCallDepth = v;
-        } else if (a == "--init") {
-            if (i + 1 >= argc) { err << "Missing value for --init\n"; ok = false; return opt; }
-            sim::InitBinding b;
-            if (!parseInitBinding(argv[++i], b)) {
-                err << "Invalid --init format: expected P.X=V with V=int|true|false\n";
+            if (!parseU64(argv[++i], v) || v > 1024) { err << "Invalid --threads value\n"; ok = false; return opt; }
+            opt.threads = static_cast<unsigned>(v);
+            opt.threadsSet = true;
+        } else if (a == "--trace-format") {
+            if (i + 1 >= argc) { err << "Missing value for --trace-format\n"; ok = false; return opt; }
+            opt.traceFormat = argv[++i];
+            if (opt.traceFormat != "text" && opt.traceFormat != "ndjson" && opt.traceFormat != "binary") {
+                err << "Invalid --trace-format: " << opt.traceFormat << "\n";
                 ok = false;
                 return opt;
             }
-            opt.simOpt.init.push_back(std::move(b));
+        } else if (a == "--trace-out") {
+            if (i + 1 >= argc) { err << "Missing value for --trace-out\n"; ok = false; return opt; }
+            opt.traceOut = argv[++i];
+        } else if (a == "--profile") {
+            opt.profile = true;
+        } else if (a == "--profile-out") {
+            if (i + 1 >= argc) { err << "Missing value for --profile-out\n"; ok = false; return opt; }
+            opt.profileOut = argv[++i];
+            opt.profile = true;
         } else {
             err << "Unknown option for simulate: " << a << "\n";
             ok = false;
@@ -556,76 +922,162 @@ static SimCliOptions parseSimOptions(int argc, char** argv, int startIndex, std:
         }
     }
 
+    if (opt.threadsSet && opt.runs == 0) {
+        err << "--threads requires --runs\n";
+        ok = false;
+    }
+    if (opt.runs > 0 && (!opt.traceOut.empty() || opt.traceFormat != "text")) {
+        err << "--trace-out/--trace-format cannot be used with --runs\n";
+        ok = false;
+    }
+    if (opt.runs > 0 && opt.profile) {
+        err << "--profile/--profile-out cannot be used with --runs\n";
+        ok = false;
+    }
+    if (opt.runs > 0 && opt.simOpt.racePolicy != sim::RacePolicy::Random) {
+        err << "--race left|right cannot be used with --runs (races are random there)\n";
+        ok = false;
+    }
+    if (opt.traceFormat == "binary" && opt.traceOut.empty()) {
+        err << "--trace-format binary requires --trace-out\n";
+        ok = false;
+    }
+
+    return opt;
+}
+
+struct ExploreCliOptions {
+    sim::ExploreOptions exploreOpt;
+    bool help = false;
+    std::string astCacheDir;
+    bool stats = false;
+};
+
+static ExploreCliOptions parseExploreOptions(int argc, char** argv, int startIndex, std::ostream& err, bool& ok) {
+    ExploreCliOptions opt;
+    ok = true;
+
+    for (int i = startIndex; i < argc; ++i) {
+        const std::string a = argv[i];
+
+        if (a == "--help" || a == "-h") {
+            opt.help = true;
+        } else if (parseCommonSimOption(argc, argv, i, opt.exploreOpt.sim, err, ok)) {
+            if (!ok) return opt;
+        } else if (parseAstCacheOption(argc, argv, i, opt.astCacheDir, err, ok)) {
+            if (!ok) return opt;
+        } else if (a == "--stats") {
+            opt.stats = true;
+        } else if (a == "--max-paths") {
+            if (i + 1 >= argc) { err << "Missing value for --max-paths\n"; ok = false; return opt; }
+            uint64_t v = 0;
+            if (!parseU64(argv[++i], v)) { err << "Invalid --max-paths value\n"; ok = false; return opt; }
+            opt.exploreOpt.maxPaths = v;
+        } else if (a == "--max-sequences") {
+            if (i + 1 >= argc) { err << "Missing value for --max-sequences\n"; ok = false; return opt; }
+            uint64_t v = 0;
+            if (!parseU64(argv[++i], v)) { err << "Invalid --max-sequences value\n"; ok = false; return opt; }
+            opt.exploreOpt.maxSequences = v;
+        } else if (a == "--threads") {
+            if (i + 1 >= argc) { err << "Missing value for --threads\n"; ok = false; return opt; }
+            uint64_t v = 0;
+            if (!parseU64(argv[++i], v) || v > 1024) { err << "Invalid --threads value\n"; ok = false; return opt; }
+            opt.exploreOpt.threads = static_cast<unsigned>(v);
+        } else {
+            err << "Unknown option for explore: " << a << "\n";
+            ok = false;
+            return opt;
+        }
+    }
+
     return opt;
 }
 
 static void printFinalStore(std::ostream& os, const runtime::Store& store) {
     os << "Final Store Sigma:\n";
-    const auto& m = store.raw();
-    if (m.empty()) {
+    if (store.empty()) {
         os << "  <empty>\n";
         return;
     }
 
-    std::vector<std::string> keys;
-    keys.reserve(m.size());
-    for (const auto& kv : m) keys.push_back(kv.first);
-    std::sort(keys.begin(), keys.end());
-
-    for (const auto& k : keys) {
-        os << "  " << k << " = " << m.at(k).toString() << "\n";
+    // raw() rebuilds "p.x" names, already sorted
+    for (const auto& kv : store.raw()) {
+        os << "  " << kv.first << " = " << kv.second.toString() << "\n";
     }
 }
 
-static void printFinalRaces(std::ostream& os, const runtime::RaceMemory& M) {
+// race memory with names resolved, sorted by process then key (output only)
+struct RaceRow {
+    std::string process;
+    std::string key;
+    std::string left, right, winner, loser;
+    runtime::Value vWinner, vLoser;
+    bool discharged = false;
+};
+
+static std::vector<RaceRow> raceRows(const runtime::RaceMemory& M, const runtime::Symbols& syms) {
+    std::vector<RaceRow> rows;
+    rows.reserve(M.size());
+    M.forEach([&](const runtime::RaceKey& k, const runtime::RaceEntry& e, bool discharged) {
+        RaceRow r;
+        r.process = syms.processes.name(k.process);
+        r.key = syms.raceKeys.name(k.key);
+        r.left = syms.processes.name(e.left);
+        r.right = syms.processes.name(e.right);
+        r.winner = syms.processes.name(e.winner());
+        r.loser = syms.processes.name(e.loser());
+        r.vWinner = e.vWinner;
+        r.vLoser = e.vLoser;
+        r.discharged = discharged;
+        rows.push_back(std::move(r));
+    });
+    std::sort(rows.begin(), rows.end(), [](const RaceRow& a, const RaceRow& b) {
+        return a.process != b.process ? a.process < b.process : a.key < b.key;
+    });
+    return rows;
+}
+
+static void printFinalRaces(std::ostream& os, const sim::SimulationResult& res) {
     os << "Final Races M:\n";
-    const auto& raw = M.raw();
-    if (raw.empty()) {
+    if (res.races.empty()) {
         os << "  <empty>\n";
         return;
     }
 
-    for (const auto& kv : raw) {
-        const auto& k = kv.first;
-        const auto& e = kv.second;
-
-        os << "  " << k.process << "[" << k.key << "]: "
-           << "left=" << e.leftProc << ", right=" << e.rightProc
-           << ", winner=" << e.winnerProc << ", loser=" << e.loserProc
-           << ", vWin=" << e.vWinner.toString() << ", vLose=" << e.vLoser.toString()
-           << ", discharged=" << (e.discharged ? "true" : "false")
+    for (const auto& r : raceRows(res.races, *res.symbols)) {
+        os << "  " << r.process << "[" << r.key << "]: "
+           << "left=" << r.left << ", right=" << r.right
+           << ", winner=" << r.winner << ", loser=" << r.loser
+           << ", vWin=" << r.vWinner.toString() << ", vLose=" << r.vLoser.toString()
+           << ", discharged=" << (r.discharged ? "true" : "false")
            << "\n";
     }
 }
 
-static void printJsonTrace(json::Writer& w, const runtime::Trace& trace) {
+static void printJsonTrace(json::Writer& w, const sim::SimulationResult& res) {
     w.beginArray("trace");
-    for (const auto& ev : trace) {
-        w.elementObjectBegin();
-        w.keyString("kind", ev.kind);
-        w.keyString("message", ev.message);
-        w.keyString("file", ev.loc.file);
-        w.keyInt("line", static_cast<int>(ev.loc.start.line));
-        w.keyInt("column", static_cast<int>(ev.loc.start.col));
-        w.elementObjectEnd();
+    if (!res.trace.empty()) {
+        sim::TraceFormatter fmt(*res.module, *res.symbols);
+        for (const auto& ev : res.trace) {
+            const ast::SourceRange& loc = fmt.loc(ev);
+            w.elementObjectBegin();
+            w.keyString("kind", sim::TraceFormatter::kind(ev.kind));
+            w.keyString("message", fmt.message(ev, res.trace));
+            w.keyString("file", loc.fileName());
+            w.keyInt("line", static_cast<int>(loc.start.line));
+            w.keyInt("column", static_cast<int>(loc.start.col));
+            w.elementObjectEnd();
+        }
     }
     w.endArray();
 }
 
-static void printJsonFinalStore(json::Writer& w, const runtime::Store& store) {
-    const auto& m = store.raw();
-
-    std::vector<std::string> keys;
-    keys.reserve(m.size());
-    for (const auto& kv : m) keys.push_back(kv.first);
-    std::sort(keys.begin(), keys.end());
-
-    w.beginArray("finalStore");
-    for (const auto& k : keys) {
-        const auto& v = m.at(k);
+static void printJsonStoreEntries(json::Writer& w, const std::map<std::string, runtime::Value>& store) {
+    for (const auto& kv : store) {
+        const auto& v = kv.second;
 
         w.elementObjectBegin();
-        w.keyString("var", k);
+        w.keyString("var", kv.first);
 
         if (v.kind == runtime::Value::Kind::Int) {
             w.keyString("type", "int");
@@ -637,27 +1089,29 @@ static void printJsonFinalStore(json::Writer& w, const runtime::Store& store) {
 
         w.elementObjectEnd();
     }
+}
+
+static void printJsonFinalStore(json::Writer& w, const runtime::Store& store) {
+    w.beginArray("finalStore");
+    printJsonStoreEntries(w, store.raw());
     w.endArray();
 }
 
 static void printJsonFinalRaces(json::Writer& w,
-                                const runtime::RaceMemory& M,
+                                const sim::SimulationResult& res,
                                 bool enabled) {
     w.beginArray("finalRaces");
     if (enabled) {
-        for (const auto& kv : M.raw()) {
-            const auto& k = kv.first;
-            const auto& e = kv.second;
-
+        for (const auto& e : raceRows(res.races, *res.symbols)) {
             w.elementObjectBegin();
-            w.keyString("race", k.process + "[" + k.key + "]");
-            w.keyString("process", k.process);
-            w.keyString("key", k.key);
+            w.keyString("race", e.process + "[" + e.key + "]");
+            w.keyString("process", e.process);
+            w.keyString("key", e.key);
 
-            w.keyString("left", e.leftProc);
-            w.keyString("right", e.rightProc);
-            w.keyString("winner", e.winnerProc);
-            w.keyString("loser", e.loserProc);
+            w.keyString("left", e.left);
+            w.keyString("right", e.right);
+            w.keyString("winner", e.winner);
+            w.keyString("loser", e.loser);
 
             if (e.vWinner.kind == runtime::Value::Kind::Int) {
                 w.keyString("vWinnerType", "int");
@@ -682,187 +1136,1311 @@ static void printJsonFinalRaces(json::Writer& w,
     w.endArray();
 }
 
-static int runSimulateFromText(const std::string& sourceName,
-                               const std::string& text,
-                               const SimCliOptions& cliOpt) {
-    Pipeline p(sourceName, text);
-    auto* tree = p.parser.program();
-
-    if (p.errorListener.hasErrors()) {
-        if (cliOpt.simOpt.json) {
-            json::Writer w(std::cout, 2);
+// Parses, builds and validates the program for the simulator commands.
+// On error prints the diagnostics and returns nullptr; in JSON mode the
+// (empty) result arrays named in `emptyArrays` follow the error lists.
+static std::shared_ptr<const ast::Program> buildValidatedProgram(Pipeline& p,
+                                                                 std::ostream& out,
+                                                                 const std::string& sourceName,
+                                                                 const char* command,
+                                                                 const sim::SimOptions& simOpt,
+                                                                 std::initializer_list<const char*> emptyArrays) {
+    auto astProgram = p.buildAst();
+
+    if (!astProgram) {
+        if (simOpt.json) {
+            RunStats::Timer emit(p.stats, "emit");
+            json::Writer w(out, jsonIndent(simOpt.jsonCompact));
             w.beginObject();
-            printJsonHeader(w, "simulate", sourceName, false);
+            printJsonHeader(w, command, sourceName, false);
             printJsonErrors(w, p.errorListener);
 
             w.beginArray("validationErrors"); w.endArray();
-            w.beginArray("runtimeErrors");    w.endArray();
-            w.beginArray("trace");            w.endArray();
-            w.beginArray("finalStore");       w.endArray();
-            w.beginArray("finalRaces");       w.endArray();
+            for (const char* name : emptyArrays) { w.beginArray(name); w.endArray(); }
 
+            printJsonStats(w, emit, p.stats);
             w.endObject();
-            std::cout << "\n";
-            return 1;
+            out << "\n";
+            return nullptr;
         }
-        return printSyntaxErrorsAndFail(p.errorListener, p.lines);
+        printSyntaxErrorsAndFail(p.errorListener, p.source);
+        return nullptr;
     }
 
-    AstBuilderVisitor builder(sourceName);
-    auto astProgram = builder.build(tree);
-
+    RunStats::Timer validateTime(p.stats, "validate");
     Validator validator;
     auto vErrors = validator.validate(*astProgram);
+    validateTime.stop();
     if (!vErrors.empty()) {
-        if (cliOpt.simOpt.json) {
-            json::Writer w(std::cout, 2);
+        if (simOpt.json) {
+            RunStats::Timer emit(p.stats, "emit");
+            json::Writer w(out, jsonIndent(simOpt.jsonCompact));
             w.beginObject();
-            printJsonHeader(w, "simulate", sourceName, false);
+            printJsonHeader(w, command, sourceName, false);
             printJsonErrors(w, p.errorListener);
             printJsonValidationErrors(w, vErrors);
 
-            w.beginArray("runtimeErrors"); w.endArray();
-            w.beginArray("trace");         w.endArray();
-            w.beginArray("finalStore");    w.endArray();
-            w.beginArray("finalRaces");    w.endArray();
+            for (const char* name : emptyArrays) { w.beginArray(name); w.endArray(); }
 
+            printJsonStats(w, emit, p.stats);
             w.endObject();
-            std::cout << "\n";
-            return 1;
+            out << "\n";
+            return nullptr;
         }
-        return printValidationErrorsAndFail(vErrors, p.lines);
+        printValidationErrorsAndFail(vErrors, p.source);
+        return nullptr;
+    }
+
+    return astProgram;
+}
+
+static std::string storeToString(const std::map<std::string, runtime::Value>& store) {
+    if (store.empty()) return "<empty>";
+    std::string out;
+    for (const auto& kv : store) {
+        if (!out.empty()) out += ", ";
+        out += kv.first + " = " + kv.second.toString();
     }
+    return out;
+}
 
-    sim::SimulationResult res = sim::Simulator::run(*astProgram, cliOpt.simOpt);
+static std::string percent(uint64_t n, uint64_t total) {
+    std::ostringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(1);
+    ss << (total ? 100.0 * static_cast<double>(n) / static_cast<double>(total) : 0.0) << "%";
+    return ss.str();
+}
+
+static int runMonteCarlo(const std::string& sourceName,
+                         const ast::Program& program,
+                         const ErrorListener& errorListener,
+                         const SimCliOptions& cliOpt,
+                         std::ostream& out,
+                         RunStats* stats) {
+    sim::MonteCarloOptions mcOpt;
+    mcOpt.sim = cliOpt.simOpt;
+    mcOpt.runs = cliOpt.runs;
+    mcOpt.threads = cliOpt.threads;
+
+    RunStats::Timer simulateTime(stats, "simulate");
+    sim::MonteCarloResult res = sim::MonteCarlo::run(program, mcOpt);
+    const bool ok = (res.okRuns == res.runs);
+    simulateTime.stop();
 
     if (cliOpt.simOpt.json) {
-        json::Writer w(std::cout, 2);
+        RunStats::Timer emit(stats, "emit");
+        json::Writer w(out, jsonIndent(cliOpt.simOpt.jsonCompact));
         w.beginObject();
-        printJsonHeader(w, "simulate", sourceName, res.ok);
-        printJsonErrors(w, p.errorListener);
+        printJsonHeader(w, "simulate", sourceName, ok);
+        printJsonErrors(w, errorListener);
 
         w.beginArray("validationErrors"); w.endArray();
 
+        w.keyUInt("runs", res.runs);
+        w.keyUInt("okRuns", res.okRuns);
+        w.keyString("seed", std::to_string(cliOpt.simOpt.seed));
+
+        w.beginArray("finalStores");
+        for (const auto& b : res.stores) {
+            w.elementObjectBegin();
+            w.keyUInt("count", b.count);
+            w.beginArray("finalStore");
+            printJsonStoreEntries(w, b.finalStore);
+            w.endArray();
+            w.elementObjectEnd();
+        }
+        w.endArray();
+
         w.beginArray("runtimeErrors");
-        for (const auto& e : res.runtimeErrors) {
+        for (const auto& b : res.errors) {
             w.elementObjectBegin();
-            w.keyString("file", e.file);
-            w.keyInt("line", static_cast<int>(e.line));
-            w.keyInt("column", static_cast<int>(e.col));
-            w.keyString("message", e.message);
+            w.keyUInt("count", b.count);
+            w.keyString("file", b.error.file);
+            w.keyInt("line", static_cast<int>(b.error.line));
+            w.keyInt("column", static_cast<int>(b.error.col));
+            w.keyString("message", b.error.message);
             w.elementObjectEnd();
         }
         w.endArray();
 
-        printJsonTrace(w, res.trace);
-        printJsonFinalStore(w, res.store);
-        printJsonFinalRaces(w, res.races, cliOpt.simOpt.finalRaces);
+        w.beginArray("raceWinners");
+        for (const auto& race : res.raceWinners) {
+            w.elementObjectBegin();
+            w.keyString("race", race.first);
+            w.beginArray("winners");
+            for (const auto& kv : race.second) {
+                w.elementObjectBegin();
+                w.keyString("process", kv.first);
+                w.keyUInt("count", kv.second);
+                w.elementObjectEnd();
+            }
+            w.endArray();
+            w.elementObjectEnd();
+        }
+        w.endArray();
 
+        printJsonStats(w, emit, stats);
         w.endObject();
-        std::cout << "\n";
-        return res.ok ? 0 : 1;
+        out << "\n";
+        return ok ? 0 : 1;
     }
 
+    RunStats::Timer emit(stats, "emit");
     if (!cliOpt.simOpt.quiet) {
-        if (cliOpt.simOpt.trace) {
-            for (const auto& ev : res.trace) {
-                std::cout << ev.toString() << "\n";
-            }
+        out << "Runs: " << res.runs << " (ok " << res.okRuns << ", failed "
+                  << (res.runs - res.okRuns) << "), base seed " << cliOpt.simOpt.seed << "\n";
+
+        out << "Final stores:\n";
+        if (res.stores.empty()) out << "  <none>\n";
+        for (const auto& b : res.stores) {
+            out << "  " << b.count << " (" << percent(b.count, res.runs) << "): "
+                      << storeToString(b.finalStore) << "\n";
         }
 
-        if (cliOpt.simOpt.finalStore) {
-            printFinalStore(std::cout, res.store);
+        out << "Runtime errors:\n";
+        if (res.errors.empty()) out << "  <none>\n";
+        for (const auto& b : res.errors) {
+            out << "  " << b.count << " (" << percent(b.count, res.runs) << "): "
+                      << b.error.file << ":" << b.error.line << ":" << b.error.col
+                      << ": " << b.error.message << "\n";
         }
 
-        if (cliOpt.simOpt.finalRaces) {
-            printFinalRaces(std::cout, res.races);
-        }
+        out << "Race winners:\n";
+        if (res.raceWinners.empty()) out << "  <none>\n";
+        for (const auto& race : res.raceWinners) {
+            uint64_t total = 0;
+            for (const auto& kv : race.second) total += kv.second;
 
-        for (const auto& e : res.runtimeErrors) {
-            std::cerr << e.file << ":" << e.line << ":" << e.col
-                      << ": runtime error: " << e.message << "\n";
+            out << "  " << race.first << ":";
+            for (const auto& kv : race.second) {
+                out << " " << kv.first << "=" << kv.second << " (" << percent(kv.second, total) << ")";
+            }
+            out << "\n";
         }
     }
 
-    return res.ok ? 0 : 1;
+    return ok ? 0 : 1;
 }
 
-// -------------------- Main --------------------
-int main(int argc, char** argv) {
-    try {
-        if (argc == 2) {
-            const std::string arg = argv[1];
-            if (arg == "--help" || arg == "-h") {
-                printUsage(std::cout);
-                return 0;
-            }
-            if (arg == "--version") {
-                printVersion(std::cout);
-                return 0;
-            }
-            printUsage(std::cerr);
-            return 2;
-        }
+// -------------------- Profile (simulate --profile) --------------------
+static constexpr size_t kProfileStatements = 20; // rows of the text table
 
-        if (argc == 3) {
-            const std::string command = argv[1];
-            const std::string arg2 = argv[2];
-            if (command == "simulate" && (arg2 == "--help" || arg2 == "-h")) {
-                printSimUsage(std::cout);
-                return 0;
-            }
-        }
+static std::string millis(int64_t ns) {
+    std::ostringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(3);
+    ss << static_cast<double>(ns) / 1e6;
+    return ss.str();
+}
 
-        if (argc < 3 || argc > 64) {
-            printUsage(std::cerr);
-            return 2;
-        }
+static std::string locString(const ast::SourceRange& loc) {
+    return loc.fileName() + ":" + std::to_string(loc.start.line) + ":" + std::to_string(loc.start.col);
+}
 
-        const std::string command = argv[1];
-        RunOptions opt;
-        const std::string inputArg = argv[2];
+static void printProfile(std::ostream& os, const sim::Profiler& prof) {
+    os << "Profile: " << prof.steps() << " steps in " << millis(prof.ns()) << " ms\n";
+
+    os << "  " << std::left << std::setw(20) << "procedure" << std::right
+       << std::setw(8) << "calls" << std::setw(10) << "steps" << std::setw(10) << "self"
+       << std::setw(8) << "steps%" << std::setw(11) << "time ms" << std::setw(11) << "self ms" << "\n";
+    for (const auto& p : prof.procedures()) {
+        os << "  " << std::left << std::setw(20) << p.name << std::right
+           << std::setw(8) << p.calls << std::setw(10) << p.totalSteps << std::setw(10) << p.selfSteps
+           << std::setw(8) << percent(p.totalSteps, prof.steps())
+           << std::setw(11) << millis(p.totalNs) << std::setw(11) << millis(p.selfNs) << "\n";
+    }
 
-        if (command == "simulate") {
-            const bool useStdin = (inputArg == "--stdin" || inputArg == "--");
-            const std::string sourceName = useStdin ? "<stdin>" : inputArg;
-            std::string text = useStdin ? readStdinToString() : readFileToString(inputArg);
+    const auto stmts = prof.statements();
+    const size_t shown = std::min(stmts.size(), kProfileStatements);
 
-            bool ok = true;
-            SimCliOptions simCli = parseSimOptions(argc, argv, 3, std::cerr, ok);
-            if (!ok) {
-                printSimUsage(std::cerr);
-                return 2;
-            }
-            if (simCli.help) {
+    // file:line:col of the printed rows, and a space after the longest
+    std::vector<std::string> locs;
+    size_t locWidth = 31;
+    for (size_t i = 0; i < shown; ++i) {
+        locs.push_back(locString(stmts[i].loc));
+        locWidth = std::max(locWidth, locs.back().size());
+    }
+    const int locColumn = static_cast<int>(locWidth + 1);
+
+    os << "\n  " << std::left << std::setw(locColumn) << "statement" << std::setw(6) << "kind"
+       << std::setw(20) << "procedure" << std::right << std::setw(10) << "count"
+       << std::setw(8) << "steps%" << std::setw(11) << "time ms" << "\n";
+    for (size_t i = 0; i < shown; ++i) {
+        const auto& st = stmts[i];
+        os << "  " << std::left << std::setw(locColumn) << locs[i] << std::setw(6) << st.kind
+           << std::setw(20) << st.proc << std::right << std::setw(10) << st.count
+           << std::setw(8) << percent(st.count, prof.steps()) << std::setw(11) << millis(st.ns) << "\n";
+    }
+    if (stmts.size() > kProfileStatements) {
+        os << "  ... " << (stmts.size() - kProfileStatements) << " more statement(s)\n";
+    }
+}
+
+// the "profile" object, laid out as when it was a separate document
+static void printJsonProfile(json::Writer& w, const sim::Profiler& prof) {
+    const int outer = w.beginDetachedObject("profile");
+    w.keyUInt("steps", prof.steps());
+    w.keyInt("ns", prof.ns());
+
+    w.beginArray("procedures");
+    for (const auto& p : prof.procedures()) {
+        w.elementObjectBegin();
+        w.keyString("name", p.name);
+        w.keyUInt("calls", p.calls);
+        w.keyUInt("steps", p.totalSteps);
+        w.keyUInt("selfSteps", p.selfSteps);
+        w.keyInt("ns", p.totalNs);
+        w.keyInt("selfNs", p.selfNs);
+        w.elementObjectEnd();
+    }
+    w.endArray();
+
+    w.beginArray("statements");
+    for (const auto& st : prof.statements()) {
+        w.elementObjectBegin();
+        w.keyString("file", st.loc.fileName());
+        w.keyInt("line", static_cast<int>(st.loc.start.line));
+        w.keyInt("column", static_cast<int>(st.loc.start.col));
+        w.keyString("kind", st.kind);
+        w.keyString("procedure", st.proc);
+        w.keyUInt("count", st.count);
+        w.keyInt("ns", st.ns);
+        w.elementObjectEnd();
+    }
+    w.endArray();
+
+    w.endDetachedObject(outer);
+}
+
+static int runSimulateFromText(const std::string& sourceName,
+                               const SourceText& text,
+                               const SimCliOptions& cliOpt,
+                               const RunContext& ctx) {
+    Pipeline p(sourceName, text, ctx.astCache, ctx.diskCache);
+    p.stats = ctx.stats;
+    auto astProgram = buildValidatedProgram(p, ctx.out, sourceName, "simulate", cliOpt.simOpt,
+                                            { "runtimeErrors", "trace", "finalStore", "finalRaces" });
+    if (!astProgram) return 1;
+
+    if (cliOpt.runs > 0) return runMonteCarlo(sourceName, *astProgram, p.errorListener, cliOpt, ctx.out, ctx.stats);
+
+    sim::SimOptions simOpt = cliOpt.simOpt;
+
+    // The trace is streamed while the program runs, so memory stays flat
+    // and output starts right away. Only --json without --trace-out still
+    // collects it, since it is nested in the result object.
+    std::ofstream traceFile;
+    std::unique_ptr<sim::TraceSink> sink;
+    if (simOpt.trace && (!cliOpt.traceOut.empty() || (!simOpt.json && !simOpt.quiet))) {
+        std::ostream* os = &ctx.out;
+        if (!cliOpt.traceOut.empty()) {
+            traceFile.open(cliOpt.traceOut, std::ios::binary);
+            if (!traceFile) throw std::runtime_error("Cannot open trace output file: " + cliOpt.traceOut);
+            os = &traceFile;
+        }
+        if (cliOpt.traceFormat == "ndjson") sink = std::make_unique<sim::NdjsonTraceSink>(*os);
+        else if (cliOpt.traceFormat == "binary") sink = std::make_unique<sim::BinaryTraceSink>(*os);
+        else sink = std::make_unique<sim::TextTraceSink>(*os);
+        simOpt.traceSink = sink.get();
+    } else if (!simOpt.json) {
+        // --quiet without --json never prints the trace: don't record it either
+        simOpt.trace = false;
+    }
+
+    sim::Profiler profiler;
+    std::ofstream profileFile;
+    if (cliOpt.profile) simOpt.profiler = &profiler;
+    if (!cliOpt.profileOut.empty()) {
+        profileFile.open(cliOpt.profileOut, std::ios::binary);
+        if (!profileFile) throw std::runtime_error("Cannot open profile output file: " + cliOpt.profileOut);
+    }
+
+    RunStats::Timer compileTime(ctx.stats, "compile");
+    auto module = std::make_shared<const sim::bc::Module>(sim::compile(*astProgram));
+    compileTime.stop();
+
+    RunStats::Timer simulateTime(ctx.stats, "simulate");
+    sim::SimulationResult res = sim::Simulator::run(module, simOpt);
+    simulateTime.stop();
+    if (profileFile.is_open()) profiler.writeCollapsed(profileFile);
+    if (ctx.stats) {
+        ctx.stats->setCount("steps", res.steps);
+        ctx.stats->setCount("traceEvents", res.traceEvents);
+        ctx.stats->setCount("storeSize", res.store.size());
+        ctx.stats->setCount("races", res.races.size());
+    }
+
+    if (cliOpt.simOpt.json) {
+        RunStats::Timer emit(ctx.stats, "emit");
+        json::Writer w(ctx.out, jsonIndent(simOpt.jsonCompact));
+        w.beginObject();
+        printJsonHeader(w, "simulate", sourceName, res.ok);
+        printJsonErrors(w, p.errorListener);
+
+        w.beginArray("validationErrors"); w.endArray();
+
+        w.beginArray("runtimeErrors");
+        for (const auto& e : res.runtimeErrors) {
+            w.elementObjectBegin();
+            w.keyString("file", e.file);
+            w.keyInt("line", static_cast<int>(e.line));
+            w.keyInt("column", static_cast<int>(e.col));
+            w.keyString("message", e.message);
+            w.elementObjectEnd();
+        }
+        w.endArray();
+
+        printJsonTrace(w, res);
+        printJsonFinalStore(w, res.store);
+        printJsonFinalRaces(w, res, cliOpt.simOpt.finalRaces);
+        if (cliOpt.profile) printJsonProfile(w, profiler);
+
+        printJsonStats(w, emit, ctx.stats);
+        w.endObject();
+        ctx.out << "\n";
+        return res.ok ? 0 : 1;
+    }
+
+    RunStats::Timer emit(ctx.stats, "emit");
+    if (!cliOpt.simOpt.quiet) {
+        if (cliOpt.simOpt.finalStore) {
+            printFinalStore(ctx.out, res.store);
+        }
+
+        if (cliOpt.simOpt.finalRaces) {
+            printFinalRaces(ctx.out, res);
+        }
+
+        for (const auto& e : res.runtimeErrors) {
+            std::cerr << e.file << ":" << e.line << ":" << e.col
+                      << ": runtime error: " << e.message << "\n";
+        }
+
+        if (cliOpt.profile) printProfile(ctx.out, profiler);
+    }
+
+    return res.ok ? 0 : 1;
+}
+
+static std::string winnerSequenceToString(const sim::WinnerSequence& seq) {
+    if (seq.empty()) return "<no races>";
+    std::string out;
+    for (size_t i = 0; i < seq.size(); ++i) {
+        if (i) out += ", ";
+        out += seq[i].race + "=" + seq[i].winner;
+    }
+    return out;
+}
+
+static int runExploreFromText(const std::string& sourceName,
+                              const SourceText& text,
+                              const ExploreCliOptions& cliOpt,
+                              const RunContext& ctx) {
+    const sim::SimOptions& simOpt = cliOpt.exploreOpt.sim;
+
+    Pipeline p(sourceName, text, ctx.astCache, ctx.diskCache);
+    p.stats = ctx.stats;
+    auto astProgram = buildValidatedProgram(p, ctx.out, sourceName, "explore", simOpt, { "outcomes" });
+    if (!astProgram) return 1;
+
+    RunStats::Timer exploreTime(ctx.stats, "explore");
+    sim::ExplorationResult res = sim::Explorer::run(*astProgram, cliOpt.exploreOpt);
+    exploreTime.stop();
+    if (ctx.stats) {
+        ctx.stats->setCount("paths", res.paths);
+        ctx.stats->setCount("decisions", res.decisions);
+    }
+
+    bool ok = true;
+    for (const auto& o : res.outcomes) ok = ok && o.ok;
+
+    if (simOpt.json) {
+        RunStats::Timer emit(ctx.stats, "emit");
+        json::Writer w(ctx.out, jsonIndent(simOpt.jsonCompact));
+        w.beginObject();
+        printJsonHeader(w, "explore", sourceName, ok);
+        printJsonErrors(w, p.errorListener);
+
+        w.beginArray("validationErrors"); w.endArray();
+
+        w.keyUInt("paths", res.paths);
+        w.keyUInt("decisions", res.decisions);
+        w.keyBool("truncated", res.truncated);
+
+        w.beginArray("outcomes");
+        for (const auto& o : res.outcomes) {
+            w.elementObjectBegin();
+            w.keyBool("ok", o.ok);
+            w.keyUInt("paths", o.paths);
+
+            w.beginArray("runtimeErrors");
+            for (const auto& e : o.runtimeErrors) {
+                w.elementObjectBegin();
+                w.keyString("file", e.file);
+                w.keyInt("line", static_cast<int>(e.line));
+                w.keyInt("column", static_cast<int>(e.col));
+                w.keyString("message", e.message);
+                w.elementObjectEnd();
+            }
+            w.endArray();
+
+            w.beginArray("finalStore");
+            printJsonStoreEntries(w, o.finalStore);
+            w.endArray();
+
+            w.beginArray("sequences");
+            for (const auto& seq : o.sequences) {
+                w.arrayValueBegin();
+                for (const auto& d : seq) {
+                    w.elementObjectBegin();
+                    w.keyString("race", d.race);
+                    w.keyString("winner", d.winner);
+                    w.keyString("side", d.side == runtime::RaceWinnerSide::Left ? "left" : "right");
+                    w.elementObjectEnd();
+                }
+                w.arrayValueEnd();
+            }
+            w.endArray();
+
+            w.elementObjectEnd();
+        }
+        w.endArray();
+
+        printJsonStats(w, emit, ctx.stats);
+        w.endObject();
+        ctx.out << "\n";
+        return ok ? 0 : 1;
+    }
+
+    RunStats::Timer emit(ctx.stats, "emit");
+    if (!simOpt.quiet) {
+        ctx.out << "Explored " << res.paths << " path(s), " << res.decisions << " race decision(s), "
+                  << res.outcomes.size() << " distinct outcome(s)"
+                  << (res.truncated ? " [truncated by --max-paths]" : "") << "\n";
+
+        for (size_t i = 0; i < res.outcomes.size(); ++i) {
+            const auto& o = res.outcomes[i];
+            ctx.out << "\nOutcome #" << (i + 1) << " (" << o.paths << " path(s)): ";
+            if (o.ok) {
+                ctx.out << "ok\n";
+                if (o.finalStore.empty()) {
+                    ctx.out << "  <empty store>\n";
+                }
+                for (const auto& kv : o.finalStore) {
+                    ctx.out << "  " << kv.first << " = " << kv.second.toString() << "\n";
+                }
+            } else {
+                for (const auto& e : o.runtimeErrors) {
+                    ctx.out << "runtime error: " << e.file << ":" << e.line << ":" << e.col
+                              << ": " << e.message << "\n";
+                }
+            }
+
+            ctx.out << "  Winner sequences:\n";
+            for (const auto& seq : o.sequences) {
+                ctx.out << "    " << winnerSequenceToString(seq) << "\n";
+            }
+            if (o.sequences.size() < o.paths) {
+                ctx.out << "    ... " << (o.paths - o.sequences.size()) << " more\n";
+            }
+        }
+    }
+
+    return ok ? 0 : 1;
+}
+
+// -------------------- Batch mode --------------------
+// rc_parser parse|ast|simulate --batch <files or dirs...> [options]
+//
+// All inputs are processed in this process by a pool of worker threads.
+// The generated ANTLR recognizers keep their deserialized ATN and DFA cache
+// in static storage shared by every instance and thread, so only the first
+// file pays for them; each file still gets its own (cheap) Pipeline.
+struct BatchOptions {
+    std::vector<std::string> inputs; // files, or directories scanned for *.rc
+    unsigned threads = 0;            // 0 = all hardware threads
+    bool ndjson = false;
+    bool jsonCompact = false;
+    bool quiet = false;
+    ParserMode parserMode = ParserMode::Auto;
+    sim::SimOptions simOpt;          // simulate only
+    std::string astCacheDir;
+    bool help = false;
+};
+
+struct BatchFileResult {
+    std::string file;
+    std::string status = "ok"; // ok|syntax|validation|runtime|io|error
+    std::string stage;         // parser stage, empty if not parsed
+    size_t syntaxErrors = 0;
+    size_t validationErrors = 0;
+    size_t runtimeErrors = 0;
+    std::string message;       // first diagnostic, "file:line:col: message"
+
+    // microseconds
+    int64_t readUs = 0;
+    int64_t parseUs = 0;
+    int64_t validateUs = 0;
+    int64_t simulateUs = 0;
+    int64_t totalUs = 0;
+
+    bool ok() const { return status == "ok"; }
+};
+
+static int64_t elapsedUs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - since).count();
+}
+
+static void printBatchUsage(std::ostream& os) {
+    os
+        << "rc_parser --batch - process many inputs in one process\n\n"
+        << "Usage:\n"
+        << "  rc_parser parse|ast|simulate --batch <file|dir>... [options]\n\n"
+        << "Directories are scanned recursively for *.rc files. Prints one JSON\n"
+        << "report (results in input order) or, with --ndjson, one line per file\n"
+        << "as it completes followed by a summary line.\n\n"
+        << "Options:\n"
+        << "  --threads N        Worker threads, 0 = all hardware threads (default 0)\n"
+        << "  --ndjson           NDJSON output instead of a single JSON object\n"
+        << "  --json             JSON output (default)\n"
+        << "  --json-compact     JSON output on one line, without indentation\n"
+        << "  --quiet            No output (only exit code)\n"
+        << "  --parser-mode M    parse/ast: auto|sll|ll (see rc_parser --help)\n"
+        << "  --ast-cache DIR    Load/store parsed programs in DIR (see rc_parser --help)\n"
+        << "  --seed N, --race MODE, --max-steps N, --max-call-depth N, --init P.X=V\n"
+        << "                    simulate: as for a single simulate run (no trace)\n\n"
+        << "Exit code is 0 if every file is ok, 1 otherwise.\n";
+}
+
+static BatchOptions parseBatchOptions(const std::string& command, int argc, char** argv,
+                                      int startIndex, std::ostream& err, bool& ok) {
+    BatchOptions opt;
+    opt.simOpt.trace = false;
+    ok = true;
+
+    int i = startIndex;
+    for (; i < argc && std::string(argv[i]).rfind("--", 0) != 0; ++i) opt.inputs.push_back(argv[i]);
+
+    for (; i < argc; ++i) {
+        const std::string a = argv[i];
+
+        if (a == "--help" || a == "-h") {
+            opt.help = true;
+        } else if (a == "--threads") {
+            if (i + 1 >= argc) { err << "Missing value for --threads\n"; ok = false; return opt; }
+            uint64_t v = 0;
+            if (!parseU64(argv[++i], v) || v > 1024) { err << "Invalid --threads value\n"; ok = false; return opt; }
+            opt.threads = static_cast<unsigned>(v);
+        } else if (a == "--ndjson") {
+            opt.ndjson = true;
+        } else if (a == "--json") {
+            opt.ndjson = false;
+        } else if (a == "--json-compact") {
+            opt.ndjson = false;
+            opt.jsonCompact = true;
+        } else if (a == "--quiet") {
+            opt.quiet = true;
+        } else if (parseAstCacheOption(argc, argv, i, opt.astCacheDir, err, ok)) {
+            if (!ok) return opt;
+        } else if (a == "--parser-mode" && command != "simulate") {
+            if (i + 1 >= argc || !parseParserMode(argv[++i], opt.parserMode)) {
+                err << "Invalid --parser-mode: expected auto|sll|ll\n";
+                ok = false;
+                return opt;
+            }
+        } else if (command == "simulate" && a == "--seed") {
+            if (i + 1 >= argc) { err << "Missing value for --seed\n"; ok = false; return opt; }
+            uint64_t v = 0;
+            if (!parseU64(argv[++i], v)) { err << "Invalid --seed value\n"; ok = false; return opt; }
+            opt.simOpt.seed = v;
+        } else if (command == "simulate" && a == "--race") {
+            if (i + 1 >= argc) { err << "Missing value for --race\n"; ok = false; return opt; }
+            const std::string mode = argv[++i];
+            if (mode == "left") opt.simOpt.racePolicy = sim::RacePolicy::Left;
+            else if (mode == "right") opt.simOpt.racePolicy = sim::RacePolicy::Right;
+            else if (mode == "random") opt.simOpt.racePolicy = sim::RacePolicy::Random;
+            else { err << "Invalid --race mode: " << mode << "\n"; ok = false; return opt; }
+        } else if (command == "simulate" && a != "--json" && a != "--quiet"
+                   && parseCommonSimOption(argc, argv, i, opt.simOpt, err, ok)) {
+            if (!ok) return opt;
+        } else {
+            err << "Unknown option for --batch: " << a << "\n";
+            ok = false;
+            return opt;
+        }
+    }
+
+    if (opt.inputs.empty() && !opt.help) {
+        err << "--batch requires at least one file or directory\n";
+        ok = false;
+    }
+    return opt;
+}
+
+// Files in command-line order; each directory contributes its *.rc files
+// (recursively, sorted by path).
+static std::vector<std::string> collectBatchFiles(const std::vector<std::string>& inputs) {
+    namespace fs = std::filesystem;
+
+    std::vector<std::string> files;
+    for (const auto& in : inputs) {
+        std::error_code ec;
+        if (!fs::is_directory(in, ec)) {
+            files.push_back(in); // a missing file is reported as an "io" result
+            continue;
+        }
+
+        std::vector<std::string> found;
+        for (fs::recursive_directory_iterator it(in, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->is_regular_file(ec) && it->path().extension() == ".rc") {
+                found.push_back(it->path().string());
+            }
+        }
+        if (ec) throw std::runtime_error("Cannot read directory: " + in + " (" + ec.message() + ")");
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+}
+
+static BatchFileResult runBatchFile(const std::string& command, const std::string& path,
+                                    const BatchOptions& opt, AstDiskCache* diskCache) {
+    using Clock = std::chrono::steady_clock;
+
+    BatchFileResult r;
+    r.file = path;
+    const auto start = Clock::now();
+
+    try {
+        auto t = Clock::now();
+        SourceText text;
+        try {
+            text = SourceText::fromFile(path);
+        } catch (const std::exception& ex) {
+            r.status = "io";
+            r.message = ex.what();
+            r.totalUs = elapsedUs(start);
+            return r;
+        }
+        r.readUs = elapsedUs(t);
+
+        t = Clock::now();
+        Pipeline p(path, text, nullptr, diskCache);
+        auto astProgram = p.buildAst(opt.parserMode);
+        r.parseUs = elapsedUs(t);
+        r.stage = parserStageName(p.stage);
+
+        if (!astProgram) {
+            const auto& errs = p.errorListener.errors();
+            r.status = "syntax";
+            r.syntaxErrors = errs.size();
+            if (!errs.empty()) {
+                const auto& e = errs.front();
+                r.message = e.file + ":" + std::to_string(e.line) + ":" + std::to_string(e.column) + ": " + e.message;
+            }
+            r.totalUs = elapsedUs(start);
+            return r;
+        }
+
+        t = Clock::now();
+        Validator validator;
+        auto vErrors = validator.validate(*astProgram);
+        r.validateUs = elapsedUs(t);
+
+        if (!vErrors.empty()) {
+            const auto& e = vErrors.front();
+            r.status = "validation";
+            r.validationErrors = vErrors.size();
+            r.message = e.file + ":" + std::to_string(e.line) + ":" + std::to_string(e.col) + ": " + e.message;
+            r.totalUs = elapsedUs(start);
+            return r;
+        }
+
+        if (command == "simulate") {
+            t = Clock::now();
+            sim::SimulationResult res = sim::Simulator::run(*astProgram, opt.simOpt);
+            r.simulateUs = elapsedUs(t);
+
+            if (!res.ok) {
+                r.status = "runtime";
+                r.runtimeErrors = res.runtimeErrors.size();
+                if (!res.runtimeErrors.empty()) {
+                    const auto& e = res.runtimeErrors.front();
+                    r.message = e.file + ":" + std::to_string(e.line) + ":" + std::to_string(e.col) + ": " + e.message;
+                }
+            }
+        }
+    } catch (const std::exception& ex) {
+        r.status = "error";
+        r.message = ex.what();
+    }
+
+    r.totalUs = elapsedUs(start);
+    return r;
+}
+
+static std::string batchResultNdjson(size_t index, const BatchFileResult& r) {
+    std::ostringstream os;
+    os << "{\"index\":" << index
+       << ",\"file\":\"" << json::escape(r.file) << "\""
+       << ",\"status\":\"" << r.status << "\""
+       << ",\"ok\":" << (r.ok() ? "true" : "false")
+       << ",\"parserStage\":\"" << r.stage << "\""
+       << ",\"syntaxErrors\":" << r.syntaxErrors
+       << ",\"validationErrors\":" << r.validationErrors
+       << ",\"runtimeErrors\":" << r.runtimeErrors
+       << ",\"message\":\"" << json::escape(r.message) << "\""
+       << ",\"readUs\":" << r.readUs
+       << ",\"parseUs\":" << r.parseUs
+       << ",\"validateUs\":" << r.validateUs
+       << ",\"simulateUs\":" << r.simulateUs
+       << ",\"totalUs\":" << r.totalUs
+       << "}\n";
+    return os.str();
+}
+
+static int runBatch(const std::string& command, const BatchOptions& opt) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<std::string> files = collectBatchFiles(opt.inputs);
+
+    std::unique_ptr<AstDiskCache> diskCache;
+    if (!opt.astCacheDir.empty()) diskCache = std::make_unique<AstDiskCache>(opt.astCacheDir, RC_PARSER_VERSION);
+
+    unsigned threads = opt.threads;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, files.size())));
+
+    std::vector<BatchFileResult> results(files.size());
+    std::atomic<size_t> next{ 0 };
+    std::mutex outMu;
+
+    auto work = [&]() {
+        for (;;) {
+            const size_t i = next.fetch_add(1);
+            if (i >= files.size()) return;
+            results[i] = runBatchFile(command, files[i], opt, diskCache.get());
+
+            if (opt.ndjson && !opt.quiet) {
+                const std::string line = batchResultNdjson(i, results[i]);
+                std::lock_guard<std::mutex> lock(outMu);
+                std::cout << line << std::flush;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; ++i) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+
+    size_t okFiles = 0;
+    for (const auto& r : results) okFiles += r.ok() ? 1 : 0;
+    const bool ok = (okFiles == results.size());
+    const int64_t wallUs = elapsedUs(start);
+
+    if (opt.quiet) return ok ? 0 : 1;
+
+    if (opt.ndjson) {
+        std::cout << "{\"summary\":true"
+                  << ",\"command\":\"" << command << "\""
+                  << ",\"ok\":" << (ok ? "true" : "false")
+                  << ",\"files\":" << results.size()
+                  << ",\"okFiles\":" << okFiles
+                  << ",\"threads\":" << threads
+                  << ",\"wallUs\":" << wallUs
+                  << "}\n";
+        return ok ? 0 : 1;
+    }
+
+    json::Writer w(std::cout, jsonIndent(opt.jsonCompact));
+    w.beginObject();
+    w.keyString("command", command);
+    w.keyBool("batch", true);
+    w.keyBool("ok", ok);
+    w.keyUInt("files", results.size());
+    w.keyUInt("okFiles", okFiles);
+    w.keyUInt("threads", threads);
+    w.keyInt("wallUs", wallUs);
+
+    w.beginArray("results");
+    for (const auto& r : results) {
+        w.elementObjectBegin();
+        w.keyString("file", r.file);
+        w.keyString("status", r.status);
+        w.keyBool("ok", r.ok());
+        w.keyString("parserStage", r.stage);
+        w.keyUInt("syntaxErrors", r.syntaxErrors);
+        w.keyUInt("validationErrors", r.validationErrors);
+        w.keyUInt("runtimeErrors", r.runtimeErrors);
+        w.keyString("message", r.message);
+        w.keyInt("readUs", r.readUs);
+        w.keyInt("parseUs", r.parseUs);
+        w.keyInt("validateUs", r.validateUs);
+        w.keyInt("simulateUs", r.simulateUs);
+        w.keyInt("totalUs", r.totalUs);
+        w.elementObjectEnd();
+    }
+    w.endArray();
+
+    w.endObject();
+    std::cout << "\n";
+    return ok ? 0 : 1;
+}
+
+// -------------------- Serve mode --------------------
+// rc_parser serve [--socket PATH] [--threads N] [--cache-mb N]
+//
+// One JSON request per line (stdin, or each connection of a Unix socket):
+//   {"id": <any>, "command": "parse|tokens|ast|simulate|explore",
+//    "source": "<program text>" | "path": "<file>", "name": "<source name>",
+//    "options": ["--race", "left", ...]}
+// `options` are the command's command-line options; --json is implied.
+// Each response is one line, in completion order:
+//   {"id": <id>, "exitCode": N, "result": <the command's --json-compact object>}
+//   {"id": <id>, "exitCode": 2, "error": "<message>"}   (bad request)
+// {"command": "stats"} reports the AST cache counters.
+//
+// parse/ast requests with a "document" key keep that document's AST
+// between requests and only re-parse the definitions an edit touched
+// (IncrementalParser; parserStage "incremental"). Every request still
+// sends the whole text. {"command": "close", "document": ...} drops it.
+struct ServeOptions {
+    std::string socketPath; // empty: stdin/stdout
+    unsigned threads = 0;   // 0 = all hardware threads
+    uint64_t cacheMb = 256;
+    std::string astCacheDir; // behind the in-memory cache
+    bool help = false;
+};
+
+static void printServeUsage(std::ostream& os) {
+    os
+        << "rc_parser serve - answer JSON-lines requests from a long-running process\n\n"
+        << "Usage:\n"
+        << "  rc_parser serve [--socket PATH] [--threads N] [--cache-mb N] [--ast-cache DIR]\n\n"
+        << "Requests (one per line):\n"
+        << "  {\"id\": 1, \"command\": \"ast\", \"source\": \"main { p.x = 1; }\", \"options\": [\"--with-loc\"]}\n"
+        << "  {\"id\": 2, \"command\": \"simulate\", \"path\": \"file.rc\", \"options\": [\"--race\", \"left\"]}\n"
+        << "  {\"id\": 3, \"command\": \"stats\"}\n"
+        << "  {\"id\": 4, \"command\": \"parse\", \"document\": \"a.rc\", \"source\": \"...\"}  (incremental)\n"
+        << "  {\"id\": 5, \"command\": \"close\", \"document\": \"a.rc\"}\n"
+        << "Responses (one per line, in completion order):\n"
+        << "  {\"id\": 1, \"exitCode\": 0, \"result\": { ...same object as --json-compact... }}\n\n"
+        << "Options:\n"
+        << "  --socket PATH      Listen on a Unix domain socket instead of stdin/stdout\n"
+        << "  --threads N        Worker threads, 0 = all hardware threads (default 0)\n"
+        << "  --cache-mb N       AST cache size in MiB, 0 = no cache (default 256)\n"
+        << "  --ast-cache DIR    Also keep parsed programs on disk in DIR (see rc_parser --help)\n";
+}
+
+static ServeOptions parseServeOptions(int argc, char** argv, int startIndex, std::ostream& err, bool& ok) {
+    ServeOptions opt;
+    ok = true;
+
+    for (int i = startIndex; i < argc; ++i) {
+        const std::string a = argv[i];
+
+        if (a == "--help" || a == "-h") {
+            opt.help = true;
+        } else if (a == "--socket") {
+            if (i + 1 >= argc) { err << "Missing value for --socket\n"; ok = false; return opt; }
+            opt.socketPath = argv[++i];
+        } else if (a == "--threads") {
+            if (i + 1 >= argc) { err << "Missing value for --threads\n"; ok = false; return opt; }
+            uint64_t v = 0;
+            if (!parseU64(argv[++i], v) || v > 1024) { err << "Invalid --threads value\n"; ok = false; return opt; }
+            opt.threads = static_cast<unsigned>(v);
+        } else if (parseAstCacheOption(argc, argv, i, opt.astCacheDir, err, ok)) {
+            if (!ok) return opt;
+        } else if (a == "--cache-mb") {
+            if (i + 1 >= argc) { err << "Missing value for --cache-mb\n"; ok = false; return opt; }
+            if (!parseU64(argv[++i], opt.cacheMb) || opt.cacheMb > (1u << 20)) {
+                err << "Invalid --cache-mb value\n";
+                ok = false;
+                return opt;
+            }
+        } else {
+            err << "Unknown option for serve: " << a << "\n";
+            ok = false;
+            return opt;
+        }
+    }
+    return opt;
+}
+
+static std::string serveError(const std::string& id, const std::string& message) {
+    std::string m = message;
+    while (!m.empty() && m.back() == '\n') m.pop_back();
+    return "{\"id\":" + id + ",\"exitCode\":2,\"error\":\"" + json::escape(m) + "\"}";
+}
+
+// Open documents of a `serve` process. Requests for one document are
+// serialized; as each carries the whole text, handling two of them out of
+// order costs a larger diff, never a wrong answer.
+class DocumentStore final {
+public:
+    struct Document {
+        std::mutex mu;
+        std::string name;
+        IncrementalParser parser;
+
+        explicit Document(const std::string& sourceName) : name(sourceName), parser(sourceName) {}
+    };
+
+    std::shared_ptr<Document> open(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto& doc = docs_[key];
+        if (!doc) doc = std::make_shared<Document>(key);
+        return doc;
+    }
+
+    bool close(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mu_);
+        return docs_.erase(key) != 0;
+    }
+
+private:
+    std::mutex mu_;
+    std::map<std::string, std::shared_ptr<Document>> docs_;
+};
+
+// parse/ast of a document through its IncrementalParser. -1 when the text
+// has to go through the regular pipeline (syntax errors: the diagnostics
+// come from ANTLR).
+static int runDocumentUpdate(const std::string& command,
+                             const std::string& sourceName,
+                             DocumentStore::Document& doc,
+                             std::string text,
+                             std::ostream& out,
+                             RunStats* stats) {
+    if (doc.name != sourceName) {
+        doc.name = sourceName;
+        doc.parser = IncrementalParser(sourceName);
+    }
+    RunStats::Timer parseTime(stats, "parse"); // re-validation included
+    if (!doc.parser.update(std::move(text))) return -1;
+    parseTime.stop();
+    if (stats) stats->setCount("astNodes", RunStats::countNodes(doc.parser.program()));
+
+    const auto vErrors = doc.parser.errors();
+    const bool ok = vErrors.empty();
+    const ErrorListener noSyntaxErrors(sourceName);
+
+    RunStats::Timer emit(stats, "emit");
+    json::Writer w(out, jsonIndent(true));
+    w.beginObject();
+    printJsonHeader(w, command, sourceName, ok);
+    w.keyString("parserStage", doc.parser.lastStats().full ? "fast" : "incremental");
+    printJsonErrors(w, noSyntaxErrors);
+    printJsonValidationErrors(w, vErrors);
+    if (command == "ast") astjson::write(w, "ast", doc.parser.program());
+    printJsonStats(w, emit, stats);
+    w.endObject();
+    out << "\n";
+    return ok ? 0 : 1;
+}
+
+static std::string handleServeRequest(const std::string& line, AstCache* cache, AstDiskCache* disk,
+                                      DocumentStore* docs) {
+    std::string id = "null";
+
+    json::Value req;
+    try {
+        req = json::parse(line);
+    } catch (const std::exception& ex) {
+        return serveError(id, ex.what());
+    }
+    if (!req.isObject()) return serveError(id, "request must be a JSON object");
+    if (const json::Value* v = req.find("id")) id = v->dump();
+
+    const json::Value* cmd = req.find("command");
+    if (!cmd || !cmd->isString()) return serveError(id, "missing \"command\"");
+    const std::string command = cmd->text;
+
+    if (command == "stats") {
+        const AstCache::Stats st = cache ? cache->stats() : AstCache::Stats{};
+        return "{\"id\":" + id + ",\"exitCode\":0,\"result\":{"
+               "\"cacheHits\":" + std::to_string(st.hits) +
+               ",\"cacheMisses\":" + std::to_string(st.misses) +
+               ",\"cacheEntries\":" + std::to_string(st.entries) +
+               ",\"cacheBytes\":" + std::to_string(st.bytes) + "}}";
+    }
+    if (command == "close") {
+        const json::Value* doc = req.find("document");
+        if (!doc || !doc->isString()) return serveError(id, "missing \"document\"");
+        const bool closed = docs && docs->close(doc->text);
+        return "{\"id\":" + id + ",\"exitCode\":0,\"result\":{\"closed\":" + (closed ? "true" : "false") + "}}";
+    }
+    if (command != "parse" && command != "tokens" && command != "ast" &&
+        command != "simulate" && command != "explore") {
+        return serveError(id, "unknown command: " + command);
+    }
+
+    const json::Value* source = req.find("source");
+    const json::Value* path = req.find("path");
+    if ((source == nullptr) == (path == nullptr) || !(source ? source : path)->isString()) {
+        return serveError(id, "exactly one of \"source\" and \"path\" (a string) is required");
+    }
+
+    const json::Value* document = req.find("document");
+    if (document && (!document->isString() || (command != "parse" && command != "ast"))) {
+        return serveError(id, "\"document\" must be a string, with the parse and ast commands");
+    }
+
+    std::string sourceName = source ? "<request>" : path->text;
+    if (const json::Value* n = req.find("name")) {
+        if (!n->isString()) return serveError(id, "\"name\" must be a string");
+        sourceName = n->text;
+    } else if (document && source) {
+        sourceName = document->text;
+    }
+
+    // options go through the usual command-line parsers
+    std::vector<std::string> args = { "rc_parser", command, sourceName };
+    if (const json::Value* o = req.find("options")) {
+        if (!o->isArray()) return serveError(id, "\"options\" must be an array of strings");
+        for (const auto& item : o->items) {
+            if (!item.isString()) return serveError(id, "\"options\" must be an array of strings");
+            args.push_back(item.text);
+        }
+    }
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back(&a[0]);
+    const int argc = static_cast<int>(argv.size());
+
+    std::ostringstream err;
+    std::ostringstream out;
+    RunStats stats;
+    RunContext ctx{ out, cache, disk };
+    bool ok = true;
+    int exitCode = 0;
+
+    try {
+        RunStats::Timer readTime(&stats, "read");
+        const SourceText text = source ? SourceText::fromString(source->text) : SourceText::fromFile(path->text);
+        readTime.stop();
+
+        if (command == "simulate") {
+            SimCliOptions simCli = parseSimOptions(argc, argv.data(), 3, err, ok);
+            if (!ok || simCli.help) return serveError(id, ok ? "--help is not available in serve" : err.str());
+            if (!simCli.astCacheDir.empty()) return serveError(id, "--ast-cache is an option of serve itself");
+            simCli.simOpt.json = simCli.simOpt.jsonCompact = true;
+            if (simCli.stats) ctx.stats = &stats;
+            exitCode = runSimulateFromText(sourceName, text, simCli, ctx);
+        } else if (command == "explore") {
+            ExploreCliOptions exploreCli = parseExploreOptions(argc, argv.data(), 3, err, ok);
+            if (!ok || exploreCli.help) return serveError(id, ok ? "--help is not available in serve" : err.str());
+            if (!exploreCli.astCacheDir.empty()) return serveError(id, "--ast-cache is an option of serve itself");
+            exploreCli.exploreOpt.sim.json = exploreCli.exploreOpt.sim.jsonCompact = true;
+            if (exploreCli.stats) ctx.stats = &stats;
+            exitCode = runExploreFromText(sourceName, text, exploreCli, ctx);
+        } else {
+            RunOptions opt = parseRunOptions(command, argc, argv.data(), 3, err, ok);
+            if (!ok) return serveError(id, err.str());
+            if (!opt.astCacheDir.empty()) return serveError(id, "--ast-cache is an option of serve itself");
+            opt.json = opt.jsonCompact = true;
+            if (opt.stats) ctx.stats = &stats;
+            exitCode = -1;
+            if (document && docs && opt.parserMode == ParserMode::Auto && !opt.printTree) {
+                auto doc = docs->open(document->text);
+                std::lock_guard<std::mutex> lock(doc->mu);
+                exitCode = runDocumentUpdate(command, sourceName, *doc, std::string(text.text()), out, ctx.stats);
+            }
+            if (exitCode < 0) {
+                if (command == "parse") exitCode = runParseFromText(sourceName, text, opt, ctx);
+                else if (command == "tokens") exitCode = runTokensFromText(sourceName, text, opt, ctx);
+                else exitCode = runAstFromText(sourceName, text, opt, ctx);
+            }
+        }
+    } catch (const std::exception& ex) {
+        return serveError(id, ex.what());
+    }
+
+    // the command's --json-compact report, without its final newline
+    std::string result = out.str();
+    while (!result.empty() && result.back() == '\n') result.pop_back();
+    return "{\"id\":" + id + ",\"exitCode\":" + std::to_string(exitCode) + ",\"result\":" + result + "}";
+}
+
+static int runServe(const ServeOptions& opt) {
+    std::unique_ptr<AstCache> cache;
+    if (opt.cacheMb > 0) cache = std::make_unique<AstCache>(static_cast<size_t>(opt.cacheMb) << 20);
+
+    std::unique_ptr<AstDiskCache> disk;
+    if (!opt.astCacheDir.empty()) disk = std::make_unique<AstDiskCache>(opt.astCacheDir, RC_PARSER_VERSION);
+
+    DocumentStore documents;
+
+    Server server([c = cache.get(), k = disk.get(), d = &documents](const std::string& line) {
+                      return handleServeRequest(line, c, k, d);
+                  },
+                  opt.threads);
+
+    if (opt.socketPath.empty()) {
+        server.serveStream(std::cin, std::cout);
+    } else {
+        server.serveUnixSocket(opt.socketPath);
+    }
+    return 0;
+}
+
+// -------------------- Main --------------------
+// <file.rc>, or --stdin / --; the load is the "read" phase of --stats
+static SourceText readInput(const std::string& inputArg, RunStats& stats) {
+    RunStats::Timer t(&stats, "read");
+    const bool useStdin = (inputArg == "--stdin" || inputArg == "--");
+    return useStdin ? SourceText::fromStdin() : SourceText::fromFile(inputArg);
+}
+
+int main(int argc, char** argv) {
+    try {
+        if (argc >= 2 && std::string(argv[1]) == "serve") {
+            bool ok = true;
+            const ServeOptions serveOpt = parseServeOptions(argc, argv, 2, std::cerr, ok);
+            if (!ok) {
+                printServeUsage(std::cerr);
+                return 2;
+            }
+            if (serveOpt.help) {
+                printServeUsage(std::cout);
+                return 0;
+            }
+            return runServe(serveOpt);
+        }
+
+        if (argc == 2) {
+            const std::string arg = argv[1];
+            if (arg == "--help" || arg == "-h") {
+                printUsage(std::cout);
+                return 0;
+            }
+            if (arg == "--version") {
+                printVersion(std::cout);
+                return 0;
+            }
+            printUsage(std::cerr);
+            return 2;
+        }
+
+        if (argc == 3) {
+            const std::string command = argv[1];
+            const std::string arg2 = argv[2];
+            if (command == "simulate" && (arg2 == "--help" || arg2 == "-h")) {
                 printSimUsage(std::cout);
                 return 0;
             }
-            return runSimulateFromText(sourceName, text, simCli);
+            if (command == "explore" && (arg2 == "--help" || arg2 == "-h")) {
+                printExploreUsage(std::cout);
+                return 0;
+            }
         }
 
-        for (int i = 3; i < argc; ++i) {
-            const std::string a = argv[i];
-            if (a == "--quiet") opt.quiet = true;
-            else if (a == "--print-tree") opt.printTree = true;
-            else if (a == "--with-loc") opt.withLoc = true;
-            else if (a == "--json") opt.json = true;
-            else {
-                std::cerr << "Unknown option: " << a << "\n";
+        // --batch takes any number of inputs: checked before the argc limit
+        if (argc >= 3 && std::string(argv[2]) == "--batch") {
+            const std::string command = argv[1];
+            if (command != "parse" && command != "ast" && command != "simulate") {
+                std::cerr << "--batch is only supported by parse, ast and simulate\n";
                 printUsage(std::cerr);
                 return 2;
             }
+
+            bool ok = true;
+            BatchOptions batchOpt = parseBatchOptions(command, argc, argv, 3, std::cerr, ok);
+            if (!ok) {
+                printBatchUsage(std::cerr);
+                return 2;
+            }
+            if (batchOpt.help) {
+                printBatchUsage(std::cout);
+                return 0;
+            }
+            return runBatch(command, batchOpt);
+        }
+
+        if (argc < 3 || argc > 64) {
+            printUsage(std::cerr);
+            return 2;
+        }
+
+        const std::string command = argv[1];
+        const std::string inputArg = argv[2];
+
+        if (command == "simulate") {
+            const bool useStdin = (inputArg == "--stdin" || inputArg == "--");
+            const std::string sourceName = useStdin ? "<stdin>" : inputArg;
+            RunStats stats;
+            const SourceText text = readInput(inputArg, stats);
+
+            bool ok = true;
+            SimCliOptions simCli = parseSimOptions(argc, argv, 3, std::cerr, ok);
+            if (!ok) {
+                printSimUsage(std::cerr);
+                return 2;
+            }
+            if (simCli.help) {
+                printSimUsage(std::cout);
+                return 0;
+            }
+            std::unique_ptr<AstDiskCache> diskCache;
+            if (!simCli.astCacheDir.empty()) diskCache = std::make_unique<AstDiskCache>(simCli.astCacheDir, RC_PARSER_VERSION);
+            const int rc = runSimulateFromText(sourceName, text, simCli,
+                                               { std::cout, nullptr, diskCache.get(), simCli.stats ? &stats : nullptr });
+            if (simCli.stats && !simCli.simOpt.json) stats.writeText(std::cerr);
+            return rc;
+        }
+
+        if (command == "explore") {
+            const bool useStdin = (inputArg == "--stdin" || inputArg == "--");
+            const std::string sourceName = useStdin ? "<stdin>" : inputArg;
+            RunStats stats;
+            const SourceText text = readInput(inputArg, stats);
+
+            bool ok = true;
+            ExploreCliOptions exploreCli = parseExploreOptions(argc, argv, 3, std::cerr, ok);
+            if (!ok) {
+                printExploreUsage(std::cerr);
+                return 2;
+            }
+            if (exploreCli.help) {
+                printExploreUsage(std::cout);
+                return 0;
+            }
+            std::unique_ptr<AstDiskCache> diskCache;
+            if (!exploreCli.astCacheDir.empty()) diskCache = std::make_unique<AstDiskCache>(exploreCli.astCacheDir, RC_PARSER_VERSION);
+            const int rc = runExploreFromText(sourceName, text, exploreCli,
+                                              { std::cout, nullptr, diskCache.get(), exploreCli.stats ? &stats : nullptr });
+            if (exploreCli.stats && !exploreCli.exploreOpt.sim.json) stats.writeText(std::cerr);
+            return rc;
+        }
+
+        bool ok = true;
+        const RunOptions opt = parseRunOptions(command, argc, argv, 3, std::cerr, ok);
+        if (!ok) {
+            printUsage(std::cerr);
+            return 2;
         }
 
         const bool useStdin = (inputArg == "--stdin" || inputArg == "--");
         const std::string sourceName = useStdin ? "<stdin>" : inputArg;
-        std::string text = useStdin ? readStdinToString() : readFileToString(inputArg);
-
-        if (command == "parse")  return runParseFromText(sourceName, text, opt);
-        if (command == "tokens") return runTokensFromText(sourceName, text, opt);
-        if (command == "ast")    return runAstFromText(sourceName, text, opt);
+        RunStats stats;
+        const SourceText text = readInput(inputArg, stats);
+
+        std::unique_ptr<AstDiskCache> diskCache;
+        if (!opt.astCacheDir.empty()) diskCache = std::make_unique<AstDiskCache>(opt.astCacheDir, RC_PARSER_VERSION);
+
+        const RunContext ctx{ std::cout, nullptr, diskCache.get(), opt.stats ? &stats : nullptr };
+        int rc = 0;
+        if (command == "parse")       rc = runParseFromText(sourceName, text, opt, ctx);
+        else if (command == "tokens") rc = runTokensFromText(sourceName, text, opt, ctx);
+        else if (command == "ast")    rc = runAstFromText(sourceName, text, opt, ctx);
+        else {
+            printUsage(std::cerr);
+            return 2;
+        }
 
-        printUsage(std::cerr);
-        return 2;
+        if (opt.stats && !opt.json) stats.writeText(std::cerr);
+        return rc;
 
     } catch (const std::exception& ex) {
         std::cerr << "Error: " << ex.what() << "\n";
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <utility>
+
+namespace runtime {
+
+// Shared, copy-on-write owner of a T. Copies share the object; mut()
+// clones it first unless this handle is the only owner. The reference
+// count is checked with acquire ordering, so a handle that sees itself
+// unique may write even if other threads dropped their copies just before
+// (std::shared_ptr::use_count() is relaxed and cannot be used for that).
+// A null handle reads as nothing and mut() default-constructs.
+template <class T>
+class CowPtr final {
+public:
+    CowPtr() = default;
+
+    template <class... Args>
+    static CowPtr make(Args&&... args) {
+        CowPtr p;
+        p.node_ = new Node{ {1}, T(std::forward<Args>(args)...) };
+        return p;
+    }
+
+    CowPtr(const CowPtr& o) noexcept : node_(o.node_) {
+        if (node_) node_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    CowPtr(CowPtr&& o) noexcept : node_(std::exchange(o.node_, nullptr)) {}
+
+    CowPtr& operator=(const CowPtr& o) noexcept {
+        CowPtr tmp(o);
+        std::swap(node_, tmp.node_);
+        return *this;
+    }
+    CowPtr& operator=(CowPtr&& o) noexcept {
+        CowPtr tmp(std::move(o));
+        std::swap(node_, tmp.node_);
+        return *this;
+    }
+
+    ~CowPtr() { release(); }
+
+    explicit operator bool() const { return node_ != nullptr; }
+
+    const T& operator*() const { return node_->value; }
+    const T* operator->() const { return &node_->value; }
+
+    T& mut() {
+        if (!node_) {
+            node_ = new Node{ {1}, T() };
+        } else if (node_->refs.load(std::memory_order_acquire) != 1) {
+            Node* copy = new Node{ {1}, node_->value };
+            release();
+            node_ = copy;
+        }
+        return node_->value;
+    }
+
+private:
+    struct Node {
+        std::atomic<long> refs;
+        T value;
+    };
+
+    Node* node_ = nullptr;
+
+    void release() {
+        if (node_ && node_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete node_;
+        node_ = nullptr;
+    }
+};
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "runtime/CowPtr.h"
+
+namespace runtime {
+
+// Paged copy-on-write vector. Copying one is O(1): the copy shares the
+// page table and every page with the original. The first write through
+// either side clones the page table (one pointer per page) and the page
+// it touches; untouched pages stay shared.
+template <class T, unsigned PageBits = 6>
+class CowVector final {
+public:
+    static constexpr size_t kPageSize = size_t{1} << PageBits;
+
+    CowVector() = default;
+    CowVector(const CowVector&) = default;
+    CowVector& operator=(const CowVector&) = default;
+
+    // moved-from vectors are empty
+    CowVector(CowVector&& o) noexcept : table_(std::move(o.table_)), size_(std::exchange(o.size_, 0)) {}
+    CowVector& operator=(CowVector&& o) noexcept {
+        table_ = std::move(o.table_);
+        size_ = std::exchange(o.size_, 0);
+        return *this;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const T& operator[](size_t i) const {
+        return (*table_)[i >> PageBits]->items[i & (kPageSize - 1)];
+    }
+
+    // writable element; detaches what is shared
+    T& mut(size_t i) {
+        return table_.mut()[i >> PageBits].mut().items[i & (kPageSize - 1)];
+    }
+
+    void set(size_t i, const T& v) { mut(i) = v; }
+
+    void push_back(const T& v) {
+        if ((size_ & (kPageSize - 1)) == 0) table_.mut().push_back(PagePtr::make());
+        mut(size_++) = v;
+    }
+
+    // grows with value-initialized elements
+    void resize(size_t n) {
+        while (size_ < n) {
+            if ((size_ & (kPageSize - 1)) == 0) table_.mut().push_back(PagePtr::make());
+            size_ = std::min(n, (size_ | (kPageSize - 1)) + 1);
+        }
+    }
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        const_iterator(const CowVector* v, size_t i) : v_(v), i_(i) {}
+
+        const T& operator*() const { return (*v_)[i_]; }
+        const T* operator->() const { return &(*v_)[i_]; }
+        const_iterator& operator++() { ++i_; return *this; }
+        bool operator==(const const_iterator& o) const { return i_ == o.i_; }
+        bool operator!=(const const_iterator& o) const { return i_ != o.i_; }
+
+    private:
+        const CowVector* v_;
+        size_t i_;
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size_); }
+
+private:
+    struct Page {
+        std::array<T, kPageSize> items{};
+    };
+    using PagePtr = CowPtr<Page>;
+    using Table = std::vector<PagePtr>;
+
+    CowPtr<Table> table_; // null while empty
+    size_t size_ = 0;
+};
+
+}
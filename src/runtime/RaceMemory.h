@@ -1,75 +1,131 @@
 #pragma once
-#include <string>
-#include <unordered_map>
-#include <optional>
+#include <cstdint>
+#include <vector>
 
+#include "runtime/CowPtr.h"
+#include "runtime/Symbols.h"
 #include "runtime/Value.h"
 
 namespace runtime {
 
+// s[k]: resolved process id + interned key (Symbols::raceKeys)
 struct RaceKey {
-    std::string process; // s
-    std::string key;     // k
+    ProcId process = 0;    // s
+    RaceKeyId key = 0;     // k
 
     bool operator==(const RaceKey& other) const {
         return process == other.process && key == other.key;
     }
 };
 
-struct RaceKeyHash {
-    size_t operator()(const RaceKey& rk) const noexcept {
-        std::hash<std::string> h;
-        size_t a = h(rk.process);
-        size_t b = h(rk.key);
-        // simple hash combine
-        return a ^ (b + 0x9e3779b97f4a7c15ULL + (a << 6) + (a >> 2));
-    }
-};
-
 enum class RaceWinnerSide { Left, Right };
 
 struct RaceEntry {
-    std::string leftProc;
-    std::string rightProc;
+    ProcId left = 0;
+    ProcId right = 0;
 
     RaceWinnerSide winnerSide = RaceWinnerSide::Left;
-    std::string winnerProc;
-    std::string loserProc;
 
     Value vWinner;
     Value vLoser;
 
-    bool discharged = false;
+    ProcId winner() const { return winnerSide == RaceWinnerSide::Left ? left : right; }
+    ProcId loser() const  { return winnerSide == RaceWinnerSide::Left ? right : left; }
 };
 
+// Race memory M. Entries sit in a dense array in resolution order; a flat
+// open-addressing table (linear probing, power-of-two size) maps the packed
+// key to the entry index, and the discharged flags are a bitset next to the
+// entries. The whole state is copy-on-write, so forks share it until one
+// of them resolves or discharges a race.
 class RaceMemory {
 public:
-    bool contains(const RaceKey& k) const {
-        return mem_.find(k) != mem_.end();
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    // entry index, or npos
+    uint32_t find(const RaceKey& k) const {
+        if (!t_) return npos;
+        const Table& t = *t_;
+        const size_t mask = t.slots.size() - 1;
+        for (size_t i = hash(k) & mask;; i = (i + 1) & mask) {
+            const uint32_t s = t.slots[i];
+            if (s == 0) return npos;
+            if (t.keys[s - 1] == k) return s - 1;
+        }
     }
 
+    bool contains(const RaceKey& k) const { return find(k) != npos; }
+
     const RaceEntry* get(const RaceKey& k) const {
-        auto it = mem_.find(k);
-        if (it == mem_.end()) return nullptr;
-        return &it->second;
+        const uint32_t i = find(k);
+        return i == npos ? nullptr : &t_->entries[i];
     }
 
-    RaceEntry* getMut(const RaceKey& k) {
-        auto it = mem_.find(k);
-        if (it == mem_.end()) return nullptr;
-        return &it->second;
+    // inserts, or overwrites an existing entry; returns its index
+    uint32_t put(const RaceKey& k, const RaceEntry& e) {
+        const uint32_t existing = find(k);
+        Table& t = t_.mut();
+        if (existing != npos) {
+            t.entries[existing] = e;
+            return existing;
+        }
+
+        if ((t.keys.size() + 1) * 2 > t.slots.size()) rehash(t, t.slots.empty() ? 8 : t.slots.size() * 2);
+
+        const uint32_t idx = static_cast<uint32_t>(t.keys.size());
+        t.keys.push_back(k);
+        t.entries.push_back(e);
+        if ((idx & 63) == 0) t.discharged.push_back(0);
+        insertSlot(t, k, idx);
+        return idx;
     }
 
-    void put(const RaceKey& k, RaceEntry e) {
-        mem_[k] = std::move(e);
+    size_t size() const { return t_ ? t_->keys.size() : 0; }
+    bool empty() const { return size() == 0; }
+
+    const RaceKey& keyAt(uint32_t i) const { return t_->keys[i]; }
+    const RaceEntry& entry(uint32_t i) const { return t_->entries[i]; }
+
+    bool discharged(uint32_t i) const {
+        return (t_->discharged[i >> 6] >> (i & 63)) & 1u;
     }
 
-    const std::unordered_map<RaceKey, RaceEntry, RaceKeyHash>& raw() const {
-        return mem_;
+    void setDischarged(uint32_t i) {
+        t_.mut().discharged[i >> 6] |= (uint64_t{1} << (i & 63));
+    }
+
+    // f(const RaceKey&, const RaceEntry&, bool discharged), in resolution order
+    template <class F>
+    void forEach(F&& f) const {
+        for (uint32_t i = 0; i < size(); ++i) f(t_->keys[i], t_->entries[i], discharged(i));
     }
 
 private:
-    std::unordered_map<RaceKey, RaceEntry, RaceKeyHash> mem_;
+    struct Table {
+        std::vector<uint32_t> slots;  // entry index + 1, 0 = empty
+        std::vector<RaceKey> keys;
+        std::vector<RaceEntry> entries;
+        std::vector<uint64_t> discharged;
+    };
+
+    CowPtr<Table> t_; // null while empty
+
+    static size_t hash(const RaceKey& k) {
+        const uint64_t x = (uint64_t{k.process} << 32) | k.key;
+        return static_cast<size_t>((x * 0x9e3779b97f4a7c15ULL) >> 32);
+    }
+
+    static void insertSlot(Table& t, const RaceKey& k, uint32_t idx) {
+        const size_t mask = t.slots.size() - 1;
+        size_t i = hash(k) & mask;
+        while (t.slots[i] != 0) i = (i + 1) & mask;
+        t.slots[i] = idx + 1;
+    }
+
+    static void rehash(Table& t, size_t n) {
+        t.slots.assign(n, 0);
+        for (uint32_t i = 0; i < t.keys.size(); ++i) insertSlot(t, t.keys[i], i);
+    }
 };
 
-} 
\ No newline at end of file
+}
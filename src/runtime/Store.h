@@ -1,38 +1,113 @@
 #pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <string>
-#include <unordered_map>
-#include <optional>
+#include <vector>
 
+#include "runtime/CowVector.h"
+#include "runtime/Symbols.h"
 #include "runtime/Value.h"
 
 namespace runtime {
 
 // Store Σ: Process.Var -> Value
+//
+// Dense (process-id, var-id) slot matrix sized from the symbol table, plus
+// an "initialized" bitmap. Names are only rebuilt by raw()/key() when the
+// store is printed. Both live in copy-on-write pages, so copying a Store
+// (forking a simulation) is O(1).
 class Store final {
 public:
+    Store() = default;
+
+    explicit Store(std::shared_ptr<const Symbols> symbols)
+        : symbols_(std::move(symbols)) {
+        if (symbols_) {
+            procs_ = symbols_->processes.size();
+            vars_  = symbols_->vars.size();
+        }
+        slots_.resize(procs_ * vars_);
+        init_.resize((slots_.size() + 63) / 64);
+    }
+
     static std::string key(const std::string& process, const std::string& var) {
         return process + "." + var;
     }
 
-    bool has(const std::string& process, const std::string& var) const {
-        return map_.find(key(process, var)) != map_.end();
+    bool has(ProcId p, VarId x) const {
+        const size_t i = index(p, x);
+        return (init_[i >> 6] >> (i & 63)) & 1u;
     }
 
-    std::optional<Value> tryGet(const std::string& process, const std::string& var) const {
-        auto it = map_.find(key(process, var));
-        if (it == map_.end()) return std::nullopt;
-        return it->second;
+    // nullptr if p.x is uninitialized
+    const Value* tryGet(ProcId p, VarId x) const {
+        const size_t i = index(p, x);
+        if (!((init_[i >> 6] >> (i & 63)) & 1u)) return nullptr;
+        return &slots_[i];
     }
 
     // Set Σ[p.x ↦ v]
-    void set(const std::string& process, const std::string& var, const Value& v) {
-        map_[key(process, var)] = v;
+    void set(ProcId p, VarId x, const Value& v) {
+        const size_t i = index(p, x);
+        slots_.set(i, v);
+        const uint64_t bit = uint64_t{1} << (i & 63);
+        if (!(init_[i >> 6] & bit)) init_.mut(i >> 6) |= bit;
+    }
+
+    // number of initialized entries
+    size_t size() const {
+        size_t n = 0;
+        for (uint64_t w : init_) {
+            for (; w; w &= w - 1) ++n;
+        }
+        return n;
+    }
+
+    bool empty() const {
+        for (uint64_t w : init_) if (w) return false;
+        return true;
+    }
+
+    // f(ProcId, VarId, const Value&) for every initialized entry
+    template <class F>
+    void forEach(F&& f) const {
+        for (size_t wi = 0; wi < init_.size(); ++wi) {
+            for (uint64_t w = init_[wi]; w; w &= w - 1) {
+                const size_t i = (wi << 6) + static_cast<size_t>(ctz(w));
+                f(static_cast<ProcId>(i / vars_), static_cast<VarId>(i % vars_), slots_[i]);
+            }
+        }
+    }
+
+    // "p.x" -> value, sorted by name (output only)
+    std::map<std::string, Value> raw() const {
+        std::map<std::string, Value> out;
+        forEach([&](ProcId p, VarId x, const Value& v) {
+            out.emplace(key(symbols_->processes.name(p), symbols_->vars.name(x)), v);
+        });
+        return out;
     }
 
-    const std::unordered_map<std::string, Value>& raw() const { return map_; }
+    const std::shared_ptr<const Symbols>& symbols() const { return symbols_; }
 
 private:
-    std::unordered_map<std::string, Value> map_;
+    std::shared_ptr<const Symbols> symbols_;
+    size_t procs_ = 0;
+    size_t vars_ = 0;
+
+    CowVector<Value> slots_;
+    CowVector<uint64_t> init_;
+
+    size_t index(ProcId p, VarId x) const {
+        return static_cast<size_t>(p) * vars_ + x;
+    }
+
+    static int ctz(uint64_t w) {
+        int n = 0;
+        while (!(w & 1u)) { w >>= 1; ++n; }
+        return n;
+    }
 };
 
-}
\ No newline at end of file
+}
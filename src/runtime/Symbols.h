@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace runtime {
+
+using SymbolId = uint32_t;
+using ProcId   = SymbolId;
+using VarId    = SymbolId;
+using RaceKeyId = SymbolId;
+
+static constexpr SymbolId kNoSymbol = UINT32_MAX;
+
+// Dense string <-> id mapping. Ids are assigned in first-seen order and
+// never change, so they can index flat arrays directly.
+class SymbolTable final {
+public:
+    SymbolId intern(const std::string& s) {
+        auto it = ids_.find(s);
+        if (it != ids_.end()) return it->second;
+
+        const SymbolId id = static_cast<SymbolId>(names_.size());
+        names_.push_back(s);
+        ids_.emplace(s, id);
+        return id;
+    }
+
+    SymbolId find(const std::string& s) const {
+        auto it = ids_.find(s);
+        return it == ids_.end() ? kNoSymbol : it->second;
+    }
+
+    const std::string& name(SymbolId id) const { return names_[id]; }
+    size_t size() const { return names_.size(); }
+
+private:
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, SymbolId> ids_;
+};
+
+// Names interned at load time (sim::compile + --init bindings).
+// Processes and variables live in separate spaces so the Store can be a
+// (process, var) matrix; race keys (the k of s[k]) have their own space.
+struct Symbols {
+    SymbolTable processes;
+    SymbolTable vars;
+    SymbolTable raceKeys;
+};
+
+}
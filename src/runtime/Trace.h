@@ -1,27 +1,73 @@
 #pragma once
-#include <string>
-#include <vector>
-
-#include "ast/SourceLocation.h"
+#include <cstdint>
+#include "runtime/CowVector.h"
+#include "runtime/Symbols.h"
+#include "runtime/Value.h"
 
 namespace runtime {
 
+enum class TraceKind : uint8_t {
+    Init,   // "init"
+    Asg,    // "asg"
+    Com,    // "com"
+    Sel,    // "sel"
+    Race,   // "race"
+    IfRace, // "ifRace"
+    If,     // "if"
+    Dis,    // "dis"
+    Call,   // "call"
+    Ret     // "ret"
+};
+
+// Compact, typed trace record. Nothing is formatted while the simulation
+// runs: sim::TraceFormatter turns records into text/JSON at emission time.
+//
+// Field use per kind (p = resolved process ids):
+//   Init/Asg  p[0].var = value
+//   Com       p[0].<expr ref> = value -> p[1].var
+//   Sel       p[0] -> p[1] [<label ref>]
+//   Race      p[0][<race ref>] winner=p[1] loser=p[2] write p[3].var=value
+//   IfRace    p[0][<race ref>] winner=p[1] -> then|else (flag)
+//   If        cond=flag @ p[0].<expr ref> -> then|else
+//   Dis       p[0][<race ref>] loser=p[1] write p[2].var=value
+//   Call      <call ref>(args[p[0] .. p[0]+arity))
+//   Ret       <call ref>
 struct TraceEvent {
-    std::string kind;     // "asg", "com", "race", "if", ...
-    std::string message;  // printable line
-    ast::SourceRange loc; 
-    // For CLI trace
-    std::string toString() const {
-        
-        std::string out = kind;
-        if (!loc.file.empty()) {
-            out += " @" + loc.file + ":" + std::to_string(loc.start.line) + ":" + std::to_string(loc.start.col);
-        }
-        out += " " + message;
-        return out;
-    }
+    TraceKind kind = TraceKind::Asg;
+    bool flag = false;
+
+    uint32_t node = 0; // source node (index into the module loc table)
+    uint32_t ref = 0;  // kind-specific module operand
+
+    ProcId p[4] = { 0, 0, 0, 0 };
+    VarId var = 0;
+    Value value;
 };
 
-using Trace = std::vector<TraceEvent>;
+// Append-only; copy-on-write pages make copies (snapshots) O(1).
+class Trace final {
+public:
+    using const_iterator = CowVector<TraceEvent, 8>::const_iterator;
+
+    void push(const TraceEvent& ev) { events_.push_back(ev); }
+
+    // call arguments, referenced by TraceKind::Call events
+    uint32_t pushArgs(const ProcId* first, size_t n) {
+        const uint32_t off = static_cast<uint32_t>(args_.size());
+        for (size_t i = 0; i < n; ++i) args_.push_back(first[i]);
+        return off;
+    }
+    ProcId arg(uint32_t off, size_t i) const { return args_[off + i]; }
+
+    size_t size() const { return events_.size(); }
+    bool empty() const { return events_.empty(); }
+
+    const_iterator begin() const { return events_.begin(); }
+    const_iterator end() const { return events_.end(); }
+
+private:
+    CowVector<TraceEvent, 8> events_;
+    CowVector<ProcId, 8> args_;
+};
 
-} 
\ No newline at end of file
+}
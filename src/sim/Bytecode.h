@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast/SourceLocation.h"
+#include "runtime/Symbols.h"
+#include "runtime/Value.h"
+
+namespace sim {
+namespace bc {
+
+// Flat instruction stream produced by sim::compile() from an ast::Program.
+//
+// Layout: main body first (terminated by Halt), then every procedure body
+// (terminated by Ret). if-statements lower to a conditional jump to the
+// else-branch plus an unconditional Jump over it at the end of the
+// then-branch, so blocks never push frames at runtime; only Call does.
+enum class Op : uint8_t {
+    Assign,     // a = target ProcVar, b = value ProcExpr
+    Comm,       // a = from ProcExpr,  b = to ProcVar
+    Select,     // a = from ProcRef, b = to ProcRef, c = label
+    Race,       // a = RaceRef, b = left ProcExpr, c = right ProcExpr, d = target ProcVar
+    Discharge,  // a = RaceRef, b = source ProcRef, c = target ProcVar
+    IfLocal,    // a = condition ProcExpr, b = else pc
+    IfRace,     // a = RaceRef, b = else pc
+    Jump,       // a = target pc
+    Call,       // a = CallSite
+    Ret,        // end of a procedure body
+    Halt        // end of main
+};
+
+struct Instr {
+    Op op = Op::Halt;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+    uint32_t d = 0;
+
+    uint32_t loc = 0; // index into Module::locs
+};
+
+// Variable operands and race keys are ids in Module::symbols.
+//
+// Process operands are ProcRefs: either a process id, or (inside a procedure
+// body) a slot of the current frame's environment. A procedure environment
+// is a small array of process ids laid out as ProcInfo::layout: the formal
+// parameters first, then any name a caller may have bound (the old
+// substitution maps were inherited by callees, and that scoping is kept).
+// An unbound slot simply holds its own name.
+using ProcRef = uint32_t;
+
+static constexpr ProcRef kSlotBit = 0x80000000u;
+
+inline bool isSlot(ProcRef r) { return (r & kSlotBit) != 0; }
+inline uint32_t slotOf(ProcRef r) { return r & ~kSlotBit; }
+inline ProcRef slotRef(uint32_t slot) { return slot | kSlotBit; }
+
+// p.e where e is a variable or a literal
+struct ProcExprRef {
+    ProcRef process = 0;
+    bool isVar = false;
+    runtime::VarId var = 0;  // isVar
+    runtime::Value literal;  // !isVar
+
+    std::string text;       // printable form of e
+    uint32_t exprLoc = 0;   // loc of e (uninitialized-variable errors)
+    uint32_t loc = 0;       // loc of p.e (condition errors)
+};
+
+struct ProcVarRef {
+    ProcRef process = 0;
+    runtime::VarId var = 0;
+};
+
+struct RaceRef {
+    ProcRef process = 0;
+    runtime::RaceKeyId key = 0;
+};
+
+// How one slot of the callee environment is filled, in caller terms.
+// Formal slots are resolved a second time through the caller environment,
+// as composeSubst() used to do.
+struct SlotInit {
+    ProcRef src = 0;
+    bool formal = false;
+};
+
+struct CallSite {
+    std::string proc;              // name as written at the call site
+    uint32_t callee = 0;           // index into Module::procs, or kNoProc
+    std::vector<ProcRef> args;
+    std::vector<SlotInit> slots;   // one per callee layout slot (empty on arity mismatch)
+};
+
+struct ProcInfo {
+    std::string name;
+    std::vector<runtime::ProcId> params;
+    std::vector<runtime::ProcId> layout; // slot -> name
+    uint32_t entry = 0;
+};
+
+static constexpr uint32_t kNoProc = UINT32_MAX;
+
+struct Module {
+    std::vector<Instr> code;
+
+    std::vector<ProcExprRef> exprs;
+    std::vector<ProcVarRef>  vars;
+    std::vector<RaceRef>     races;
+    std::vector<CallSite>    calls;
+    std::vector<std::string> labels;
+    std::vector<ProcInfo>    procs;
+
+    std::shared_ptr<runtime::Symbols> symbols = std::make_shared<runtime::Symbols>();
+
+    std::vector<ast::SourceRange> locs;
+
+    uint32_t entry = 0;
+    uint32_t programLoc = 0;
+    uint32_t initLoc = 0;     // "<init>" pseudo-location for --init bindings
+};
+
+} // namespace bc
+} // namespace sim
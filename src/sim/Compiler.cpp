@@ -0,0 +1,312 @@
+#include "sim/Compiler.h"
+
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <variant>
+
+namespace sim {
+
+namespace {
+
+static void collectCalls(const ast::Block& b, std::vector<const ast::CallStmt*>& out) {
+    for (const auto& st : b.statements) {
+        std::visit([&](auto&& node) {
+            using T = std::decay_t<decltype(node)>;
+            if constexpr (std::is_same_v<T, ast::CallStmt>) {
+                out.push_back(&node);
+            } else if constexpr (std::is_same_v<T, ast::IfLocalStmt> ||
+                                 std::is_same_v<T, ast::IfRaceStmt>) {
+                collectCalls(*node.thenBlock, out);
+                collectCalls(*node.elseBlock, out);
+            }
+        }, *st);
+    }
+}
+
+class Lowering final {
+public:
+    explicit Lowering(bc::Module& m) : m_(m) {}
+
+    void program(const ast::Program& p) {
+        m_.programLoc = loc(p.loc);
+
+        ast::SourceRange init;
+        init.file = ast::SourceFiles::intern("<init>");
+        m_.initLoc = loc(init);
+
+        // procedure table first, so calls can be resolved in one pass
+        // (same rule as the old buildProcTable: last definition wins)
+        for (const auto& def : p.procedures) {
+            auto it = procIndex_.find(def->name);
+            if (it == procIndex_.end()) {
+                procIndex_.emplace(def->name, static_cast<uint32_t>(m_.procs.size()));
+                m_.procs.push_back(bc::ProcInfo{ def->name, processes(def->params), {}, 0 });
+            } else {
+                m_.procs[it->second].params = processes(def->params);
+            }
+            procDefs_[def->name] = def;
+        }
+
+        computeLayouts();
+
+        m_.entry = pc();
+        block(*p.main->body);
+        emit(bc::Op::Halt, loc(p.main->loc));
+
+        for (auto& info : m_.procs) {
+            enterBody(info);
+            info.entry = pc();
+            const ast::ProcDef* def = procDefs_.at(info.name);
+            block(*def->body);
+            emit(bc::Op::Ret, loc(def->loc));
+        }
+    }
+
+private:
+    bc::Module& m_;
+    std::unordered_map<std::string, uint32_t> procIndex_;
+    std::unordered_map<std::string, const ast::ProcDef*> procDefs_;
+
+    // slots of the body being lowered (empty for main)
+    std::unordered_map<runtime::ProcId, uint32_t> slots_;
+
+    // A name can be bound in P's environment if it is a formal of P or can
+    // be bound in any caller of P. Formals come first in the layout; the
+    // inherited names follow in id order.
+    void computeLayouts() {
+        const size_t n = m_.procs.size();
+        std::vector<std::vector<uint32_t>> callees(n);
+        std::vector<std::set<runtime::ProcId>> bound(n);
+
+        auto calleesOf = [&](const ast::Block& body) {
+            std::vector<const ast::CallStmt*> calls;
+            collectCalls(body, calls);
+            std::vector<uint32_t> res;
+            for (const auto* c : calls) {
+                auto it = procIndex_.find(c->proc);
+                if (it != procIndex_.end()) res.push_back(it->second);
+            }
+            return res;
+        };
+
+        for (size_t i = 0; i < n; ++i) {
+            callees[i] = calleesOf(*procDefs_.at(m_.procs[i].name)->body);
+            bound[i].insert(m_.procs[i].params.begin(), m_.procs[i].params.end());
+        }
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t caller = 0; caller < n; ++caller) {
+                for (uint32_t callee : callees[caller]) {
+                    for (runtime::ProcId name : bound[caller]) {
+                        changed |= bound[callee].insert(name).second;
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            auto& layout = m_.procs[i].layout;
+            for (runtime::ProcId f : m_.procs[i].params) {
+                if (std::find(layout.begin(), layout.end(), f) == layout.end()) layout.push_back(f);
+            }
+            for (runtime::ProcId name : bound[i]) {
+                if (std::find(layout.begin(), layout.end(), name) == layout.end()) layout.push_back(name);
+            }
+        }
+    }
+
+    void enterBody(const bc::ProcInfo& info) {
+        slots_.clear();
+        for (uint32_t i = 0; i < info.layout.size(); ++i) slots_.emplace(info.layout[i], i);
+    }
+
+    uint32_t pc() const { return static_cast<uint32_t>(m_.code.size()); }
+
+    uint32_t loc(const ast::SourceRange& r) {
+        m_.locs.push_back(r);
+        return static_cast<uint32_t>(m_.locs.size() - 1);
+    }
+
+    uint32_t emit(bc::Op op, uint32_t locIdx,
+                  uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0) {
+        bc::Instr ins;
+        ins.op = op;
+        ins.a = a;
+        ins.b = b;
+        ins.c = c;
+        ins.d = d;
+        ins.loc = locIdx;
+        m_.code.push_back(ins);
+        return pc() - 1;
+    }
+
+    runtime::ProcId process(const std::string& s) {
+        return m_.symbols->processes.intern(s);
+    }
+
+    // process operand as seen from the body being lowered
+    bc::ProcRef procRef(runtime::ProcId id) const {
+        auto it = slots_.find(id);
+        return it == slots_.end() ? id : bc::slotRef(it->second);
+    }
+
+    bc::ProcRef procRef(const std::string& s) {
+        return procRef(process(s));
+    }
+
+    std::vector<runtime::ProcId> processes(const ast::List<ast::Process>& v) {
+        std::vector<runtime::ProcId> ids;
+        ids.reserve(v.size());
+        for (const auto& s : v) ids.push_back(process(s));
+        return ids;
+    }
+
+    runtime::VarId var(const std::string& s) {
+        return m_.symbols->vars.intern(s);
+    }
+
+    uint32_t label(const std::string& s) {
+        m_.labels.push_back(s);
+        return static_cast<uint32_t>(m_.labels.size() - 1);
+    }
+
+    uint32_t procExpr(const ast::ProcExpr& pe) {
+        return expr(pe.process, pe.expr, pe.loc);
+    }
+
+    // Σ(p,e): the process of an Assign value is the target process
+    uint32_t expr(const std::string& proc, const ast::Expr& e, const ast::SourceRange& outer) {
+        bc::ProcExprRef ref;
+        ref.process = procRef(proc);
+        ref.loc = loc(outer);
+
+        std::visit([&](auto&& node) {
+            using T = std::decay_t<decltype(node)>;
+            if constexpr (std::is_same_v<T, ast::ExprVar>) {
+                ref.isVar = true;
+                ref.var = var(node.name);
+                ref.text = node.name;
+                ref.exprLoc = node.loc.file == ast::kNoFile ? ref.loc : loc(node.loc);
+            } else if constexpr (std::is_same_v<T, ast::Value>) {
+                ref.literal = (node.kind == ast::Value::Kind::Int)
+                    ? runtime::Value::makeInt(node.intValue)
+                    : runtime::Value::makeBool(node.boolValue);
+                ref.text = ref.literal.toString();
+                ref.exprLoc = ref.loc;
+            }
+        }, e);
+
+        m_.exprs.push_back(std::move(ref));
+        return static_cast<uint32_t>(m_.exprs.size() - 1);
+    }
+
+    uint32_t procVar(const ast::ProcVar& pv) {
+        m_.vars.push_back(bc::ProcVarRef{ procRef(pv.process), var(pv.var) });
+        return static_cast<uint32_t>(m_.vars.size() - 1);
+    }
+
+    uint32_t raceId(const ast::RaceId& id) {
+        m_.races.push_back(bc::RaceRef{ procRef(id.process), m_.symbols->raceKeys.intern(id.key) });
+        return static_cast<uint32_t>(m_.races.size() - 1);
+    }
+
+    uint32_t callSite(const ast::CallStmt& c) {
+        bc::CallSite cs;
+        cs.proc = c.proc;
+        auto it = procIndex_.find(c.proc);
+        cs.callee = (it == procIndex_.end()) ? bc::kNoProc : it->second;
+        for (const auto& a : c.args) cs.args.push_back(procRef(a));
+
+        if (cs.callee != bc::kNoProc && m_.procs[cs.callee].params.size() == cs.args.size()) {
+            const bc::ProcInfo& def = m_.procs[cs.callee];
+            for (runtime::ProcId name : def.layout) {
+                bc::SlotInit init;
+                init.src = procRef(name);
+                // duplicated formals: the last argument wins
+                for (size_t i = 0; i < def.params.size(); ++i) {
+                    if (def.params[i] == name) {
+                        init.src = cs.args[i];
+                        init.formal = true;
+                    }
+                }
+                cs.slots.push_back(init);
+            }
+        }
+        m_.calls.push_back(std::move(cs));
+        return static_cast<uint32_t>(m_.calls.size() - 1);
+    }
+
+    void block(const ast::Block& b) {
+        for (const auto& st : b.statements) stmt(*st);
+    }
+
+    // if (c) { then } else { else }  ==>
+    //     If* c, L_else
+    //     <then>
+    //     Jump L_end
+    // L_else:
+    //     <else>
+    // L_end:
+    void branches(uint32_t ifPc, const ast::Block& thenB, const ast::Block& elseB, uint32_t locIdx) {
+        block(thenB);
+        const uint32_t jmp = emit(bc::Op::Jump, locIdx);
+        m_.code[ifPc].b = pc();
+        block(elseB);
+        m_.code[jmp].a = pc();
+    }
+
+    void stmt(const ast::Stmt& st) {
+        std::visit([&](auto&& node) {
+            using T = std::decay_t<decltype(node)>;
+
+            if constexpr (std::is_same_v<T, ast::InteractionStmt>) {
+                interaction(node.interaction);
+            } else if constexpr (std::is_same_v<T, ast::CallStmt>) {
+                emit(bc::Op::Call, loc(node.loc), callSite(node));
+            } else if constexpr (std::is_same_v<T, ast::IfLocalStmt>) {
+                const uint32_t l = loc(node.loc);
+                const uint32_t ifPc = emit(bc::Op::IfLocal, l, procExpr(node.condition));
+                branches(ifPc, *node.thenBlock, *node.elseBlock, l);
+            } else if constexpr (std::is_same_v<T, ast::IfRaceStmt>) {
+                const uint32_t l = loc(node.loc);
+                const uint32_t ifPc = emit(bc::Op::IfRace, l, raceId(node.condition));
+                branches(ifPc, *node.thenBlock, *node.elseBlock, l);
+            }
+        }, st);
+    }
+
+    // interactions report errors and trace at the interaction's own loc
+    void interaction(const ast::Interaction& in) {
+        std::visit([&](auto&& node) {
+            using I = std::decay_t<decltype(node)>;
+
+            if constexpr (std::is_same_v<I, ast::Assign>) {
+                emit(bc::Op::Assign, loc(node.loc),
+                     procVar(node.target), expr(node.target.process, node.value, node.loc));
+            } else if constexpr (std::is_same_v<I, ast::Comm>) {
+                emit(bc::Op::Comm, loc(node.loc), procExpr(node.from), procVar(node.to));
+            } else if constexpr (std::is_same_v<I, ast::Select>) {
+                emit(bc::Op::Select, loc(node.loc), procRef(node.from), procRef(node.to), label(node.label));
+            } else if constexpr (std::is_same_v<I, ast::Race>) {
+                emit(bc::Op::Race, loc(node.loc),
+                     raceId(node.id), procExpr(node.left), procExpr(node.right), procVar(node.target));
+            } else if constexpr (std::is_same_v<I, ast::Discharge>) {
+                emit(bc::Op::Discharge, loc(node.loc),
+                     raceId(node.id), procRef(node.source), procVar(node.target));
+            }
+        }, in);
+    }
+};
+
+} // namespace
+
+bc::Module compile(const ast::Program& program) {
+    bc::Module m;
+    Lowering(m).program(program);
+    return m;
+}
+
+}
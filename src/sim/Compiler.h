@@ -0,0 +1,13 @@
+#pragma once
+#include "ast/Ast.h"
+#include "sim/Bytecode.h"
+
+namespace sim {
+
+// Lowers a (validated) ast::Program into a flat bytecode module.
+// Undefined procedures and arity mismatches are not rejected here: the
+// corresponding Call instruction reports them when (and if) it executes,
+// exactly like the tree-walking interpreter did.
+bc::Module compile(const ast::Program& program);
+
+}
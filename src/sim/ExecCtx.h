@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "runtime/CowPtr.h"
+#include "runtime/RaceMemory.h"
+#include "runtime/Store.h"
+#include "runtime/Symbols.h"
+#include "runtime/Trace.h"
+#include "sim/Bytecode.h"
+#include "sim/SimOptions.h"
+
+namespace sim {
+
+// One frame per active procedure call (main included). if-branches are
+// plain jumps in the bytecode, so they share their enclosing frame (and
+// its environment). Environments live back to back in a single stack of
+// process ids; a frame only records where its own slots start.
+struct CallFrame {
+    uint32_t returnPc = 0;
+    size_t envBase = 0;
+
+    // kNoProc for main
+    uint32_t callSite = bc::kNoProc;
+
+    // call-site loc (for ret trace)
+    uint32_t callLoc = 0;
+};
+
+// Race whose winner has to be chosen by the caller (see suspendAtRace).
+struct PendingRace {
+    runtime::ProcId process = 0; // resolved race process
+    uint32_t race = 0;           // index into Module::races
+    runtime::ProcId left = 0;
+    runtime::ProcId right = 0;
+};
+
+// Complete interpreter state. It is a plain value: copying it forks the
+// execution, and execute() can be resumed on any copy. Store, race memory,
+// trace and RNG are copy-on-write, so a fork costs O(1) plus the frame and
+// environment stacks (a few words per active call).
+struct ExecCtx {
+    const SimOptions& opt;
+    const bc::Module& mod;
+    std::shared_ptr<const runtime::Symbols> syms;
+    runtime::Store store;
+    runtime::RaceMemory races;
+    runtime::Trace trace;
+
+    std::vector<CallFrame> frames;
+    std::vector<runtime::ProcId> env;
+    uint32_t pc = 0;
+
+    uint64_t steps = 0;
+    uint64_t callDepth = 0;
+    uint64_t traceEvents = 0; // sent to the sink or recorded in `trace`
+
+    // shared until a fork draws from it
+    runtime::CowPtr<std::mt19937_64> rng;
+
+    // When set, a race does not consult opt.racePolicy: execute() stops
+    // right before the winner is picked (pending is filled in) and returns
+    // ExecStatus::Suspended. Set `forced` and call execute() again to go on.
+    bool suspendAtRace = false;
+    std::optional<runtime::RaceWinnerSide> forced;
+    bool suspended = false;
+    bool raceCounted = false; // the race at pc already took its step
+    PendingRace pending;
+
+    ExecCtx(const bc::Module& m, const SimOptions& o, std::shared_ptr<const runtime::Symbols> s)
+        : opt(o), mod(m), syms(std::move(s)), store(syms),
+          rng(runtime::CowPtr<std::mt19937_64>::make(o.seed)) {}
+
+    const ast::SourceRange& loc(uint32_t idx) const { return mod.locs[idx]; }
+
+    const std::string& procName(runtime::ProcId p) const { return syms->processes.name(p); }
+    const std::string& varName(runtime::VarId x) const { return syms->vars.name(x); }
+    const std::string& raceKeyName(runtime::RaceKeyId k) const { return syms->raceKeys.name(k); }
+
+    std::mt19937_64& rngMut() { return rng.mut(); }
+};
+
+enum class ExecStatus { Halted, Suspended };
+
+// --init may name processes/variables the program never mentions: those
+// need store slots too, so they are interned into a private copy of the table.
+std::shared_ptr<const runtime::Symbols> symbolsWithInit(const bc::Module& module, const SimOptions& opt);
+
+// Applies opt.init and positions the context at the module entry.
+// Throws runtime::RuntimeError.
+void startExecution(ExecCtx& ctx);
+
+// Runs until Halt or a suspended race. Throws runtime::RuntimeError.
+ExecStatus execute(ExecCtx& ctx);
+
+}
@@ -0,0 +1,294 @@
+#include "sim/Explorer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+#include "runtime/RuntimeError.h"
+#include "sim/Compiler.h"
+#include "sim/ExecCtx.h"
+
+namespace sim {
+
+namespace {
+
+struct Branch {
+    ExecCtx ctx;
+    WinnerSequence path;
+};
+
+// Depth-first, left-winner-first order of two leaves. No complete path is a
+// prefix of another, so comparing the sides is enough.
+static bool pathBefore(const WinnerSequence& a, const WinnerSequence& b) {
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+        [](const RaceDecision& x, const RaceDecision& y) { return x.side < y.side; });
+}
+
+// Outcomes seen by one worker. Keeps, per outcome, the `maxSequences`
+// first paths in depth-first order, so merging the workers gives the
+// same report whatever the thread count.
+class Collector final {
+public:
+    explicit Collector(uint64_t maxSequences) : maxSequences_(maxSequences) {}
+
+    uint64_t paths = 0;
+    uint64_t decisions = 0;
+
+    void halted(const ExecCtx& ctx, const WinnerSequence& path) {
+        std::map<std::string, runtime::Value> store = ctx.store.raw();
+
+        std::string key = "S";
+        for (const auto& kv : store) key += kv.first + "=" + kv.second.toString() + ";";
+
+        ExploreOutcome& o = outcome(key);
+        if (o.paths == 0) {
+            o.ok = true;
+            o.finalStore = std::move(store);
+        }
+        add(o, path, 1);
+    }
+
+    void failed(const runtime::RuntimeError& re, const WinnerSequence& path) {
+        RuntimeErrorInfo e;
+        e.file = re.loc().fileName();
+        e.line = re.loc().start.line;
+        e.col  = re.loc().start.col;
+        e.message = re.what();
+
+        const std::string key = "E" + e.file + ":" + std::to_string(e.line) + ":" +
+                                std::to_string(e.col) + ": " + e.message;
+
+        ExploreOutcome& o = outcome(key);
+        if (o.paths == 0) {
+            o.ok = false;
+            o.runtimeErrors.push_back(std::move(e));
+        }
+        add(o, path, 1);
+    }
+
+    void merge(Collector& other) {
+        paths += other.paths;
+        decisions += other.decisions;
+        for (auto& kv : other.index_) {
+            ExploreOutcome& src = other.outcomes_[kv.second];
+            ExploreOutcome& dst = outcome(kv.first);
+            if (dst.paths == 0) {
+                dst.ok = src.ok;
+                dst.finalStore = std::move(src.finalStore);
+                dst.runtimeErrors = std::move(src.runtimeErrors);
+            }
+            dst.paths += src.paths;
+            for (auto& seq : src.sequences) keep(dst, std::move(seq));
+        }
+    }
+
+    // outcomes ordered by their first path
+    std::vector<ExploreOutcome> take() {
+        std::sort(outcomes_.begin(), outcomes_.end(), [](const ExploreOutcome& a, const ExploreOutcome& b) {
+            return pathBefore(a.sequences.front(), b.sequences.front());
+        });
+        index_.clear();
+        return std::move(outcomes_);
+    }
+
+private:
+    uint64_t maxSequences_;
+    std::unordered_map<std::string, size_t> index_;
+    std::vector<ExploreOutcome> outcomes_;
+
+    ExploreOutcome& outcome(const std::string& key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            it = index_.emplace(key, outcomes_.size()).first;
+            outcomes_.emplace_back();
+        }
+        return outcomes_[it->second];
+    }
+
+    void add(ExploreOutcome& o, const WinnerSequence& path, uint64_t n) {
+        o.paths += n;
+        paths += n;
+        keep(o, path);
+    }
+
+    // sorted insert, bounded by maxSequences_
+    void keep(ExploreOutcome& o, WinnerSequence seq) {
+        auto& v = o.sequences;
+        if (maxSequences_ != 0 && v.size() >= maxSequences_ && !pathBefore(seq, v.back())) return;
+        v.insert(std::upper_bound(v.begin(), v.end(), seq, pathBefore), std::move(seq));
+        if (maxSequences_ != 0 && v.size() > maxSequences_) v.pop_back();
+    }
+};
+
+static RaceDecision decision(const ExecCtx& ctx, runtime::RaceWinnerSide side) {
+    const PendingRace& pr = ctx.pending;
+    RaceDecision d;
+    d.race = ctx.procName(pr.process) + "[" + ctx.raceKeyName(ctx.mod.races[pr.race].key) + "]";
+    d.winner = ctx.procName(side == runtime::RaceWinnerSide::Left ? pr.left : pr.right);
+    d.side = side;
+    return d;
+}
+
+// Work-stealing pool over the race decision tree. Every worker goes down
+// its own subtree depth first, always continuing with the left child and
+// queueing the right one at the back of its deque; idle workers steal from
+// the front of a victim's deque, i.e. the shallowest (largest) subtree.
+class Pool final {
+public:
+    Pool(const ExploreOptions& opt, unsigned threads)
+        : opt_(opt), queues_(threads) {
+        collectors_.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i) collectors_.emplace_back(opt.maxSequences);
+    }
+
+    void run(Branch root) {
+        pending_ = 1;
+        queues_[0].items.push_back(std::move(root));
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < queues_.size(); ++i) threads.emplace_back([this, i] { work(i); });
+        work(0);
+        for (auto& t : threads) t.join();
+    }
+
+    void finish(ExplorationResult& res) {
+        Collector& all = collectors_[0];
+        for (size_t i = 1; i < collectors_.size(); ++i) all.merge(collectors_[i]);
+
+        res.paths = all.paths;
+        res.decisions = all.decisions;
+        res.truncated = stop_ && pending_ > 0;
+        res.outcomes = all.take();
+    }
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<Branch> items;
+    };
+
+    const ExploreOptions& opt_;
+    std::deque<Queue> queues_;
+    std::vector<Collector> collectors_;
+
+    std::atomic<uint64_t> pending_{ 0 };   // branches not yet run to their leaf/fork
+    std::atomic<uint64_t> leaves_{ 0 };
+    std::atomic<bool> stop_{ false };
+
+    // own deque first (newest, deepest branch), then steal
+    std::optional<Branch> take(unsigned self) {
+        {
+            Queue& q = queues_[self];
+            std::lock_guard<std::mutex> lock(q.m);
+            if (!q.items.empty()) {
+                std::optional<Branch> b(std::move(q.items.back()));
+                q.items.pop_back();
+                return b;
+            }
+        }
+        for (size_t k = 1; k < queues_.size(); ++k) {
+            Queue& q = queues_[(self + k) % queues_.size()];
+            std::lock_guard<std::mutex> lock(q.m);
+            if (q.items.empty()) continue;
+            std::optional<Branch> b(std::move(q.items.front()));
+            q.items.pop_front();
+            return b;
+        }
+        return std::nullopt;
+    }
+
+    void pushOwn(unsigned self, Branch b) {
+        Queue& q = queues_[self];
+        std::lock_guard<std::mutex> lock(q.m);
+        q.items.push_back(std::move(b));
+    }
+
+    void leafDone() {
+        --pending_;
+        if (opt_.maxPaths != 0 && ++leaves_ >= opt_.maxPaths) stop_ = true;
+    }
+
+    void work(unsigned self) {
+        Collector& collect = collectors_[self];
+
+        std::optional<Branch> current;
+        while (!stop_) {
+            if (!current) {
+                std::optional<Branch> next = take(self);
+                if (!next) {
+                    if (pending_ == 0) return;
+                    std::this_thread::yield();
+                    continue;
+                }
+                current.emplace(std::move(*next));
+            }
+
+            Branch& b = *current;
+            try {
+                if (execute(b.ctx) == ExecStatus::Halted) {
+                    collect.halted(b.ctx, b.path);
+                    current.reset();
+                    leafDone();
+                    continue;
+                }
+            } catch (const runtime::RuntimeError& re) {
+                collect.failed(re, b.path);
+                current.reset();
+                leafDone();
+                continue;
+            }
+
+            // suspended at a race: fork, keep going left
+            ++collect.decisions;
+            ++pending_; // two children replace the parent
+
+            Branch right = b;
+            right.ctx.forced = runtime::RaceWinnerSide::Right;
+            right.path.push_back(decision(right.ctx, runtime::RaceWinnerSide::Right));
+            pushOwn(self, std::move(right));
+
+            b.ctx.forced = runtime::RaceWinnerSide::Left;
+            b.path.push_back(decision(b.ctx, runtime::RaceWinnerSide::Left));
+        }
+    }
+};
+
+} // namespace
+
+ExplorationResult Explorer::run(const ast::Program& program, const ExploreOptions& opt) {
+    return run(std::make_shared<const bc::Module>(compile(program)), opt);
+}
+
+ExplorationResult Explorer::run(std::shared_ptr<const bc::Module> module, const ExploreOptions& opt) {
+    SimOptions simOpt = opt.sim;
+    simOpt.trace = false;
+    simOpt.profiler = nullptr;
+
+    ExplorationResult res;
+
+    ExecCtx root(*module, simOpt, symbolsWithInit(*module, simOpt));
+    root.suspendAtRace = true;
+    try {
+        startExecution(root);
+    } catch (const runtime::RuntimeError& re) {
+        Collector collect(opt.maxSequences);
+        collect.failed(re, {});
+        res.paths = collect.paths;
+        res.outcomes = collect.take();
+        return res;
+    }
+
+    unsigned threads = opt.threads;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    Pool pool(opt, threads);
+    pool.run(Branch{ std::move(root), {} });
+    pool.finish(res);
+    return res;
+}
+
+}
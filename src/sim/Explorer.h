@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast/Ast.h"
+#include "runtime/RaceMemory.h"
+#include "runtime/Value.h"
+#include "sim/Bytecode.h"
+#include "sim/SimOptions.h"
+#include "sim/SimulationResult.h"
+
+namespace sim {
+
+struct ExploreOptions {
+    // racePolicy/seed/trace are ignored: every race is tried both ways
+    SimOptions sim;
+
+    // stop after this many complete paths (0 = no limit)
+    uint64_t maxPaths = 1000000;
+
+    // winner sequences kept per outcome (0 = all)
+    uint64_t maxSequences = 10;
+
+    // worker threads (0 = one per hardware thread)
+    unsigned threads = 1;
+};
+
+// One race decision along a path: "p[k]" won by `winner`.
+struct RaceDecision {
+    std::string race;
+    std::string winner;
+    runtime::RaceWinnerSide side = runtime::RaceWinnerSide::Left;
+};
+
+using WinnerSequence = std::vector<RaceDecision>;
+
+// A distinct end state: either a final store or a runtime error.
+struct ExploreOutcome {
+    bool ok = false;
+    std::map<std::string, runtime::Value> finalStore; // ok only
+    std::vector<RuntimeErrorInfo> runtimeErrors;      // !ok only
+
+    uint64_t paths = 0;                     // paths ending here
+    std::vector<WinnerSequence> sequences;  // first ones in depth-first order
+};
+
+struct ExplorationResult {
+    uint64_t paths = 0;      // complete paths explored
+    uint64_t decisions = 0;  // races branched on
+    bool truncated = false;  // maxPaths reached (which paths were run then depends on scheduling)
+
+    // ordered by their first path in depth-first order (left winner before
+    // right winner); identical for any thread count
+    std::vector<ExploreOutcome> outcomes;
+};
+
+// Exhaustive race-outcome exploration: walks the binary tree of race
+// winners, forking the interpreter state at each race instead of re-running
+// the prefix. Subtrees are spread over `threads` workers by work stealing.
+class Explorer final {
+public:
+    static ExplorationResult run(const ast::Program& program, const ExploreOptions& opt);
+    static ExplorationResult run(std::shared_ptr<const bc::Module> module, const ExploreOptions& opt);
+};
+
+}
@@ -0,0 +1,148 @@
+#include "sim/MonteCarlo.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+#include "sim/Compiler.h"
+#include "sim/Simulator.h"
+
+namespace sim {
+
+namespace {
+
+// runs handed to a worker at a time
+static constexpr uint64_t kChunk = 64;
+
+// Per-worker histograms, keyed by the printable outcome.
+struct Tally {
+    uint64_t runs = 0;
+    uint64_t okRuns = 0;
+    std::unordered_map<std::string, StoreBucket> stores;
+    std::unordered_map<std::string, ErrorBucket> errors;
+    std::map<std::string, std::map<std::string, uint64_t>> raceWinners;
+
+    void add(SimulationResult& res) {
+        ++runs;
+
+        const runtime::Symbols& syms = *res.symbols;
+        res.races.forEach([&](const runtime::RaceKey& k, const runtime::RaceEntry& e, bool) {
+            const std::string race = syms.processes.name(k.process) + "[" + syms.raceKeys.name(k.key) + "]";
+            ++raceWinners[race][syms.processes.name(e.winner())];
+        });
+
+        if (!res.ok) {
+            const RuntimeErrorInfo& e = res.runtimeErrors.front();
+            const std::string key = e.file + ":" + std::to_string(e.line) + ":" +
+                                    std::to_string(e.col) + ": " + e.message;
+            ErrorBucket& b = errors[key];
+            if (b.count == 0) b.error = e;
+            ++b.count;
+            return;
+        }
+
+        ++okRuns;
+        std::map<std::string, runtime::Value> store = res.store.raw();
+        std::string key;
+        for (const auto& kv : store) key += kv.first + "=" + kv.second.toString() + ";";
+        StoreBucket& b = stores[key];
+        if (b.count == 0) b.finalStore = std::move(store);
+        ++b.count;
+    }
+
+    void merge(Tally& o) {
+        runs += o.runs;
+        okRuns += o.okRuns;
+        for (auto& kv : o.stores) {
+            StoreBucket& b = stores[kv.first];
+            if (b.count == 0) b.finalStore = std::move(kv.second.finalStore);
+            b.count += kv.second.count;
+        }
+        for (auto& kv : o.errors) {
+            ErrorBucket& b = errors[kv.first];
+            if (b.count == 0) b.error = std::move(kv.second.error);
+            b.count += kv.second.count;
+        }
+        for (auto& race : o.raceWinners) {
+            auto& dst = raceWinners[race.first];
+            for (const auto& w : race.second) dst[w.first] += w.second;
+        }
+    }
+};
+
+template <class Bucket>
+static std::vector<Bucket> byFrequency(std::unordered_map<std::string, Bucket>& m) {
+    std::vector<std::pair<std::string, Bucket>> v(std::make_move_iterator(m.begin()),
+                                                  std::make_move_iterator(m.end()));
+    std::sort(v.begin(), v.end(), [](const auto& a, const auto& b) {
+        if (a.second.count != b.second.count) return a.second.count > b.second.count;
+        return a.first < b.first;
+    });
+
+    std::vector<Bucket> out;
+    out.reserve(v.size());
+    for (auto& kv : v) out.push_back(std::move(kv.second));
+    return out;
+}
+
+} // namespace
+
+uint64_t MonteCarlo::deriveSeed(uint64_t base, uint64_t run) {
+    // splitmix64 of (base, run)
+    uint64_t z = base + 0x9e3779b97f4a7c15ULL * (run + 1);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+MonteCarloResult MonteCarlo::run(const ast::Program& program, const MonteCarloOptions& opt) {
+    return run(std::make_shared<const bc::Module>(compile(program)), opt);
+}
+
+MonteCarloResult MonteCarlo::run(std::shared_ptr<const bc::Module> module, const MonteCarloOptions& opt) {
+    unsigned threads = opt.threads;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<uint64_t>(threads, (opt.runs + kChunk - 1) / kChunk));
+    threads = std::max(1u, threads);
+
+    std::vector<Tally> tallies(threads);
+    std::atomic<uint64_t> next{ 0 };
+
+    auto work = [&](unsigned self) {
+        SimOptions simOpt = opt.sim;
+        simOpt.trace = false;
+        simOpt.profiler = nullptr;
+        simOpt.racePolicy = RacePolicy::Random;
+
+        Tally& tally = tallies[self];
+        for (;;) {
+            const uint64_t first = next.fetch_add(kChunk);
+            if (first >= opt.runs) return;
+            const uint64_t last = std::min(opt.runs, first + kChunk);
+            for (uint64_t i = first; i < last; ++i) {
+                simOpt.seed = deriveSeed(opt.sim.seed, i);
+                SimulationResult res = Simulator::run(module, simOpt);
+                tally.add(res);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; ++i) pool.emplace_back(work, i);
+    work(0);
+    for (auto& t : pool) t.join();
+
+    Tally& all = tallies[0];
+    for (size_t i = 1; i < tallies.size(); ++i) all.merge(tallies[i]);
+
+    MonteCarloResult res;
+    res.runs = all.runs;
+    res.okRuns = all.okRuns;
+    res.stores = byFrequency(all.stores);
+    res.errors = byFrequency(all.errors);
+    res.raceWinners = std::move(all.raceWinners);
+    return res;
+}
+
+}
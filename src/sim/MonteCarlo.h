@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast/Ast.h"
+#include "runtime/Value.h"
+#include "sim/Bytecode.h"
+#include "sim/SimOptions.h"
+#include "sim/SimulationResult.h"
+
+namespace sim {
+
+struct MonteCarloOptions {
+    // racePolicy is forced to Random and trace to off; seed is the base seed
+    SimOptions sim;
+
+    uint64_t runs = 1;
+
+    // worker threads (0 = one per hardware thread)
+    unsigned threads = 1;
+};
+
+struct StoreBucket {
+    std::map<std::string, runtime::Value> finalStore;
+    uint64_t count = 0;
+};
+
+struct ErrorBucket {
+    RuntimeErrorInfo error;
+    uint64_t count = 0;
+};
+
+struct MonteCarloResult {
+    uint64_t runs = 0;
+    uint64_t okRuns = 0;
+
+    // most frequent first (ties by content), independent of the thread count
+    std::vector<StoreBucket> stores;  // successful runs
+    std::vector<ErrorBucket> errors;  // failed runs
+
+    // "p[k]" -> winner process -> runs in which it won
+    std::map<std::string, std::map<std::string, uint64_t>> raceWinners;
+};
+
+// Runs the same compiled program `runs` times under RacePolicy::Random.
+// Run i uses seed deriveSeed(sim.seed, i), so the aggregate depends only on
+// the base seed and the number of runs.
+class MonteCarlo final {
+public:
+    static MonteCarloResult run(const ast::Program& program, const MonteCarloOptions& opt);
+    static MonteCarloResult run(std::shared_ptr<const bc::Module> module, const MonteCarloOptions& opt);
+
+    static uint64_t deriveSeed(uint64_t base, uint64_t run);
+};
+
+}
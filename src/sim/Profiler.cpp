@@ -0,0 +1,153 @@
+#include "sim/Profiler.h"
+
+#include <algorithm>
+
+namespace sim {
+
+void Profiler::begin(const bc::Module& module) {
+    mod_ = &module;
+    stmts_.assign(module.locs.size(), StmtRec{});
+    nodes_.assign(1, Node{}); // main
+    nodes_[0].calls = 1;
+    active_.assign(module.procs.size(), 0);
+    cur_ = 0;
+    last_ = kNone;
+    lastNode_ = 0;
+    steps_ = 0;
+    totalNs_ = 0;
+    since_ = std::chrono::steady_clock::now();
+}
+
+void Profiler::end() {
+    charge(std::chrono::steady_clock::now());
+    last_ = kNone;
+}
+
+void Profiler::call(uint32_t proc) {
+    uint32_t child = kNone;
+    for (const auto& c : nodes_[cur_].children) {
+        if (c.first == proc) {
+            child = c.second;
+            break;
+        }
+    }
+    if (child == kNone) {
+        child = static_cast<uint32_t>(nodes_.size());
+        Node n;
+        n.proc = proc;
+        n.parent = cur_;
+        n.recursive = active_[proc] > 0;
+        nodes_.push_back(std::move(n));
+        nodes_[cur_].children.emplace_back(proc, child);
+    }
+    nodes_[child].calls++;
+    active_[proc]++;
+    cur_ = child;
+}
+
+void Profiler::ret() {
+    if (nodes_[cur_].parent == kNone) return;
+    active_[nodes_[cur_].proc]--;
+    cur_ = nodes_[cur_].parent;
+}
+
+const std::string& Profiler::procName(uint32_t proc) const {
+    static const std::string mainName = "main";
+    return proc == bc::kNoProc ? mainName : mod_->procs[proc].name;
+}
+
+const char* Profiler::kindName(bc::Op op) {
+    switch (op) {
+    case bc::Op::Assign:    return "asg";
+    case bc::Op::Comm:      return "com";
+    case bc::Op::Select:    return "sel";
+    case bc::Op::Race:      return "race";
+    case bc::Op::Discharge: return "dis";
+    case bc::Op::IfLocal:
+    case bc::Op::IfRace:    return "if";
+    case bc::Op::Call:      return "call";
+    default:                return "?";
+    }
+}
+
+std::vector<Profiler::Statement> Profiler::statements() const {
+    std::vector<Statement> out;
+    for (size_t i = 0; i < stmts_.size(); ++i) {
+        const StmtRec& r = stmts_[i];
+        if (r.count == 0) continue;
+        Statement st;
+        st.loc = mod_->locs[i];
+        st.kind = r.kind;
+        st.proc = procName(nodes_[r.node].proc);
+        st.count = r.count;
+        st.ns = r.ns;
+        out.push_back(std::move(st));
+    }
+    std::stable_sort(out.begin(), out.end(), [](const Statement& a, const Statement& b) {
+        if (a.count != b.count) return a.count > b.count;
+        if (a.ns != b.ns) return a.ns > b.ns;
+        if (a.loc.start.line != b.loc.start.line) return a.loc.start.line < b.loc.start.line;
+        return a.loc.start.col < b.loc.start.col;
+    });
+    return out;
+}
+
+std::vector<Profiler::Procedure> Profiler::procedures() const {
+    // inclusive cost of each stack node: children come after their parent
+    std::vector<uint64_t> steps(nodes_.size());
+    std::vector<int64_t> ns(nodes_.size());
+    for (size_t i = nodes_.size(); i-- > 0;) {
+        steps[i] += nodes_[i].selfSteps;
+        ns[i] += nodes_[i].selfNs;
+        if (nodes_[i].parent != kNone) {
+            steps[nodes_[i].parent] += steps[i];
+            ns[nodes_[i].parent] += ns[i];
+        }
+    }
+
+    // slot 0: main, then Module::procs
+    std::vector<Procedure> byProc(mod_->procs.size() + 1);
+    std::vector<bool> ran(byProc.size(), false);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        const Node& n = nodes_[i];
+        const size_t slot = (n.proc == bc::kNoProc) ? 0 : n.proc + 1;
+        Procedure& p = byProc[slot];
+        ran[slot] = true;
+        p.calls += n.calls;
+        p.selfSteps += n.selfSteps;
+        p.selfNs += n.selfNs;
+        if (!n.recursive) {
+            p.totalSteps += steps[i];
+            p.totalNs += ns[i];
+        }
+    }
+
+    std::vector<Procedure> out;
+    for (size_t slot = 0; slot < byProc.size(); ++slot) {
+        if (!ran[slot]) continue;
+        byProc[slot].name = procName(slot == 0 ? bc::kNoProc : static_cast<uint32_t>(slot - 1));
+        out.push_back(std::move(byProc[slot]));
+    }
+    std::stable_sort(out.begin(), out.end(), [](const Procedure& a, const Procedure& b) {
+        if (a.totalSteps != b.totalSteps) return a.totalSteps > b.totalSteps;
+        return a.selfSteps > b.selfSteps;
+    });
+    return out;
+}
+
+void Profiler::writeCollapsed(std::ostream& os) const {
+    std::vector<const std::string*> path;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (nodes_[i].selfSteps == 0) continue;
+        path.clear();
+        for (uint32_t n = static_cast<uint32_t>(i); n != kNone; n = nodes_[n].parent) {
+            path.push_back(&procName(nodes_[n].proc));
+        }
+        for (size_t k = path.size(); k-- > 0;) {
+            os << *path[k] << (k ? ";" : " ");
+        }
+        os << nodes_[i].selfSteps << "\n";
+    }
+}
+
+}
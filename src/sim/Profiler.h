@@ -0,0 +1,130 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ast/SourceLocation.h"
+#include "sim/Bytecode.h"
+
+namespace sim {
+
+// Source-level profile of one Simulator::run (simulate --profile).
+//
+// execute() reports every instruction it dispatches, and every call and
+// return, so the profiler follows the CallFrame stack. It keeps one record
+// per statement (instruction loc) and a tree of the call stacks seen, with
+// the steps and time spent in each stack's own statements. Time goes from
+// one instruction to the next: a statement is charged for the jumps and
+// returns after it, and steady_clock is read on every instruction, so the
+// times include that overhead (the step counts are exact).
+//
+// Procedures get inclusive and exclusive costs; a recursive activation is
+// part of the outermost one of the same procedure, so inclusive costs are
+// not counted twice.
+class Profiler final {
+public:
+    struct Statement {
+        ast::SourceRange loc;
+        const char* kind = "";  // trace kind: asg, com, sel, race, dis, if, call
+        std::string proc;       // "main" or the procedure it belongs to
+        uint64_t count = 0;     // executions (one step each)
+        int64_t ns = 0;
+    };
+
+    struct Procedure {
+        std::string name;
+        uint64_t calls = 0;     // activations, main included
+        uint64_t selfSteps = 0;
+        uint64_t totalSteps = 0;
+        int64_t selfNs = 0;
+        int64_t totalNs = 0;
+    };
+
+    // Simulator::run
+    void begin(const bc::Module& module);
+    void end();
+
+    // execute(): before each instruction; after a Call pushed its frame
+    // (proc: index into Module::procs); at each Ret
+    void enter(const bc::Instr& ins) {
+        const auto now = std::chrono::steady_clock::now();
+        charge(now);
+        if (ins.op == bc::Op::Jump || ins.op == bc::Op::Ret || ins.op == bc::Op::Halt) return;
+        last_ = ins.loc;
+        lastNode_ = cur_;
+        StmtRec& st = stmts_[ins.loc];
+        if (st.count++ == 0) {
+            st.kind = kindName(ins.op);
+            st.node = cur_;
+        }
+        nodes_[cur_].selfSteps++;
+        steps_++;
+    }
+    void call(uint32_t proc);
+    void ret();
+
+    uint64_t steps() const { return steps_; }
+    int64_t ns() const { return totalNs_; }
+
+    // executed statements, most executed first (then most time, then
+    // source order)
+    std::vector<Statement> statements() const;
+
+    // procedures that ran, main included, most inclusive steps first
+    std::vector<Procedure> procedures() const;
+
+    // One "main;proc;proc <steps>" line per call stack with steps of its
+    // own (Brendan Gregg's collapsed format, as read by flamegraph.pl and
+    // speedscope). Weighted by steps, so the output is deterministic.
+    void writeCollapsed(std::ostream& os) const;
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct StmtRec {
+        const char* kind = nullptr;
+        uint32_t node = kNone; // stack node of the first execution
+        uint64_t count = 0;
+        int64_t ns = 0;
+    };
+
+    // one per distinct call stack; children are created after their parent
+    struct Node {
+        uint32_t proc = bc::kNoProc; // kNoProc: main
+        uint32_t parent = kNone;
+        bool recursive = false;      // proc already on the stack above
+        uint64_t calls = 0;
+        uint64_t selfSteps = 0;
+        int64_t selfNs = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> children; // proc -> node
+    };
+
+    const bc::Module* mod_ = nullptr;
+    std::vector<StmtRec> stmts_; // by loc index
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> active_; // activations of each proc on the stack
+    uint32_t cur_ = 0;
+
+    std::chrono::steady_clock::time_point since_;
+    uint32_t last_ = kNone;      // loc charged for the time since `since_`
+    uint32_t lastNode_ = 0;
+    uint64_t steps_ = 0;
+    int64_t totalNs_ = 0;
+
+    void charge(std::chrono::steady_clock::time_point now) {
+        const int64_t d = std::chrono::duration_cast<std::chrono::nanoseconds>(now - since_).count();
+        since_ = now;
+        totalNs_ += d;
+        if (last_ == kNone) return;
+        stmts_[last_].ns += d;
+        nodes_[lastNode_].selfNs += d;
+    }
+
+    const std::string& procName(uint32_t proc) const;
+    static const char* kindName(bc::Op op);
+};
+
+}
@@ -7,6 +7,9 @@
 
 namespace sim {
 
+class TraceSink;
+class Profiler;
+
 enum class RacePolicy { Random, Left, Right };
 
 struct InitBinding {
@@ -18,8 +21,19 @@ struct InitBinding {
 struct SimOptions {
     bool quiet = false;
     bool json = false;
+    bool jsonCompact = false; // --json-compact: JSON on one line
 
     bool trace = true;
+
+    // Simulator::run hands trace events to this sink as they happen instead
+    // of collecting them in SimulationResult::trace (not owned; Simulation
+    // ignores it, since restore() has to rewind the trace)
+    TraceSink* traceSink = nullptr;
+
+    // Simulator::run reports every instruction, call and return to it
+    // (--profile; not owned, ignored like traceSink by Simulation, and
+    // dropped by Explorer and MonteCarlo)
+    Profiler* profiler = nullptr;
     bool finalStore = false;
     bool finalRaces = false;
 
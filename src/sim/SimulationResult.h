@@ -1,4 +1,5 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -6,6 +7,7 @@
 #include "runtime/RaceMemory.h"
 #include "runtime/Trace.h"
 #include "ast/SourceLocation.h"
+#include "sim/Bytecode.h"
 
 namespace sim {
 
@@ -24,6 +26,13 @@ struct SimulationResult {
     runtime::RaceMemory races;
 
     std::vector<RuntimeErrorInfo> runtimeErrors;
+
+    uint64_t steps = 0;       // executed steps (as counted for --max-steps)
+    uint64_t traceEvents = 0; // also counted when the trace went to a sink
+
+    // what the trace refers to (see sim::TraceFormatter)
+    std::shared_ptr<const bc::Module> module;
+    std::shared_ptr<const runtime::Symbols> symbols;
 };
 
 } 
\ No newline at end of file
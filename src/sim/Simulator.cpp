@@ -1,8 +1,8 @@
 #include "sim/Simulator.h"
 
-#include <unordered_map>
+#include <memory>
 #include <sstream>
-#include <variant>
+#include <stdexcept>
 #include <vector>
 #include <random>
 
@@ -11,59 +11,20 @@
 #include "runtime/Store.h"
 #include "runtime/Trace.h"
 #include "runtime/RaceMemory.h"
+#include "sim/Compiler.h"
+#include "sim/ExecCtx.h"
+#include "sim/Profiler.h"
+#include "sim/TraceSink.h"
 
 namespace sim {
 
 namespace {
 
-// loc finta per init
-static ast::SourceRange initLoc() {
-    ast::SourceRange r;
-    r.file = "<init>";
-    r.start.line = 0;
-    r.start.col = 0;
-    r.end = r.start;
-    return r;
-}
-
-struct ExecCtx {
-    const SimOptions& opt;
-    runtime::Store store;
-    runtime::RaceMemory races;
-    runtime::Trace trace;
-
-    uint64_t steps = 0;
-    uint64_t callDepth = 0;
-
-    std::mt19937_64 rng;
-
-    explicit ExecCtx(const SimOptions& o)
-        : opt(o), rng(o.seed) {}
-};
-
-struct BlockFrame {
-    const ast::Block* block = nullptr;
-    size_t ip = 0;
-    std::unordered_map<std::string, std::string> subst;
-
-    // empty for main
-    std::string procName;
-
-    // call-site loc (for ret trace)
-    ast::SourceRange callLoc;
-};
+using runtime::ProcId;
 
 // -------------------- helpers --------------------
-static runtime::Value toRuntimeValue(const ast::Value& v) {
-    if (v.kind == ast::Value::Kind::Int) return runtime::Value::makeInt(v.intValue);
-    return runtime::Value::makeBool(v.boolValue);
-}
-
-static std::string processSubst(const std::string& p,
-                                const std::unordered_map<std::string, std::string>& subst) {
-    auto it = subst.find(p);
-    if (it == subst.end()) return p;
-    return it->second;
+static ProcId resolve(bc::ProcRef r, const ProcId* env) {
+    return bc::isSlot(r) ? env[bc::slotOf(r)] : r;
 }
 
 static void checkStepLimit(ExecCtx& ctx, const ast::SourceRange& loc) {
@@ -79,130 +40,82 @@ static void checkCallDepth(ExecCtx& ctx, const ast::SourceRange& loc) {
     }
 }
 
-static void pushTrace(ExecCtx& ctx,
-                      const std::string& kind,
-                      const std::string& msg,
-                      const ast::SourceRange& loc) {
-    if (!ctx.opt.trace) return;
+// Trace records are plain data; formatting happens in sim::TraceFormatter.
+static runtime::TraceEvent traceEvent(runtime::TraceKind kind, uint32_t node, uint32_t ref = 0) {
     runtime::TraceEvent ev;
     ev.kind = kind;
-    ev.message = msg;
-    ev.loc = loc;
-    ctx.trace.push_back(std::move(ev));
-}
-
-static std::string exprToString(const ast::Expr& e) {
-    return std::visit([&](auto&& node) -> std::string {
-        using T = std::decay_t<decltype(node)>;
-        if constexpr (std::is_same_v<T, ast::ExprVar>) return node.name;
-        if constexpr (std::is_same_v<T, ast::Value>) {
-            if (node.kind == ast::Value::Kind::Int) return std::to_string(node.intValue);
-            return node.boolValue ? "true" : "false";
-        }
-        return "<expr>";
-    }, e);
+    ev.node = node;
+    ev.ref = ref;
+    return ev;
 }
 
-static std::string procExprToString(const ast::ProcExpr& pe,
-                                    const std::unordered_map<std::string, std::string>& subst) {
-    const std::string pEff = processSubst(pe.process, subst);
-    return pEff + "." + exprToString(pe.expr);
-}
-
-static std::string procVarToString(const ast::ProcVar& pv,
-                                   const std::unordered_map<std::string, std::string>& subst) {
-    const std::string pEff = processSubst(pv.process, subst);
-    return pEff + "." + pv.var;
-}
-
-static std::unordered_map<std::string, std::string>
-composeSubst(const std::unordered_map<std::string, std::string>& outer,
-             const std::unordered_map<std::string, std::string>& inner) {
-    std::unordered_map<std::string, std::string> res = outer;
-
-    for (const auto& kv : inner) {
-        const std::string& formal = kv.first;
-        const std::string& actual = kv.second;
-
-        std::string resolved = actual;
-        auto it = outer.find(actual);
-        if (it != outer.end()) resolved = it->second;
-
-        res[formal] = resolved;
+// args: resolved call arguments of a Call event
+static void pushTrace(ExecCtx& ctx, const runtime::TraceEvent& ev, const ProcId* args = nullptr) {
+    ctx.traceEvents++;
+    if (ctx.opt.traceSink) {
+        ctx.opt.traceSink->event(ev, args);
+        return;
     }
-
-    return res;
+    if (ev.kind == runtime::TraceKind::Call) {
+        runtime::TraceEvent stored = ev;
+        stored.p[0] = ctx.trace.pushArgs(args, ctx.mod.calls[ev.ref].args.size());
+        ctx.trace.push(stored);
+        return;
+    }
+    ctx.trace.push(ev);
 }
 
 // Σ(p,e) ↓ v
-static runtime::Value evalExpr(ExecCtx& ctx,
-                               const std::string& process,
-                               const ast::Expr& expr,
-                               const std::unordered_map<std::string, std::string>& subst,
-                               const ast::SourceRange& errLoc) {
-    const std::string pEff = processSubst(process, subst);
-
-    return std::visit([&](auto&& node) -> runtime::Value {
-        using T = std::decay_t<decltype(node)>;
-
-        if constexpr (std::is_same_v<T, ast::Value>) {
-            return toRuntimeValue(node);
-        } else if constexpr (std::is_same_v<T, ast::ExprVar>) {
-            auto ov = ctx.store.tryGet(pEff, node.name);
-            if (!ov.has_value()) {
-                std::ostringstream ss;
-                ss << "uninitialized variable '" << pEff << "." << node.name << "'";
-                const ast::SourceRange loc = (node.loc.file.empty() ? errLoc : node.loc);
-                throw runtime::RuntimeError(loc, ss.str());
-            }
-            return *ov;
-        }
+static runtime::Value evalProcExpr(ExecCtx& ctx, const bc::ProcExprRef& pe, const ProcId* env) {
+    if (!pe.isVar) return pe.literal;
 
-        throw runtime::RuntimeError(errLoc, "unknown expression kind");
-    }, expr);
-}
-
-static runtime::Value evalProcExpr(ExecCtx& ctx,
-                                  const ast::ProcExpr& pe,
-                                  const std::unordered_map<std::string, std::string>& subst) {
-    return evalExpr(ctx, pe.process, pe.expr, subst, pe.loc);
+    const ProcId pEff = resolve(pe.process, env);
+    const runtime::Value* ov = ctx.store.tryGet(pEff, pe.var);
+    if (!ov) {
+        std::ostringstream ss;
+        ss << "uninitialized variable '" << ctx.procName(pEff) << "." << ctx.varName(pe.var) << "'";
+        throw runtime::RuntimeError(ctx.loc(pe.exprLoc), ss.str());
+    }
+    return *ov;
 }
 
 // -------------------- concrete actions --------------------
-static void execAssign(ExecCtx& ctx,
-                       const ast::Assign& a,
-                       const std::unordered_map<std::string, std::string>& subst) {
-    const std::string targetProcEff = processSubst(a.target.process, subst);
-    runtime::Value v = evalExpr(ctx, a.target.process, a.value, subst, a.loc);
-    ctx.store.set(targetProcEff, a.target.var, v);
+static void execAssign(ExecCtx& ctx, const bc::Instr& ins, const ProcId* env) {
+    const bc::ProcVarRef& target = ctx.mod.vars[ins.a];
+    const ProcId targetProcEff = resolve(target.process, env);
+    runtime::Value v = evalProcExpr(ctx, ctx.mod.exprs[ins.b], env);
+    ctx.store.set(targetProcEff, target.var, v);
 
-    std::ostringstream ss;
-    ss << procVarToString(a.target, subst) << " = " << v.toString();
-    pushTrace(ctx, "asg", ss.str(), a.loc);
+    if (!ctx.opt.trace) return;
+    auto ev = traceEvent(runtime::TraceKind::Asg, ins.loc);
+    ev.p[0] = targetProcEff;
+    ev.var = target.var;
+    ev.value = v;
+    pushTrace(ctx, ev);
 }
 
-static void execComm(ExecCtx& ctx,
-                     const ast::Comm& c,
-                     const std::unordered_map<std::string, std::string>& subst) {
-    const std::string toProcEff = processSubst(c.to.process, subst);
-    runtime::Value v = evalProcExpr(ctx, c.from, subst);
-    ctx.store.set(toProcEff, c.to.var, v);
+static void execComm(ExecCtx& ctx, const bc::Instr& ins, const ProcId* env) {
+    const bc::ProcExprRef& from = ctx.mod.exprs[ins.a];
+    const bc::ProcVarRef& to = ctx.mod.vars[ins.b];
+    const ProcId toProcEff = resolve(to.process, env);
+    runtime::Value v = evalProcExpr(ctx, from, env);
+    ctx.store.set(toProcEff, to.var, v);
 
-    std::ostringstream ss;
-    ss << procExprToString(c.from, subst) << " = " << v.toString()
-       << " -> " << procVarToString(c.to, subst);
-    pushTrace(ctx, "com", ss.str(), c.loc);
+    if (!ctx.opt.trace) return;
+    auto ev = traceEvent(runtime::TraceKind::Com, ins.loc, ins.a);
+    ev.p[0] = resolve(from.process, env);
+    ev.p[1] = toProcEff;
+    ev.var = to.var;
+    ev.value = v;
+    pushTrace(ctx, ev);
 }
 
-static void execSelect(ExecCtx& ctx,
-                       const ast::Select& s,
-                       const std::unordered_map<std::string, std::string>& subst) {
-    const std::string fromEff = processSubst(s.from, subst);
-    const std::string toEff   = processSubst(s.to, subst);
-
-    std::ostringstream ss;
-    ss << fromEff << " -> " << toEff << " [" << s.label << "]";
-    pushTrace(ctx, "sel", ss.str(), s.loc);
+static void execSelect(ExecCtx& ctx, const bc::Instr& ins, const ProcId* env) {
+    if (!ctx.opt.trace) return;
+    auto ev = traceEvent(runtime::TraceKind::Sel, ins.loc, ins.c);
+    ev.p[0] = resolve(ins.a, env);
+    ev.p[1] = resolve(ins.b, env);
+    pushTrace(ctx, ev);
 }
 
 static bool requireBool(const runtime::Value& v, const ast::SourceRange& loc) {
@@ -212,40 +125,23 @@ static bool requireBool(const runtime::Value& v, const ast::SourceRange& loc) {
     return v.boolValue;
 }
 
-static std::unordered_map<std::string, const ast::ProcDef*>
-buildProcTable(const ast::Program& program) {
-    std::unordered_map<std::string, const ast::ProcDef*> table;
-    for (const auto& p : program.procedures) table[p->name] = p.get();
-    return table;
-}
-
-static std::unordered_map<std::string, std::string>
-buildCallSubst(const ast::ProcDef& def,
-               const ast::CallStmt& call,
-               const std::unordered_map<std::string, std::string>& callerSubst) {
-    if (def.params.size() != call.args.size()) {
-        std::ostringstream ss;
-        ss << "procedure '" << def.name << "' arity mismatch at runtime";
-        throw runtime::RuntimeError(call.loc, ss.str());
+static runtime::RaceWinnerSide decideRaceWinnerSide(ExecCtx& ctx, const ast::SourceRange& loc) {
+    if (ctx.forced) {
+        const runtime::RaceWinnerSide side = *ctx.forced;
+        ctx.forced.reset();
+        return side;
     }
-
-    std::unordered_map<std::string, std::string> inner;
-    for (size_t i = 0; i < def.params.size(); ++i) {
-        const std::string& formal = def.params[i];
-        const std::string& actual = call.args[i];
-        inner[formal] = processSubst(actual, callerSubst);
+    if (ctx.suspendAtRace) {
+        ctx.suspended = true;
+        return runtime::RaceWinnerSide::Left; // not used
     }
 
-    return inner;
-}
-
-static runtime::RaceWinnerSide decideRaceWinnerSide(ExecCtx& ctx, const ast::SourceRange& loc) {
     switch (ctx.opt.racePolicy) {
     case RacePolicy::Left:  return runtime::RaceWinnerSide::Left;
     case RacePolicy::Right: return runtime::RaceWinnerSide::Right;
     case RacePolicy::Random: {
         std::uniform_int_distribution<int> dist(0, 1);
-        return (dist(ctx.rng) == 0) ? runtime::RaceWinnerSide::Left
+        return (dist(ctx.rngMut()) == 0) ? runtime::RaceWinnerSide::Left
                                    : runtime::RaceWinnerSide::Right;
     }
     default:
@@ -253,290 +149,498 @@ static runtime::RaceWinnerSide decideRaceWinnerSide(ExecCtx& ctx, const ast::Sou
     }
 }
 
-static runtime::RaceKey toRaceKey(const ast::RaceId& id,
-                                  const std::unordered_map<std::string, std::string>& subst) {
+static runtime::RaceKey toRaceKey(const bc::RaceRef& id, const ProcId* env) {
     runtime::RaceKey k;
-    k.process = processSubst(id.process, subst);
+    k.process = resolve(id.process, env);
     k.key = id.key;
     return k;
 }
 
-static void execRace(ExecCtx& ctx,
-                     const ast::Race& r,
-                     const std::unordered_map<std::string, std::string>& subst) {
-    runtime::RaceKey key = toRaceKey(r.id, subst);
+// "race 's[k]' <what>"
+static runtime::RuntimeError raceError(const ExecCtx& ctx, const ast::SourceRange& loc,
+                                       const runtime::RaceKey& key, const char* what) {
+    std::ostringstream ss;
+    ss << "race '" << ctx.procName(key.process) << "[" << ctx.raceKeyName(key.key) << "]' " << what;
+    return runtime::RuntimeError(loc, ss.str());
+}
+
+static void execRace(ExecCtx& ctx, const bc::Instr& ins, const ProcId* env) {
+    const ast::SourceRange& loc = ctx.loc(ins.loc);
+    const bc::ProcExprRef& left = ctx.mod.exprs[ins.b];
+    const bc::ProcExprRef& right = ctx.mod.exprs[ins.c];
+    const bc::ProcVarRef& target = ctx.mod.vars[ins.d];
 
-    if (ctx.races.contains(key)) {
-        std::ostringstream ss;
-        ss << "race '" << key.process << "[" << key.key << "]' already resolved";
-        throw runtime::RuntimeError(r.loc, ss.str());
-    }
+    const runtime::RaceKey key = toRaceKey(ctx.mod.races[ins.a], env);
 
-    runtime::Value vL = evalProcExpr(ctx, r.left, subst);
-    runtime::Value vR = evalProcExpr(ctx, r.right, subst);
+    if (ctx.races.contains(key)) throw raceError(ctx, loc, key, "already resolved");
 
-    const std::string leftProcEff  = processSubst(r.left.process, subst);
-    const std::string rightProcEff = processSubst(r.right.process, subst);
+    runtime::Value vL = evalProcExpr(ctx, left, env);
+    runtime::Value vR = evalProcExpr(ctx, right, env);
 
-    runtime::RaceWinnerSide side = decideRaceWinnerSide(ctx, r.loc);
+    const ProcId leftId  = resolve(left.process, env);
+    const ProcId rightId = resolve(right.process, env);
+
+    runtime::RaceWinnerSide side = decideRaceWinnerSide(ctx, loc);
+    if (ctx.suspended) {
+        ctx.pending.process = key.process;
+        ctx.pending.race = ins.a;
+        ctx.pending.left = leftId;
+        ctx.pending.right = rightId;
+        return;
+    }
 
     runtime::RaceEntry entry;
-    entry.leftProc = leftProcEff;
-    entry.rightProc = rightProcEff;
+    entry.left = leftId;
+    entry.right = rightId;
+    entry.winnerSide = side;
 
     if (side == runtime::RaceWinnerSide::Left) {
-        entry.winnerSide = runtime::RaceWinnerSide::Left;
-        entry.winnerProc = leftProcEff;
-        entry.loserProc = rightProcEff;
         entry.vWinner = vL;
         entry.vLoser = vR;
     } else {
-        entry.winnerSide = runtime::RaceWinnerSide::Right;
-        entry.winnerProc = rightProcEff;
-        entry.loserProc = leftProcEff;
         entry.vWinner = vR;
         entry.vLoser = vL;
     }
 
-    const std::string targetProcEff = processSubst(r.target.process, subst);
-    ctx.store.set(targetProcEff, r.target.var, entry.vWinner);
+    const ProcId targetProcEff = resolve(target.process, env);
+    ctx.store.set(targetProcEff, target.var, entry.vWinner);
 
     ctx.races.put(key, entry);
 
-    const runtime::RaceEntry* saved = ctx.races.get(key);
-    std::ostringstream ss;
-    ss << key.process << "[" << key.key << "] winner=" << saved->winnerProc
-       << " loser=" << saved->loserProc
-       << " write " << targetProcEff << "." << r.target.var << "=" << saved->vWinner.toString();
-    pushTrace(ctx, "race", ss.str(), r.loc);
-}
-
-static void execIfRace(ExecCtx& ctx,
-                       const ast::IfRaceStmt& s,
-                       const std::unordered_map<std::string, std::string>& subst,
-                       const ast::Block*& chosenOut,
-                       std::string& traceMsgOut) {
-    runtime::RaceKey key = toRaceKey(s.condition, subst);
+    if (!ctx.opt.trace) return;
+    auto ev = traceEvent(runtime::TraceKind::Race, ins.loc, ins.a);
+    ev.p[0] = key.process;
+    ev.p[1] = entry.winner();
+    ev.p[2] = entry.loser();
+    ev.p[3] = targetProcEff;
+    ev.var = target.var;
+    ev.value = entry.vWinner;
+    pushTrace(ctx, ev);
+}
+
+// returns true when the then-branch is taken
+static bool execIfRace(ExecCtx& ctx, const bc::Instr& ins, const ProcId* env) {
+    const ast::SourceRange& loc = ctx.loc(ins.loc);
+    const runtime::RaceKey key = toRaceKey(ctx.mod.races[ins.a], env);
     const runtime::RaceEntry* entry = ctx.races.get(key);
-    if (!entry) {
-        std::ostringstream ss;
-        ss << "race '" << key.process << "[" << key.key << "]' not resolved";
-        throw runtime::RuntimeError(s.loc, ss.str());
-    }
+    if (!entry) throw raceError(ctx, loc, key, "not resolved");
 
     const bool cond = (entry->winnerSide == runtime::RaceWinnerSide::Left);
-    chosenOut = cond ? s.thenBlock.get() : s.elseBlock.get();
 
-    std::ostringstream ss;
-    ss << key.process << "[" << key.key << "] winner=" << entry->winnerProc
-       << " -> " << (cond ? "then" : "else");
-    traceMsgOut = ss.str();
+    if (ctx.opt.trace) {
+        auto ev = traceEvent(runtime::TraceKind::IfRace, ins.loc, ins.a);
+        ev.flag = cond;
+        ev.p[0] = key.process;
+        ev.p[1] = entry->winner();
+        pushTrace(ctx, ev);
+    }
+    return cond;
+}
+
+static bool execIfLocal(ExecCtx& ctx, const bc::Instr& ins, const ProcId* env) {
+    const bc::ProcExprRef& condition = ctx.mod.exprs[ins.a];
+    runtime::Value condV = evalProcExpr(ctx, condition, env);
+    bool cond = requireBool(condV, ctx.loc(condition.loc));
+
+    if (ctx.opt.trace) {
+        auto ev = traceEvent(runtime::TraceKind::If, ins.loc, ins.a);
+        ev.flag = cond;
+        ev.p[0] = resolve(condition.process, env);
+        pushTrace(ctx, ev);
+    }
+    return cond;
 }
 
-static void execDischarge(ExecCtx& ctx,
-                          const ast::Discharge& d,
-                          const std::unordered_map<std::string, std::string>& subst) {
-    runtime::RaceKey key = toRaceKey(d.id, subst);
+static void execDischarge(ExecCtx& ctx, const bc::Instr& ins, const ProcId* env) {
+    const ast::SourceRange& loc = ctx.loc(ins.loc);
+    const bc::ProcVarRef& target = ctx.mod.vars[ins.c];
+    const runtime::RaceKey key = toRaceKey(ctx.mod.races[ins.a], env);
 
-    runtime::RaceEntry* entry = ctx.races.getMut(key);
-    if (!entry) {
+    const uint32_t idx = ctx.races.find(key);
+    if (idx == runtime::RaceMemory::npos) throw raceError(ctx, loc, key, "not resolved");
+    const runtime::RaceEntry& entry = ctx.races.entry(idx);
+
+    const ProcId ellId = resolve(ins.b, env);
+    if (ellId != entry.loser()) {
         std::ostringstream ss;
-        ss << "race '" << key.process << "[" << key.key << "]' not resolved";
-        throw runtime::RuntimeError(d.loc, ss.str());
+        ss << "discharge expects loser '" << ctx.procName(entry.loser())
+           << "', got '" << ctx.procName(ellId) << "'";
+        throw runtime::RuntimeError(loc, ss.str());
     }
 
-    const std::string loserExpected = entry->loserProc;
-    const std::string ellEff = processSubst(d.source, subst);
+    if (ctx.races.discharged(idx)) throw raceError(ctx, loc, key, "already discharged");
+
+    const runtime::Value vLoser = entry.vLoser;
+    const ProcId targetProcEff = resolve(target.process, env);
+    ctx.store.set(targetProcEff, target.var, vLoser);
+
+    ctx.races.setDischarged(idx);
+
+    if (!ctx.opt.trace) return;
+    auto ev = traceEvent(runtime::TraceKind::Dis, ins.loc, ins.a);
+    ev.p[0] = key.process;
+    ev.p[1] = ellId;
+    ev.p[2] = targetProcEff;
+    ev.var = target.var;
+    ev.value = vLoser;
+    pushTrace(ctx, ev);
+}
+
+// Looks a process id up by name in an environment (identity if the
+// layout has no slot for it).
+static ProcId lookupByName(const bc::ProcInfo* layoutOwner, const ProcId* env, ProcId p) {
+    if (!layoutOwner) return p;
+    const auto& layout = layoutOwner->layout;
+    for (size_t i = 0; i < layout.size(); ++i) {
+        if (layout[i] == p) return env[i];
+    }
+    return p;
+}
 
-    if (ellEff != loserExpected) {
+// Pushes the callee frame and returns the callee entry pc.
+// Cost is one pass over the callee layout (formals + inherited names);
+// formals are looked up once more in the caller layout, like composeSubst().
+static uint32_t execCall(ExecCtx& ctx, const bc::Instr& ins, uint32_t returnPc) {
+    const ast::SourceRange& loc = ctx.loc(ins.loc);
+    const bc::CallSite& call = ctx.mod.calls[ins.a];
+
+    if (call.callee == bc::kNoProc) {
         std::ostringstream ss;
-        ss << "discharge expects loser '" << loserExpected << "', got '" << ellEff << "'";
-        throw runtime::RuntimeError(d.loc, ss.str());
+        ss << "call to undefined procedure '" << call.proc << "'";
+        throw runtime::RuntimeError(loc, ss.str());
     }
+    const bc::ProcInfo& def = ctx.mod.procs[call.callee];
+
+    checkCallDepth(ctx, loc);
+    ctx.callDepth++;
+
+    const CallFrame& caller = ctx.frames.back();
+    const size_t callerBase = caller.envBase;
+    const bc::ProcInfo* callerDef =
+        (caller.callSite == bc::kNoProc) ? nullptr : &ctx.mod.procs[ctx.mod.calls[caller.callSite].callee];
+    if (ctx.opt.trace) {
+        const ProcId* env = ctx.env.data() + callerBase;
+        ProcId args[8];
+        std::vector<ProcId> many;
+        ProcId* out = args;
+        if (call.args.size() > 8) {
+            many.resize(call.args.size());
+            out = many.data();
+        }
+        for (size_t i = 0; i < call.args.size(); ++i) out[i] = resolve(call.args[i], env);
 
-    if (entry->discharged) {
+        pushTrace(ctx, traceEvent(runtime::TraceKind::Call, ins.loc, ins.a), out);
+    }
+
+    if (def.params.size() != call.args.size()) {
         std::ostringstream ss;
-        ss << "race '" << key.process << "[" << key.key << "]' already discharged";
-        throw runtime::RuntimeError(d.loc, ss.str());
+        ss << "procedure '" << def.name << "' arity mismatch at runtime";
+        throw runtime::RuntimeError(loc, ss.str());
     }
 
-    const std::string targetProcEff = processSubst(d.target.process, subst);
-    ctx.store.set(targetProcEff, d.target.var, entry->vLoser);
+    const size_t base = ctx.env.size();
+    ctx.env.resize(base + call.slots.size());
+    // re-read after resize: the caller environment may have moved
+    const ProcId* callerEnv = ctx.env.data() + callerBase;
+    for (size_t i = 0; i < call.slots.size(); ++i) {
+        const bc::SlotInit& si = call.slots[i];
+        ProcId v = resolve(si.src, callerEnv);
+        if (si.formal) v = lookupByName(callerDef, callerEnv, v);
+        ctx.env[base + i] = v;
+    }
 
-    entry->discharged = true;
+    CallFrame fr;
+    fr.returnPc = returnPc;
+    fr.envBase = base;
+    fr.callSite = ins.a;
+    fr.callLoc = ins.loc;
+    ctx.frames.push_back(fr);
 
-    std::ostringstream ss;
-    ss << key.process << "[" << key.key << "] loser=" << ellEff
-       << " write " << targetProcEff << "." << d.target.var << "=" << entry->vLoser.toString();
-    pushTrace(ctx, "dis", ss.str(), d.loc);
+    return def.entry;
 }
 
 } // namespace
 
-SimulationResult Simulator::run(const ast::Program& program, const SimOptions& opt) {
-    SimulationResult res;
-    res.ok = false;
+ExecStatus execute(ExecCtx& ctx) {
+    const std::vector<bc::Instr>& code = ctx.mod.code;
+
+    uint32_t pc = ctx.pc;
+    ctx.suspended = false;
+
+    for (;;) {
+        const bc::Instr& ins = code[pc];
+        const ProcId* env = ctx.env.data() + ctx.frames.back().envBase;
+        if (ctx.opt.profiler) ctx.opt.profiler->enter(ins);
+
+        switch (ins.op) {
+        case bc::Op::Assign:
+            checkStepLimit(ctx, ctx.loc(ins.loc));
+            execAssign(ctx, ins, env);
+            ++pc;
+            break;
+
+        case bc::Op::Comm:
+            checkStepLimit(ctx, ctx.loc(ins.loc));
+            execComm(ctx, ins, env);
+            ++pc;
+            break;
+
+        case bc::Op::Select:
+            checkStepLimit(ctx, ctx.loc(ins.loc));
+            execSelect(ctx, ins, env);
+            ++pc;
+            break;
+
+        case bc::Op::Race:
+            // a resumed race was already counted when it suspended
+            if (!ctx.raceCounted) checkStepLimit(ctx, ctx.loc(ins.loc));
+            ctx.raceCounted = false;
+            execRace(ctx, ins, env);
+            if (ctx.suspended) {
+                ctx.raceCounted = true;
+                ctx.pc = pc;
+                return ExecStatus::Suspended;
+            }
+            ++pc;
+            break;
+
+        case bc::Op::Discharge:
+            checkStepLimit(ctx, ctx.loc(ins.loc));
+            execDischarge(ctx, ins, env);
+            ++pc;
+            break;
+
+        case bc::Op::IfLocal:
+            checkStepLimit(ctx, ctx.loc(ins.loc));
+            pc = execIfLocal(ctx, ins, env) ? pc + 1 : ins.b;
+            break;
+
+        case bc::Op::IfRace:
+            checkStepLimit(ctx, ctx.loc(ins.loc));
+            pc = execIfRace(ctx, ins, env) ? pc + 1 : ins.b;
+            break;
+
+        case bc::Op::Jump:
+            pc = ins.a;
+            break;
+
+        case bc::Op::Call:
+            checkStepLimit(ctx, ctx.loc(ins.loc));
+            pc = execCall(ctx, ins, pc + 1);
+            if (ctx.opt.profiler) ctx.opt.profiler->call(ctx.mod.calls[ins.a].callee);
+            break;
+
+        case bc::Op::Ret: {
+            const CallFrame fr = ctx.frames.back();
+            ctx.callDepth--;
+
+            if (ctx.opt.trace) {
+                const uint32_t node =
+                    (ctx.loc(fr.callLoc).file != ast::kNoFile ? fr.callLoc : ctx.mod.programLoc);
+                pushTrace(ctx, traceEvent(runtime::TraceKind::Ret, node, fr.callSite));
+            }
 
-    ExecCtx ctx(opt);
+            pc = fr.returnPc;
+            ctx.env.resize(fr.envBase);
+            ctx.frames.pop_back();
+            if (ctx.opt.profiler) ctx.opt.profiler->ret();
+            break;
+        }
 
-    try {
-        // ---- APPLY INIT (da --init ...) ----
-        {
-            const ast::SourceRange loc = initLoc();
-            for (const auto& b : opt.init) {
-                ctx.store.set(b.process, b.var, b.value);
-
-                std::ostringstream ss;
-                ss << b.process << "." << b.var << " = " << b.value.toString();
-                pushTrace(ctx, "init", ss.str(), loc);
-            }
+        case bc::Op::Halt:
+            ctx.pc = pc;
+            return ExecStatus::Halted;
+
+        default:
+            throw runtime::RuntimeError(ctx.loc(ctx.mod.programLoc), "unknown instruction");
+        }
+    }
+}
+
+std::shared_ptr<const runtime::Symbols> symbolsWithInit(const bc::Module& module, const SimOptions& opt) {
+    bool missing = false;
+    for (const auto& b : opt.init) {
+        if (module.symbols->processes.find(b.process) == runtime::kNoSymbol ||
+            module.symbols->vars.find(b.var) == runtime::kNoSymbol) {
+            missing = true;
+            break;
         }
+    }
+    if (!missing) return module.symbols;
 
-        const auto procTable = buildProcTable(program);
+    auto syms = std::make_shared<runtime::Symbols>(*module.symbols);
+    for (const auto& b : opt.init) {
+        syms->processes.intern(b.process);
+        syms->vars.intern(b.var);
+    }
+    return syms;
+}
+
+void startExecution(ExecCtx& ctx) {
+    // ---- APPLY INIT (da --init ...) ----
+    for (const auto& b : ctx.opt.init) {
+        auto ev = traceEvent(runtime::TraceKind::Init, ctx.mod.initLoc);
+        ev.p[0] = ctx.syms->processes.find(b.process);
+        ev.var = ctx.syms->vars.find(b.var);
+        ev.value = b.value;
+        ctx.store.set(ev.p[0], ev.var, b.value);
+
+        if (ctx.opt.trace) pushTrace(ctx, ev);
+    }
 
-        std::vector<BlockFrame> stack;
-        stack.push_back(BlockFrame{ program.main->body.get(), 0, {}, "", {} });
+    ctx.frames.push_back(CallFrame{});
+    ctx.pc = ctx.mod.entry;
+}
 
-        while (!stack.empty()) {
-            BlockFrame& fr = stack.back();
+SimulationResult Simulator::run(const ast::Program& program, const SimOptions& opt) {
+    return run(std::make_shared<const bc::Module>(compile(program)), opt);
+}
 
-            if (fr.ip >= fr.block->statements.size()) {
-                if (!fr.procName.empty()) {
-                    ctx.callDepth--;
+static RuntimeErrorInfo errorInfo(const runtime::RuntimeError& re) {
+    RuntimeErrorInfo e;
+    e.file = re.loc().fileName();
+    e.line = re.loc().start.line;
+    e.col  = re.loc().start.col;
+    e.message = re.what();
+    return e;
+}
 
-                    const ast::SourceRange& loc =
-                        (!fr.callLoc.file.empty() ? fr.callLoc : program.loc);
+static RuntimeErrorInfo internalErrorInfo(const std::exception& ex) {
+    RuntimeErrorInfo e;
+    e.file = "<internal>";
+    e.line = 0;
+    e.col  = 0;
+    e.message = ex.what();
+    return e;
+}
 
-                    pushTrace(ctx, "ret", fr.procName, loc);
-                }
-                stack.pop_back();
-                continue;
-            }
+SimulationResult Simulator::run(std::shared_ptr<const bc::Module> modulePtr, const SimOptions& opt) {
+    const bc::Module& module = *modulePtr;
 
-            const ast::Stmt& st = *fr.block->statements[fr.ip];
-
-            std::visit([&](auto&& node) {
-                using T = std::decay_t<decltype(node)>;
-
-                if constexpr (std::is_same_v<T, ast::InteractionStmt>) {
-                    checkStepLimit(ctx, node.loc);
-                    fr.ip++;
-
-                    std::visit([&](auto&& inNode) {
-                        using I = std::decay_t<decltype(inNode)>;
-
-                        if constexpr (std::is_same_v<I, ast::Assign>) {
-                            execAssign(ctx, inNode, fr.subst);
-                        } else if constexpr (std::is_same_v<I, ast::Comm>) {
-                            execComm(ctx, inNode, fr.subst);
-                        } else if constexpr (std::is_same_v<I, ast::Select>) {
-                            execSelect(ctx, inNode, fr.subst);
-                        } else if constexpr (std::is_same_v<I, ast::Race>) {
-                            execRace(ctx, inNode, fr.subst);
-                        } else if constexpr (std::is_same_v<I, ast::Discharge>) {
-                            execDischarge(ctx, inNode, fr.subst);
-                        }
-                    }, node.interaction);
-
-                } else if constexpr (std::is_same_v<T, ast::IfLocalStmt>) {
-                    checkStepLimit(ctx, node.loc);
-
-                    runtime::Value condV = evalProcExpr(ctx, node.condition, fr.subst);
-                    bool cond = requireBool(condV, node.condition.loc);
-
-                    std::ostringstream ss;
-                    ss << "cond=" << (cond ? "true" : "false")
-                       << " @ " << procExprToString(node.condition, fr.subst)
-                       << " -> " << (cond ? "then" : "else");
-                    pushTrace(ctx, "if", ss.str(), node.loc);
-
-                    fr.ip++;
-                    const ast::Block* chosen = cond ? node.thenBlock.get() : node.elseBlock.get();
-                    stack.push_back(BlockFrame{ chosen, 0, fr.subst, "", {} });
-
-                } else if constexpr (std::is_same_v<T, ast::IfRaceStmt>) {
-                    checkStepLimit(ctx, node.loc);
-
-                    const ast::Block* chosen = nullptr;
-                    std::string msg;
-                    execIfRace(ctx, node, fr.subst, chosen, msg);
-                    pushTrace(ctx, "ifRace", msg, node.loc);
-
-                    fr.ip++;
-                    stack.push_back(BlockFrame{ chosen, 0, fr.subst, "", {} });
-
-                } else if constexpr (std::is_same_v<T, ast::CallStmt>) {
-                    checkStepLimit(ctx, node.loc);
-
-                    auto it = procTable.find(node.proc);
-                    if (it == procTable.end()) {
-                        std::ostringstream ss;
-                        ss << "call to undefined procedure '" << node.proc << "'";
-                        throw runtime::RuntimeError(node.loc, ss.str());
-                    }
-                    const ast::ProcDef* def = it->second;
-
-                    checkCallDepth(ctx, node.loc);
-                    ctx.callDepth++;
-
-                    {
-                        std::ostringstream ss;
-                        ss << node.proc << "(";
-                        for (size_t i = 0; i < node.args.size(); ++i) {
-                            if (i) ss << ",";
-                            ss << processSubst(node.args[i], fr.subst);
-                        }
-                        ss << ")";
-                        pushTrace(ctx, "call", ss.str(), node.loc);
-                    }
-
-                    auto inner = buildCallSubst(*def, node, fr.subst);
-                    auto composed = composeSubst(fr.subst, inner);
-
-                    fr.ip++;
-                    stack.push_back(BlockFrame{ def->body.get(), 0, composed, node.proc, node.loc });
-
-                } else {
-                    throw runtime::RuntimeError(program.loc, "unknown statement kind");
-                }
-
-            }, st);
-        }
+    SimulationResult res;
+    res.ok = false;
+    res.module = modulePtr;
 
+    ExecCtx ctx(module, opt, symbolsWithInit(module, opt));
+    res.symbols = ctx.syms;
+
+    TraceSink* sink = opt.trace ? opt.traceSink : nullptr;
+    if (sink) sink->begin(module, *ctx.syms);
+    if (opt.profiler) opt.profiler->begin(module);
+
+    try {
+        startExecution(ctx);
+        execute(ctx);
         res.ok = true;
-        res.store = std::move(ctx.store);
-        res.races = std::move(ctx.races);
-        res.trace = std::move(ctx.trace);
-        return res;
+    } catch (const runtime::RuntimeError& re) {
+        res.runtimeErrors.push_back(errorInfo(re));
+    } catch (const std::exception& ex) {
+        res.runtimeErrors.push_back(internalErrorInfo(ex));
+    }
+
+    if (sink) sink->end();
+    if (opt.profiler) opt.profiler->end();
+
+    res.steps = ctx.steps;
+    res.traceEvents = ctx.traceEvents;
+    res.store = std::move(ctx.store);
+    res.races = std::move(ctx.races);
+    res.trace = std::move(ctx.trace);
+    return res;
+}
 
+// -------------------- Simulation --------------------
+Simulation::Simulation(std::shared_ptr<const bc::Module> module, const SimOptions& opt)
+    : module_(std::move(module)), opt_(opt) {
+    opt_.traceSink = nullptr;
+    opt_.profiler = nullptr;
+    ctx_ = std::make_unique<ExecCtx>(*module_, opt_, symbolsWithInit(*module_, opt_));
+    try {
+        startExecution(*ctx_);
     } catch (const runtime::RuntimeError& re) {
-        RuntimeErrorInfo e;
-        e.file = re.loc().file;
-        e.line = re.loc().start.line;
-        e.col  = re.loc().start.col;
-        e.message = re.what();
-        res.runtimeErrors.push_back(std::move(e));
-
-        res.store = std::move(ctx.store);
-        res.races = std::move(ctx.races);
-        res.trace = std::move(ctx.trace);
-        res.ok = false;
-        return res;
+        runtimeErrors_.push_back(errorInfo(re));
+        done_ = true;
+    }
+}
+
+Simulation::~Simulation() = default;
 
+void Simulation::resume(bool suspendAtRace) {
+    if (done_) return;
+    if (suspended_ && suspendAtRace && !ctx_->forced) return; // still waiting for decide()
+
+    ctx_->suspendAtRace = suspendAtRace;
+    try {
+        suspended_ = (execute(*ctx_) == ExecStatus::Suspended);
+        done_ = !suspended_;
+    } catch (const runtime::RuntimeError& re) {
+        runtimeErrors_.push_back(errorInfo(re));
+        suspended_ = false;
+        done_ = true;
     } catch (const std::exception& ex) {
-        RuntimeErrorInfo e;
-        e.file = "<internal>";
-        e.line = 0;
-        e.col  = 0;
-        e.message = ex.what();
-        res.runtimeErrors.push_back(std::move(e));
-
-        res.store = std::move(ctx.store);
-        res.races = std::move(ctx.races);
-        res.trace = std::move(ctx.trace);
-        res.ok = false;
-        return res;
+        runtimeErrors_.push_back(internalErrorInfo(ex));
+        suspended_ = false;
+        done_ = true;
+    }
+}
+
+bool Simulation::runToNextRace() {
+    resume(true);
+    return suspended_;
+}
+
+void Simulation::runToEnd() {
+    resume(false);
+}
+
+PendingRaceInfo Simulation::pendingRace() const {
+    if (!suspended_) throw std::logic_error("simulation is not waiting on a race");
+
+    const PendingRace& pr = ctx_->pending;
+    PendingRaceInfo info;
+    info.race = ctx_->procName(pr.process) + "[" + ctx_->raceKeyName(module_->races[pr.race].key) + "]";
+    info.left = ctx_->procName(pr.left);
+    info.right = ctx_->procName(pr.right);
+    return info;
+}
+
+void Simulation::decide(runtime::RaceWinnerSide side) {
+    if (!suspended_) throw std::logic_error("simulation is not waiting on a race");
+    ctx_->forced = side;
+}
+
+Snapshot Simulation::snapshot() const {
+    Snapshot snap;
+    snap.owner_ = this;
+    snap.ctx_ = std::make_shared<const ExecCtx>(*ctx_);
+    snap.suspended_ = suspended_;
+    snap.done_ = done_;
+    snap.runtimeErrors_ = runtimeErrors_;
+    return snap;
+}
+
+void Simulation::restore(const Snapshot& snap) {
+    if (snap.owner_ != this || !snap.ctx_) {
+        throw std::invalid_argument("snapshot was taken from another simulation");
     }
+    ctx_ = std::make_unique<ExecCtx>(*snap.ctx_);
+    suspended_ = snap.suspended_;
+    done_ = snap.done_;
+    runtimeErrors_ = snap.runtimeErrors_;
 }
 
-} 
\ No newline at end of file
+SimulationResult Simulation::result() const {
+    SimulationResult res;
+    res.ok = done_ && runtimeErrors_.empty();
+    res.module = module_;
+    res.symbols = ctx_->syms;
+    res.steps = ctx_->steps;
+    res.traceEvents = ctx_->traceEvents;
+    res.store = ctx_->store;
+    res.races = ctx_->races;
+    res.trace = ctx_->trace;
+    res.runtimeErrors = runtimeErrors_;
+    return res;
+}
+
+}
@@ -1,5 +1,10 @@
 #pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "ast/Ast.h"
+#include "sim/Bytecode.h"
 #include "sim/SimOptions.h"
 #include "sim/SimulationResult.h"
 
@@ -7,7 +12,87 @@ namespace sim {
 
 class Simulator final {
 public:
+    // Lowers the program (sim::compile) and runs it.
     static SimulationResult run(const ast::Program& program, const SimOptions& opt);
+
+    // Runs an already compiled module; lets callers compile once and run many times.
+    // The result keeps the module alive, its trace refers to it.
+    static SimulationResult run(std::shared_ptr<const bc::Module> module, const SimOptions& opt);
+};
+
+struct ExecCtx;
+
+// The race a suspended Simulation is waiting on.
+struct PendingRaceInfo {
+    std::string race;   // "p[k]"
+    std::string left;   // process that wins with RaceWinnerSide::Left
+    std::string right;
+};
+
+class Simulation;
+
+// Frozen state of a Simulation. Taking one is O(1) (store, race memory,
+// trace and RNG are shared copy-on-write), so thousands per second are
+// fine. Only valid for the Simulation that took it.
+class Snapshot final {
+private:
+    friend class Simulation;
+
+    const Simulation* owner_ = nullptr;
+    std::shared_ptr<const ExecCtx> ctx_;
+    bool suspended_ = false;
+    bool done_ = false;
+    std::vector<RuntimeErrorInfo> runtimeErrors_;
+};
+
+// Step-wise simulation for what-if debugging: run to the next race, take a
+// snapshot, pick a winner, and later restore the snapshot to try the other.
+//
+//   Simulation s(module, opt);
+//   while (s.runToNextRace()) {
+//       Snapshot before = s.snapshot();
+//       s.decide(runtime::RaceWinnerSide::Right);
+//       ...
+//   }
+//   SimulationResult r = s.result();
+class Simulation final {
+public:
+    Simulation(std::shared_ptr<const bc::Module> module, const SimOptions& opt);
+    ~Simulation();
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    // Runs until a race needs a winner (true) or the program ends or fails
+    // (false). A winner given with decide() is used first.
+    bool runToNextRace();
+
+    // Runs to the end, resolving races with opt.racePolicy.
+    void runToEnd();
+
+    bool suspended() const { return suspended_; }
+    bool finished() const { return done_; }
+
+    // requires suspended()
+    PendingRaceInfo pendingRace() const;
+    void decide(runtime::RaceWinnerSide side);
+
+    Snapshot snapshot() const;
+    void restore(const Snapshot& snap); // throws std::invalid_argument for a foreign snapshot
+
+    // current store, race memory and trace (also mid-run)
+    SimulationResult result() const;
+
+private:
+    std::shared_ptr<const bc::Module> module_;
+    SimOptions opt_;
+    std::unique_ptr<ExecCtx> ctx_;
+
+    bool suspended_ = false;
+    bool done_ = false;
+    std::vector<RuntimeErrorInfo> runtimeErrors_;
+
+    void resume(bool suspendAtRace);
 };
 
-} 
\ No newline at end of file
+}
@@ -0,0 +1,110 @@
+#include "sim/TraceFormat.h"
+
+namespace sim {
+
+const char* TraceFormatter::kind(runtime::TraceKind k) {
+    switch (k) {
+    case runtime::TraceKind::Init:   return "init";
+    case runtime::TraceKind::Asg:    return "asg";
+    case runtime::TraceKind::Com:    return "com";
+    case runtime::TraceKind::Sel:    return "sel";
+    case runtime::TraceKind::Race:   return "race";
+    case runtime::TraceKind::IfRace: return "ifRace";
+    case runtime::TraceKind::If:     return "if";
+    case runtime::TraceKind::Dis:    return "dis";
+    case runtime::TraceKind::Call:   return "call";
+    case runtime::TraceKind::Ret:    return "ret";
+    }
+    return "?";
+}
+
+std::string TraceFormatter::message(const runtime::TraceEvent& ev, const runtime::ProcId* args) const {
+    using runtime::TraceKind;
+
+    std::string out;
+    switch (ev.kind) {
+    case TraceKind::Init:
+    case TraceKind::Asg:
+        out = proc(ev.p[0]) + "." + var(ev.var) + " = " + ev.value.toString();
+        break;
+
+    case TraceKind::Com:
+        out = proc(ev.p[0]) + "." + mod_.exprs[ev.ref].text + " = " + ev.value.toString()
+            + " -> " + proc(ev.p[1]) + "." + var(ev.var);
+        break;
+
+    case TraceKind::Sel:
+        out = proc(ev.p[0]) + " -> " + proc(ev.p[1]) + " [" + mod_.labels[ev.ref] + "]";
+        break;
+
+    case TraceKind::Race:
+        out = proc(ev.p[0]) + "[" + raceKey(ev.ref) + "] winner=" + proc(ev.p[1])
+            + " loser=" + proc(ev.p[2])
+            + " write " + proc(ev.p[3]) + "." + var(ev.var) + "=" + ev.value.toString();
+        break;
+
+    case TraceKind::IfRace:
+        out = proc(ev.p[0]) + "[" + raceKey(ev.ref) + "] winner=" + proc(ev.p[1])
+            + " -> " + (ev.flag ? "then" : "else");
+        break;
+
+    case TraceKind::If:
+        out = std::string("cond=") + (ev.flag ? "true" : "false")
+            + " @ " + proc(ev.p[0]) + "." + mod_.exprs[ev.ref].text
+            + " -> " + (ev.flag ? "then" : "else");
+        break;
+
+    case TraceKind::Dis:
+        out = proc(ev.p[0]) + "[" + raceKey(ev.ref) + "] loser=" + proc(ev.p[1])
+            + " write " + proc(ev.p[2]) + "." + var(ev.var) + "=" + ev.value.toString();
+        break;
+
+    case TraceKind::Call: {
+        const bc::CallSite& call = mod_.calls[ev.ref];
+        out = call.proc + "(";
+        for (size_t i = 0; i < call.args.size(); ++i) {
+            if (i) out += ",";
+            out += proc(args[i]);
+        }
+        out += ")";
+        break;
+    }
+
+    case TraceKind::Ret:
+        out = mod_.calls[ev.ref].proc;
+        break;
+    }
+    return out;
+}
+
+std::vector<runtime::ProcId> TraceFormatter::callArgs(const runtime::TraceEvent& ev,
+                                                       const runtime::Trace& trace) const {
+    std::vector<runtime::ProcId> args;
+    if (ev.kind == runtime::TraceKind::Call) {
+        const size_t n = mod_.calls[ev.ref].args.size();
+        args.reserve(n);
+        for (size_t i = 0; i < n; ++i) args.push_back(trace.arg(ev.p[0], i));
+    }
+    return args;
+}
+
+std::string TraceFormatter::message(const runtime::TraceEvent& ev, const runtime::Trace& trace) const {
+    return message(ev, callArgs(ev, trace).data());
+}
+
+std::string TraceFormatter::toString(const runtime::TraceEvent& ev, const runtime::Trace& trace) const {
+    return toString(ev, callArgs(ev, trace).data());
+}
+
+std::string TraceFormatter::toString(const runtime::TraceEvent& ev, const runtime::ProcId* args) const {
+    const ast::SourceRange& l = loc(ev);
+
+    std::string out = kind(ev.kind);
+    if (l.file != ast::kNoFile) {
+        out += " @" + l.fileName() + ":" + std::to_string(l.start.line) + ":" + std::to_string(l.start.col);
+    }
+    out += " " + message(ev, args);
+    return out;
+}
+
+}
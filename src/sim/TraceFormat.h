@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "ast/SourceLocation.h"
+#include "runtime/Symbols.h"
+#include "runtime/Trace.h"
+#include "sim/Bytecode.h"
+
+namespace sim {
+
+// Renders runtime::TraceEvent records back into the printable trace
+// ("kind @file:line:col message"). Only used when the trace is emitted.
+class TraceFormatter final {
+public:
+    TraceFormatter(const bc::Module& module, const runtime::Symbols& symbols)
+        : mod_(module), syms_(symbols) {}
+
+    static const char* kind(runtime::TraceKind k);
+
+    // `args`: resolved call arguments of a Call event (see sim::TraceSink)
+    std::string message(const runtime::TraceEvent& ev, const runtime::ProcId* args) const;
+    std::string message(const runtime::TraceEvent& ev, const runtime::Trace& trace) const;
+    const ast::SourceRange& loc(const runtime::TraceEvent& ev) const { return mod_.locs[ev.node]; }
+
+    // For CLI trace
+    std::string toString(const runtime::TraceEvent& ev, const runtime::ProcId* args) const;
+    std::string toString(const runtime::TraceEvent& ev, const runtime::Trace& trace) const;
+
+private:
+    const bc::Module& mod_;
+    const runtime::Symbols& syms_;
+
+    const std::string& proc(runtime::ProcId p) const { return syms_.processes.name(p); }
+    const std::string& var(runtime::VarId x) const { return syms_.vars.name(x); }
+    const std::string& raceKey(uint32_t raceRef) const { return syms_.raceKeys.name(mod_.races[raceRef].key); }
+
+    // a stored Call event keeps its arguments in the trace's side array
+    std::vector<runtime::ProcId> callArgs(const runtime::TraceEvent& ev, const runtime::Trace& trace) const;
+};
+
+}
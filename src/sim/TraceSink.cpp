@@ -0,0 +1,123 @@
+#include "sim/TraceSink.h"
+
+#include "Json.h"
+
+namespace sim {
+
+// -------------------- text --------------------
+void TextTraceSink::begin(const bc::Module& module, const runtime::Symbols& symbols) {
+    fmt_ = std::make_unique<TraceFormatter>(module, symbols);
+}
+
+void TextTraceSink::event(const runtime::TraceEvent& ev, const runtime::ProcId* args) {
+    os_ << fmt_->toString(ev, args) << "\n";
+}
+
+void TextTraceSink::end() {
+    os_.flush();
+}
+
+// -------------------- NDJSON --------------------
+void NdjsonTraceSink::begin(const bc::Module& module, const runtime::Symbols& symbols) {
+    fmt_ = std::make_unique<TraceFormatter>(module, symbols);
+}
+
+void NdjsonTraceSink::event(const runtime::TraceEvent& ev, const runtime::ProcId* args) {
+    const ast::SourceRange& loc = fmt_->loc(ev);
+    os_ << "{\"kind\":\"" << TraceFormatter::kind(ev.kind) << "\""
+        << ",\"message\":\"" << json::escape(fmt_->message(ev, args)) << "\""
+        << ",\"file\":\"" << json::escape(loc.fileName()) << "\""
+        << ",\"line\":" << loc.start.line
+        << ",\"column\":" << loc.start.col
+        << "}\n";
+}
+
+void NdjsonTraceSink::end() {
+    os_.flush();
+}
+
+// -------------------- binary --------------------
+void BinaryTraceSink::u32(uint32_t v) {
+    char b[4];
+    for (int i = 0; i < 4; ++i) b[i] = static_cast<char>((v >> (8 * i)) & 0xFFu);
+    os_.write(b, 4);
+}
+
+void BinaryTraceSink::str(const std::string& s) {
+    u32(static_cast<uint32_t>(s.size()));
+    os_.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+void BinaryTraceSink::begin(const bc::Module& module, const runtime::Symbols& symbols) {
+    mod_ = &module;
+
+    os_.write("RCTRACE\0", 8);
+    u32(kVersion);
+
+    auto table = [&](const runtime::SymbolTable& t) {
+        u32(static_cast<uint32_t>(t.size()));
+        for (uint32_t i = 0; i < t.size(); ++i) str(t.name(i));
+    };
+    table(symbols.processes);
+    table(symbols.vars);
+    table(symbols.raceKeys);
+
+    u32(static_cast<uint32_t>(module.labels.size()));
+    for (const auto& l : module.labels) str(l);
+
+    u32(static_cast<uint32_t>(module.exprs.size()));
+    for (const auto& e : module.exprs) str(e.text);
+
+    u32(static_cast<uint32_t>(module.calls.size()));
+    for (const auto& c : module.calls) str(c.proc);
+
+    u32(static_cast<uint32_t>(module.locs.size()));
+    for (const auto& l : module.locs) {
+        str(l.fileName());
+        u32(l.start.line);
+        u32(l.start.col);
+    }
+}
+
+void BinaryTraceSink::event(const runtime::TraceEvent& ev, const runtime::ProcId* args) {
+    const bool isBool = ev.value.kind == runtime::Value::Kind::Bool;
+
+    u8(static_cast<uint8_t>(ev.kind));
+    u8(ev.flag ? 1 : 0);
+    u8(isBool ? 1 : 0);
+    u8(0);
+    u32(ev.node);
+    u32(ev.ref);
+    for (runtime::ProcId p : ev.p) u32(p);
+    u32(ev.var);
+    u32(isBool ? (ev.value.boolValue ? 1u : 0u) : static_cast<uint32_t>(ev.value.intValue));
+
+    if (ev.kind == runtime::TraceKind::Call) {
+        const size_t n = mod_->calls[ev.ref].args.size();
+        u32(static_cast<uint32_t>(n));
+        for (size_t i = 0; i < n; ++i) u32(args[i]);
+    }
+}
+
+void BinaryTraceSink::end() {
+    u8(0xFF);
+    os_.flush();
+}
+
+// -------------------- memory --------------------
+void MemoryTraceSink::begin(const bc::Module& module, const runtime::Symbols& symbols) {
+    (void)symbols;
+    mod_ = &module;
+}
+
+void MemoryTraceSink::event(const runtime::TraceEvent& ev, const runtime::ProcId* args) {
+    if (ev.kind != runtime::TraceKind::Call) {
+        trace_.push(ev);
+        return;
+    }
+    runtime::TraceEvent stored = ev;
+    stored.p[0] = trace_.pushArgs(args, mod_->calls[ev.ref].args.size());
+    trace_.push(stored);
+}
+
+}
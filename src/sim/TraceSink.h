@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "runtime/Symbols.h"
+#include "runtime/Trace.h"
+#include "sim/Bytecode.h"
+#include "sim/TraceFormat.h"
+
+namespace sim {
+
+// Receives trace events while Simulator::run executes, instead of having
+// them accumulate in SimulationResult::trace. Memory stays constant and
+// output starts with the first step.
+//
+// begin() is called once before the first event (symbols include the
+// --init names), end() once after the last one, also when the run fails.
+// `args` points to the resolved call arguments of a TraceKind::Call event
+// (call-site arity), and is null for every other kind.
+class TraceSink {
+public:
+    virtual ~TraceSink() = default;
+
+    virtual void begin(const bc::Module& module, const runtime::Symbols& symbols) {
+        (void)module;
+        (void)symbols;
+    }
+    virtual void event(const runtime::TraceEvent& ev, const runtime::ProcId* args) = 0;
+    virtual void end() {}
+};
+
+// "kind @file:line:col message" lines, as printed by `simulate`.
+class TextTraceSink final : public TraceSink {
+public:
+    explicit TextTraceSink(std::ostream& os) : os_(os) {}
+
+    void begin(const bc::Module& module, const runtime::Symbols& symbols) override;
+    void event(const runtime::TraceEvent& ev, const runtime::ProcId* args) override;
+    void end() override;
+
+private:
+    std::ostream& os_;
+    std::unique_ptr<TraceFormatter> fmt_;
+};
+
+// One JSON object per line, same fields as the "trace" array of --json:
+// {"kind":..,"message":..,"file":..,"line":..,"column":..}
+class NdjsonTraceSink final : public TraceSink {
+public:
+    explicit NdjsonTraceSink(std::ostream& os) : os_(os) {}
+
+    void begin(const bc::Module& module, const runtime::Symbols& symbols) override;
+    void event(const runtime::TraceEvent& ev, const runtime::ProcId* args) override;
+    void end() override;
+
+private:
+    std::ostream& os_;
+    std::unique_ptr<TraceFormatter> fmt_;
+};
+
+// Compact binary stream (little endian), written to a file opened in
+// binary mode. Self-describing: the header carries every table the
+// records refer to.
+//
+//   header   "RCTRACE\0", u32 version (1)
+//            string tables, each u32 count then (u32 len, bytes)*:
+//              processes, vars, raceKeys, labels,
+//              expr texts (Module::exprs), call names (Module::calls)
+//            locs: u32 count then (string file, u32 line, u32 col)*
+//   record   u8 kind, u8 flag, u8 value kind (0 int, 1 bool), u8 pad,
+//            u32 node (loc index), u32 ref, u32 p[4], u32 var, i32 value
+//            Call records are followed by u32 argc and argc u32 process ids.
+//   trailer  u8 0xFF
+class BinaryTraceSink final : public TraceSink {
+public:
+    static constexpr uint32_t kVersion = 1;
+
+    explicit BinaryTraceSink(std::ostream& os) : os_(os) {}
+
+    void begin(const bc::Module& module, const runtime::Symbols& symbols) override;
+    void event(const runtime::TraceEvent& ev, const runtime::ProcId* args) override;
+    void end() override;
+
+private:
+    std::ostream& os_;
+    const bc::Module* mod_ = nullptr;
+
+    void u8(uint8_t v) { os_.put(static_cast<char>(v)); }
+    void u32(uint32_t v);
+    void str(const std::string& s);
+};
+
+// Keeps the events in memory (tests, or callers that want a Trace while
+// still going through the sink interface).
+class MemoryTraceSink final : public TraceSink {
+public:
+    void begin(const bc::Module& module, const runtime::Symbols& symbols) override;
+    void event(const runtime::TraceEvent& ev, const runtime::ProcId* args) override;
+
+    const runtime::Trace& trace() const { return trace_; }
+
+private:
+    runtime::Trace trace_;
+    const bc::Module* mod_ = nullptr;
+};
+
+}
@@ -0,0 +1,795 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "antlr4-runtime.h"
+#include "RacingChoreoLexer.h"
+#include "RacingChoreoParser.h"
+
+#include "AstBuilderVisitor.h"
+#include "AstJson.h"
+#include "FastParser.h"
+#include "Json.h"
+#include "JsonReader.h"
+#include "RunStats.h"
+#include "Validation.h"
+#include "gen/Generator.h"
+#include "sim/Compiler.h"
+#include "sim/SimOptions.h"
+#include "sim/Simulator.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#define RC_HAVE_SPAWN 1
+#endif
+
+// rc_bench: throughput and latency of each phase, on programs from
+// gen::generate. One process runs every benchmark; each sample is one
+// call of the phase on the whole program.
+//
+// --perf CASE is the perf regression check (ctest -L perf): it runs
+// rc_parser itself on a generated program and compares wall time, steps
+// per second and peak RSS with a baseline file.
+
+#ifndef RC_BUILD_CONFIG
+#define RC_BUILD_CONFIG ""
+#endif
+
+namespace {
+
+struct BenchOptions {
+    std::vector<uint32_t> sizes{1000, 10000, 100000}; // statements
+    uint64_t seed = 1;
+    uint32_t minSamples = 5;
+    uint32_t maxSamples = 1000;
+    uint32_t minTimeMs = 200;
+    std::string filter; // substring of "workload/size/benchmark"
+    std::string outPath;
+    bool quiet = false;
+
+    // --perf / --perf-update
+    std::string perfCase;
+    std::string baselinePath;
+    bool perfUpdate = false;
+    std::string rcParser;
+    std::string workDir = ".";
+    uint32_t runs = 3;
+    int tolerance = -1; // overrides the baseline's wall/steps tolerance
+};
+
+// ---------- peak RSS ----------
+// RunStats::peakRssKb. On Linux it is reset before each benchmark
+// through clear_refs, so each result has its own peak; elsewhere it is
+// the process peak so far.
+void resetPeakRss() {
+#if defined(__linux__)
+    std::ofstream f("/proc/self/clear_refs");
+    if (f) f << "5";
+#endif
+}
+
+// ---------- workloads ----------
+struct Workload {
+    std::string name;
+    uint32_t statements = 0;
+    std::string text;
+    std::unique_ptr<ast::Program> program; // FastParser's
+    std::shared_ptr<const sim::bc::Module> module;
+    uint64_t tokens = 0;
+    uint64_t nodes = 0;
+};
+
+gen::GenOptions workloadOptions(const std::string& name, uint32_t statements, uint64_t seed) {
+    gen::GenOptions g;
+    g.seed = seed;
+    g.statements = statements;
+    if (name == "mixed") {
+        g.procedures = std::max<uint32_t>(4, statements / 250);
+    } else if (name == "races") {
+        // main only, a race group every few statements
+        g.procedures = 0;
+        g.recursive = 0;
+        g.racePercent = 100;
+        g.dischargePercent = 100;
+    } else { // calls
+        g.procedures = std::max<uint32_t>(12, statements / 50);
+        g.callDepth = 6;
+        g.callsPerBody = 3;
+        g.recursive = 4;
+        g.recursionDepth = 8;
+    }
+    return g;
+}
+
+const char* const kWorkloads[] = {"mixed", "races", "calls"};
+
+Workload makeWorkload(const std::string& name, uint32_t statements, uint64_t seed) {
+    Workload w;
+    w.name = name;
+    w.statements = statements;
+    w.text = gen::generate(workloadOptions(name, statements, seed));
+
+    size_t tokens = 0;
+    w.program = FastParser("<bench>").parse(w.text, &tokens);
+    if (!w.program) throw std::runtime_error("generated program does not parse: " + name);
+    if (!Validator().validate(*w.program).empty()) throw std::runtime_error("generated program is not valid: " + name);
+    w.tokens = tokens;
+    w.nodes = RunStats::countNodes(*w.program);
+    w.module = std::make_shared<const sim::bc::Module>(sim::compile(*w.program));
+    return w;
+}
+
+sim::SimOptions simOptions(uint64_t seed) {
+    sim::SimOptions o;
+    o.quiet = true;
+    o.trace = false;
+    o.seed = seed;
+    o.maxSteps = UINT64_MAX;
+    return o;
+}
+
+// the ANTLR front end as Pipeline sets it up for its SLL pass
+struct Antlr {
+    antlr4::ANTLRInputStream input;
+    RacingChoreoLexer lexer;
+    antlr4::CommonTokenStream tokens;
+    RacingChoreoParser parser;
+
+    explicit Antlr(const std::string& text)
+        : input(text), lexer(&input), tokens(&lexer), parser(&tokens) {
+        lexer.removeErrorListeners();
+        parser.removeErrorListeners();
+        parser.getInterpreter<antlr4::atn::ParserATNSimulator>()
+            ->setPredictionMode(antlr4::atn::PredictionMode::SLL);
+        parser.setErrorHandler(std::make_shared<antlr4::BailErrorStrategy>());
+    }
+};
+
+// ---------- measuring ----------
+struct Result {
+    std::string name;
+    const Workload* workload = nullptr;
+    const char* unit = "";
+    uint64_t units = 0;          // per sample
+    std::vector<int64_t> ns;     // one per sample, sorted
+    uint64_t peakRssKb = 0;
+};
+
+volatile uint64_t g_sink = 0; // keeps the measured calls from being optimized out
+
+// one untimed warm-up call, then samples until both minSamples and
+// minTimeMs are reached (or maxSamples)
+std::vector<int64_t> measure(const BenchOptions& opt, const std::function<uint64_t()>& f) {
+    g_sink = g_sink + f();
+
+    std::vector<int64_t> ns;
+    int64_t total = 0;
+    const int64_t minTotal = int64_t(opt.minTimeMs) * 1000000;
+    while (ns.size() < opt.maxSamples && (ns.size() < opt.minSamples || total < minTotal)) {
+        const auto t0 = std::chrono::steady_clock::now();
+        g_sink = g_sink + f();
+        const auto t1 = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        total += ns.back();
+    }
+    std::sort(ns.begin(), ns.end());
+    return ns;
+}
+
+// nearest rank
+int64_t percentile(const std::vector<int64_t>& sorted, int p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (sorted.size() * static_cast<size_t>(p) + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+double meanNs(const std::vector<int64_t>& ns) {
+    double sum = 0;
+    for (int64_t v : ns) sum += static_cast<double>(v);
+    return ns.empty() ? 0 : sum / static_cast<double>(ns.size());
+}
+
+std::string number(double v) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.3f", v);
+    return buf;
+}
+
+// ---------- benchmarks ----------
+struct Bench {
+    const char* name;
+    const char* unit;
+    uint64_t (*units)(const Workload&);
+    std::function<uint64_t()> (*prepare)(const Workload&, const BenchOptions&);
+};
+
+uint64_t tokensOf(const Workload& w) { return w.tokens; }
+uint64_t nodesOf(const Workload& w) { return w.nodes; }
+
+const Bench kBenches[] = {
+    {"lex", "tokens", tokensOf, [](const Workload& w, const BenchOptions&) -> std::function<uint64_t()> {
+        return [&w] {
+            antlr4::ANTLRInputStream input(w.text);
+            RacingChoreoLexer lexer(&input);
+            lexer.removeErrorListeners();
+            antlr4::CommonTokenStream tokens(&lexer);
+            tokens.fill();
+            return static_cast<uint64_t>(tokens.size());
+        };
+    }},
+    {"parse_fast", "tokens", tokensOf, [](const Workload& w, const BenchOptions&) -> std::function<uint64_t()> {
+        return [&w] {
+            auto prog = FastParser("<bench>").parse(w.text);
+            return static_cast<uint64_t>(prog->procedures.size());
+        };
+    }},
+    {"parse_antlr", "tokens", tokensOf, [](const Workload& w, const BenchOptions&) -> std::function<uint64_t()> {
+        return [&w] {
+            Antlr fe(w.text);
+            return static_cast<uint64_t>(fe.parser.program()->procDef().size());
+        };
+    }},
+    {"build", "nodes", nodesOf, [](const Workload& w, const BenchOptions&) -> std::function<uint64_t()> {
+        auto fe = std::make_shared<Antlr>(w.text);
+        RacingChoreoParser::ProgramContext* tree = fe->parser.program();
+        return [fe, tree] {
+            auto prog = AstBuilderVisitor("<bench>").build(tree);
+            return static_cast<uint64_t>(prog->procedures.size());
+        };
+    }},
+    {"validate", "nodes", nodesOf, [](const Workload& w, const BenchOptions&) -> std::function<uint64_t()> {
+        return [&w] { return static_cast<uint64_t>(Validator().validate(*w.program).size()); };
+    }},
+    {"astjson", "nodes", nodesOf, [](const Workload& w, const BenchOptions&) -> std::function<uint64_t()> {
+        return [&w] { return static_cast<uint64_t>(astjson::serialize(*w.program).size()); };
+    }},
+    {"compile", "nodes", nodesOf, [](const Workload& w, const BenchOptions&) -> std::function<uint64_t()> {
+        return [&w] { return static_cast<uint64_t>(sim::compile(*w.program).code.size()); };
+    }},
+    {"simulate", "steps", nullptr, [](const Workload& w, const BenchOptions& opt) -> std::function<uint64_t()> {
+        const sim::SimOptions so = simOptions(opt.seed);
+        return [&w, so] {
+            sim::SimulationResult r = sim::Simulator::run(w.module, so);
+            if (!r.ok) {
+                throw std::runtime_error("simulation of " + w.name + " failed: " +
+                                         (r.runtimeErrors.empty() ? "?" : r.runtimeErrors.front().message));
+            }
+            return r.steps;
+        };
+    }},
+};
+
+uint64_t simulatedSteps(const Workload& w, const BenchOptions& opt) {
+    return sim::Simulator::run(w.module, simOptions(opt.seed)).steps;
+}
+
+void writeResult(json::Writer& jw, const Result& r) {
+    const Workload& w = *r.workload;
+    const double mean = meanNs(r.ns);
+
+    jw.elementObjectBegin();
+    jw.keyString("name", r.name);
+    jw.keyString("workload", w.name);
+    jw.keyInt("statements", static_cast<int>(w.statements));
+    jw.keyRaw("bytes", std::to_string(w.text.size()));
+    jw.keyString("unit", r.unit);
+    jw.keyRaw("units", std::to_string(r.units));
+    jw.keyInt("samples", static_cast<int>(r.ns.size()));
+
+    std::ostringstream lat;
+    lat << "{\"min\": " << number(r.ns.front() / 1e3) << ", \"mean\": " << number(mean / 1e3)
+        << ", \"p50\": " << number(percentile(r.ns, 50) / 1e3) << ", \"p90\": " << number(percentile(r.ns, 90) / 1e3)
+        << ", \"p99\": " << number(percentile(r.ns, 99) / 1e3) << ", \"max\": " << number(r.ns.back() / 1e3) << "}";
+    jw.keyRaw("latencyUs", lat.str());
+
+    // at the mean latency
+    const double perSec = mean > 0 ? 1e9 / mean : 0;
+    std::ostringstream tp;
+    tp << "{\"unitsPerSec\": " << number(static_cast<double>(r.units) * perSec)
+       << ", \"bytesPerSec\": " << number(static_cast<double>(w.text.size()) * perSec) << "}";
+    jw.keyRaw("throughput", tp.str());
+
+    jw.keyRaw("peakRssKb", std::to_string(r.peakRssKb));
+    jw.elementObjectEnd();
+}
+
+// ---------- perf regression check ----------
+// rc_parser runs with --stats on a program written to the work dir; its
+// output goes to a file next to it, and the last "peakRssKb" in there is
+// its peak RSS (not wait4's, which on Linux also counts this process:
+// the child shares our memory until it execs). Simulations use --race
+// left, so the steps (counted here, in process) are the same every run;
+// steps per second divide them by the "simulate" phase of the report.
+struct PerfCase {
+    const char* name;
+    const char* command; // of rc_parser
+    const char* workload;
+    uint32_t statements;
+};
+
+const PerfCase kPerfCases[] = {
+    {"parse_mixed", "parse", "mixed", 50000},
+    {"ast_json_mixed", "ast", "mixed", 20000},
+    {"simulate_mixed", "simulate", "mixed", 50000},
+    {"simulate_races", "simulate", "races", 50000},
+    {"simulate_calls", "simulate", "calls", 5000},
+};
+
+constexpr uint64_t kPerfSeed = 1;
+constexpr const char* kPerfMaxSteps = "1000000000";
+
+struct PerfLimits {
+    int wallTolerancePercent = 50;  // also for steps per second
+    int rssTolerancePercent = 25;
+    double wallSlackMs = 10;        // absolute, for the short cases (also the simulate phase)
+    uint64_t rssSlackKb = 8192;
+};
+
+struct PerfMeasure {
+    double wallMs = 0;       // median of the runs
+    uint64_t steps = 0;      // simulate only
+    double stepsPerSec = 0;  // over the median simulate phase
+    uint64_t peakRssKb = 0;  // largest of the runs
+};
+
+// wall time of one run; stdout and stderr go to outPath
+int64_t runChild(const std::vector<std::string>& args, const std::string& outPath) {
+#if RC_HAVE_SPAWN
+    std::vector<char*> argv;
+    for (const std::string& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_adddup2(&actions, 1, 2);
+
+    const auto t0 = std::chrono::steady_clock::now();
+    pid_t pid = 0;
+    const int rc = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) throw std::runtime_error("Cannot run " + args[0] + ": " + std::strerror(rc));
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) throw std::runtime_error("waitpid failed for " + args[0]);
+    const auto t1 = std::chrono::steady_clock::now();
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::string cmd;
+        for (const std::string& a : args) cmd += (cmd.empty() ? "" : " ") + a;
+        throw std::runtime_error("command failed (output in " + outPath + "): " + cmd);
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+#else
+    (void)outPath;
+    throw std::runtime_error("--perf needs posix_spawn: " + args[0]);
+#endif
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) throw std::runtime_error("Cannot open file: " + path);
+    std::ostringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+}
+
+// the value after the last "peakRssKb" of a --stats report (text or JSON)
+uint64_t reportedPeakRss(const std::string& outPath) {
+    const std::string text = readFile(outPath);
+    const size_t at = text.rfind("peakRssKb");
+    if (at == std::string::npos) throw std::runtime_error("no peakRssKb in the --stats output: " + outPath);
+    size_t i = at + 9;
+    while (i < text.size() && (text[i] == '"' || text[i] == ':' || text[i] == ' ')) ++i;
+    return std::strtoull(text.c_str() + i, nullptr, 10);
+}
+
+// the "simulate" phase of a --stats report, in microseconds: the last
+// "  simulate  <us> us" line (text) or "simulate": <us> (JSON)
+double reportedSimulateUs(const std::string& outPath) {
+    const std::string text = readFile(outPath);
+    size_t at = text.rfind("\n  simulate ");
+    if (at == std::string::npos) at = text.rfind("\"simulate\":");
+    if (at == std::string::npos) throw std::runtime_error("no simulate time in the --stats output: " + outPath);
+    size_t i = text.find("simulate", at) + 8;
+    while (i < text.size() && (text[i] == '"' || text[i] == ':' || text[i] == ' ')) ++i;
+    return std::strtod(text.c_str() + i, nullptr);
+}
+
+PerfMeasure measurePerf(const PerfCase& pc, const BenchOptions& opt) {
+    const Workload w = makeWorkload(pc.workload, pc.statements, kPerfSeed);
+
+    const std::string path = opt.workDir + "/perf_" + pc.name + ".rc";
+    {
+        std::ofstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("Cannot open output file: " + path);
+        f << w.text;
+        if (!f) throw std::runtime_error("Cannot write " + path);
+    }
+
+    std::vector<std::string> args{opt.rcParser, pc.command, path, "--stats"};
+    uint64_t steps = 0;
+    if (std::string(pc.command) == "simulate") {
+        args.insert(args.end(), {"--quiet", "--race", "left", "--max-steps", kPerfMaxSteps});
+
+        sim::SimOptions so = simOptions(kPerfSeed);
+        so.racePolicy = sim::RacePolicy::Left;
+        so.maxSteps = std::stoull(kPerfMaxSteps);
+        const sim::SimulationResult r = sim::Simulator::run(w.module, so);
+        if (!r.ok) throw std::runtime_error(std::string("simulation of ") + pc.name + " failed");
+        steps = r.steps;
+    } else if (std::string(pc.command) == "ast") {
+        args.push_back("--json");
+    } else {
+        args.push_back("--quiet");
+    }
+
+    const std::string outPath = opt.workDir + "/perf_" + pc.name + ".out";
+    std::vector<int64_t> ns;
+    std::vector<double> simulateUs;
+    PerfMeasure m;
+    for (uint32_t i = 0; i < opt.runs; ++i) {
+        ns.push_back(runChild(args, outPath));
+        m.peakRssKb = std::max(m.peakRssKb, reportedPeakRss(outPath));
+        if (steps) simulateUs.push_back(reportedSimulateUs(outPath));
+    }
+    std::sort(ns.begin(), ns.end());
+    m.wallMs = static_cast<double>(ns[ns.size() / 2]) / 1e6;
+    if (steps) {
+        m.steps = steps;
+        std::sort(simulateUs.begin(), simulateUs.end());
+        const double us = simulateUs[simulateUs.size() / 2];
+        if (us > 0) m.stepsPerSec = static_cast<double>(steps) * 1e6 / us;
+    }
+    return m;
+}
+
+double numberOf(const json::Value* v) {
+    return (v && v->type == json::Value::Type::Number) ? std::stod(v->text) : 0;
+}
+
+PerfLimits readLimits(const json::Value& doc) {
+    PerfLimits l;
+    if (const json::Value* v = doc.find("wallTolerancePercent")) l.wallTolerancePercent = static_cast<int>(numberOf(v));
+    if (const json::Value* v = doc.find("rssTolerancePercent")) l.rssTolerancePercent = static_cast<int>(numberOf(v));
+    if (const json::Value* v = doc.find("wallSlackMs")) l.wallSlackMs = numberOf(v);
+    if (const json::Value* v = doc.find("rssSlackKb")) l.rssSlackKb = static_cast<uint64_t>(numberOf(v));
+    return l;
+}
+
+// one line of the report; false on a regression
+bool checkLine(const char* what, double value, double base, double limit, bool higherIsWorse, const char* unit) {
+    const bool ok = higherIsWorse ? value <= limit : value >= limit;
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "  %-9s %14.3f %-3s baseline %14.3f  limit %s%14.3f  %s\n", what, value, unit, base,
+                  higherIsWorse ? "<=" : ">=", limit, ok ? "ok" : "REGRESSION");
+    std::cout << buf;
+    return ok;
+}
+
+int runPerfCheck(const BenchOptions& opt) {
+    const PerfCase* pc = nullptr;
+    for (const PerfCase& c : kPerfCases) {
+        if (opt.perfCase == c.name) pc = &c;
+    }
+    if (!pc) throw std::runtime_error("Unknown perf case: " + opt.perfCase);
+
+    const std::string text = readFile(opt.baselinePath);
+    const json::Value doc = json::Reader(text).parseDocument();
+
+    // the numbers only mean something for the configuration they came from
+    const json::Value* config = doc.find("config");
+    const std::string baseConfig = config && config->isString() ? config->text : "";
+    if (baseConfig != RC_BUILD_CONFIG) {
+        std::cout << "skipped: the baseline is for " << (baseConfig.empty() ? "<none>" : baseConfig)
+                  << " builds, this is " << (*RC_BUILD_CONFIG ? RC_BUILD_CONFIG : "<none>") << "\n";
+        return 77;
+    }
+
+    const json::Value* base = nullptr;
+    if (const json::Value* cases = doc.find("cases"); cases && cases->isArray()) {
+        for (const json::Value& c : cases->items) {
+            const json::Value* name = c.find("name");
+            if (name && name->isString() && name->text == pc->name) base = &c;
+        }
+    }
+    if (!base) {
+        throw std::runtime_error(std::string("No baseline for ") + pc->name + " in " + opt.baselinePath +
+                                 " (rc_bench --perf-update)");
+    }
+
+    PerfLimits limits = readLimits(doc);
+    if (opt.tolerance >= 0) limits.wallTolerancePercent = opt.tolerance;
+    const double slow = 1 + limits.wallTolerancePercent / 100.0;
+
+    const PerfMeasure m = measurePerf(*pc, opt);
+    std::cout << pc->name << ": rc_parser " << pc->command << ", " << pc->workload << " workload, "
+              << pc->statements << " statements, " << opt.runs << " runs\n";
+
+    bool ok = true;
+    const double baseWall = numberOf(base->find("wallMs"));
+    ok &= checkLine("wall", m.wallMs, baseWall, baseWall * slow + limits.wallSlackMs, true, "ms");
+
+    const double baseSteps = numberOf(base->find("stepsPerSec"));
+    if (m.stepsPerSec > 0 && baseSteps > 0) {
+        // the simulate phase may take as much longer as the wall time
+        const double baseSec = static_cast<double>(m.steps) / baseSteps;
+        const double limit = static_cast<double>(m.steps) / (baseSec * slow + limits.wallSlackMs / 1e3);
+        ok &= checkLine("steps/s", m.stepsPerSec, baseSteps, limit, false, "");
+    }
+
+    const double baseRss = numberOf(base->find("peakRssKb"));
+    ok &= checkLine("peak RSS", static_cast<double>(m.peakRssKb), baseRss,
+                    baseRss * (1 + limits.rssTolerancePercent / 100.0) + static_cast<double>(limits.rssSlackKb), true,
+                    "KB");
+    return ok ? 0 : 1;
+}
+
+// measures every case and rewrites the baseline, keeping its limits
+int runPerfUpdate(const BenchOptions& opt) {
+    PerfLimits limits;
+    std::ifstream existing(opt.baselinePath, std::ios::binary);
+    if (existing) {
+        existing.close();
+        limits = readLimits(json::Reader(readFile(opt.baselinePath)).parseDocument());
+    }
+
+    std::ostringstream out;
+    json::Writer jw(out);
+    jw.beginObject();
+    jw.keyString("config", RC_BUILD_CONFIG);
+    jw.keyInt("wallTolerancePercent", limits.wallTolerancePercent);
+    jw.keyInt("rssTolerancePercent", limits.rssTolerancePercent);
+    jw.keyRaw("wallSlackMs", number(limits.wallSlackMs));
+    jw.keyRaw("rssSlackKb", std::to_string(limits.rssSlackKb));
+    jw.beginArray("cases");
+    for (const PerfCase& pc : kPerfCases) {
+        const PerfMeasure m = measurePerf(pc, opt);
+        if (!opt.quiet) std::cerr << pc.name << ": " << number(m.wallMs) << " ms, " << m.peakRssKb << " KB\n";
+
+        jw.elementObjectBegin();
+        jw.keyString("name", pc.name);
+        jw.keyRaw("wallMs", number(m.wallMs));
+        if (m.stepsPerSec > 0) jw.keyRaw("stepsPerSec", number(m.stepsPerSec));
+        jw.keyRaw("peakRssKb", std::to_string(m.peakRssKb));
+        jw.elementObjectEnd();
+    }
+    jw.endArray();
+    jw.endObject();
+    out << "\n";
+
+    std::ofstream f(opt.baselinePath, std::ios::binary);
+    if (!f) throw std::runtime_error("Cannot open output file: " + opt.baselinePath);
+    f << out.str();
+    return f ? 0 : 1;
+}
+
+void printUsage(std::ostream& os) {
+    const BenchOptions d;
+    os
+        << "rc_bench - throughput and latency of the rc_parser phases\n\n"
+        << "Usage:\n"
+        << "  rc_bench [--sizes N,N,...] [--seed S] [--filter TEXT] [--min-samples N]\n"
+        << "           [--max-samples N] [--min-time MS] [--quiet] [-o FILE]\n"
+        << "  rc_bench --perf CASE --baseline FILE --rc-parser PATH [--work-dir DIR] [--runs N]\n"
+        << "           [--tolerance PCT]\n"
+        << "  rc_bench --perf-update FILE --rc-parser PATH [--work-dir DIR] [--runs N]\n\n"
+        << "Workloads (programs from rc_gen, one per size in statements):\n"
+        << "  mixed   default rc_gen settings\n"
+        << "  races   main only, race groups with discharge throughout\n"
+        << "  calls   deep call graph (depth 6, 3 calls per body) and recursion\n"
+        << "Benchmarks: lex, parse_fast, parse_antlr (SLL), build (AstBuilderVisitor),\n"
+        << "validate, astjson, compile, simulate (no trace).\n\n"
+        << "Options:\n"
+        << "  --sizes N,...     Program sizes in statements (default 1000,10000,100000)\n"
+        << "  --seed S          Generator and race policy seed (default " << d.seed << ")\n"
+        << "  --filter TEXT     Only benchmarks whose \"workload/size/name\" contains TEXT\n"
+        << "  --min-samples N   Samples per benchmark, at least (default " << d.minSamples << ")\n"
+        << "  --max-samples N   Samples per benchmark, at most (default " << d.maxSamples << ")\n"
+        << "  --min-time MS     Keep sampling until MS milliseconds were measured (default "
+        << d.minTimeMs << ")\n"
+        << "  --quiet           No progress lines on stderr\n"
+        << "  -o FILE           Write the JSON report to FILE (default stdout)\n\n"
+        << "Perf regression check (exit 1 on a regression, 77 when the baseline is\n"
+        << "for another build configuration):\n"
+        << "  --perf CASE       Run rc_parser on the case's program (written to the work dir)\n"
+        << "                    and compare with the baseline\n"
+        << "                    Cases:";
+    for (const PerfCase& c : kPerfCases) os << " " << c.name;
+    os
+        << "\n"
+        << "  --baseline FILE   Expected wall time, steps/s and peak RSS per case, and the\n"
+        << "                    tolerances\n"
+        << "  --perf-update F   Measure every case and write baseline F (keeps its tolerances)\n"
+        << "  --rc-parser PATH  rc_parser executable\n"
+        << "  --work-dir DIR    Where the generated programs go (default .)\n"
+        << "  --runs N          Runs per case; the median wall time counts (default " << d.runs << ")\n"
+        << "  --tolerance PCT   Allowed slowdown in percent, instead of the baseline's\n";
+}
+
+bool parseU64(const std::string& s, uint64_t& out) {
+    try {
+        size_t idx = 0;
+        unsigned long long v = std::stoull(s, &idx, 10);
+        if (idx != s.size()) return false;
+        out = static_cast<uint64_t>(v);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool parseSizes(const std::string& s, std::vector<uint32_t>& out) {
+    out.clear();
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        uint64_t v = 0;
+        if (!parseU64(item, v) || v == 0 || v > 100000000) return false;
+        out.push_back(static_cast<uint32_t>(v));
+    }
+    return !out.empty();
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& opt, bool& help) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        if (a == "--help" || a == "-h") { help = true; continue; }
+        if (a == "--quiet") { opt.quiet = true; continue; }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << a << "\n";
+            return false;
+        }
+        const std::string v = argv[++i];
+        uint64_t n = 0;
+        if (a == "--sizes") {
+            if (!parseSizes(v, opt.sizes)) { std::cerr << "Invalid --sizes value\n"; return false; }
+        } else if (a == "--seed") {
+            if (!parseU64(v, opt.seed)) { std::cerr << "Invalid --seed value\n"; return false; }
+        } else if (a == "--filter") {
+            opt.filter = v;
+        } else if (a == "--min-samples" || a == "--max-samples" || a == "--min-time") {
+            if (!parseU64(v, n) || n > 1000000) { std::cerr << "Invalid " << a << " value\n"; return false; }
+            if (a == "--min-samples") opt.minSamples = static_cast<uint32_t>(n);
+            else if (a == "--max-samples") opt.maxSamples = static_cast<uint32_t>(std::max<uint64_t>(n, 1));
+            else opt.minTimeMs = static_cast<uint32_t>(n);
+        } else if (a == "-o") {
+            opt.outPath = v;
+        } else if (a == "--perf") {
+            opt.perfCase = v;
+        } else if (a == "--baseline") {
+            opt.baselinePath = v;
+        } else if (a == "--perf-update") {
+            opt.baselinePath = v;
+            opt.perfUpdate = true;
+        } else if (a == "--rc-parser") {
+            opt.rcParser = v;
+        } else if (a == "--work-dir") {
+            opt.workDir = v;
+        } else if (a == "--runs") {
+            if (!parseU64(v, n) || n == 0 || n > 1000) { std::cerr << "Invalid --runs value\n"; return false; }
+            opt.runs = static_cast<uint32_t>(n);
+        } else if (a == "--tolerance") {
+            if (!parseU64(v, n) || n > 10000) { std::cerr << "Invalid --tolerance value\n"; return false; }
+            opt.tolerance = static_cast<int>(n);
+        } else {
+            std::cerr << "Unknown option: " << a << "\n";
+            return false;
+        }
+    }
+    const bool perf = !opt.perfCase.empty();
+    if (perf && opt.perfUpdate) {
+        std::cerr << "--perf and --perf-update cannot be combined\n";
+        return false;
+    }
+    if (perf && opt.baselinePath.empty()) {
+        std::cerr << "Missing --baseline\n";
+        return false;
+    }
+    if ((perf || opt.perfUpdate) && opt.rcParser.empty()) {
+        std::cerr << "Missing --rc-parser\n";
+        return false;
+    }
+    return true;
+}
+
+int runBench(const BenchOptions& opt) {
+    std::ofstream file;
+    if (!opt.outPath.empty()) {
+        file.open(opt.outPath, std::ios::binary);
+        if (!file) throw std::runtime_error("Cannot open output file: " + opt.outPath);
+    }
+    std::ostream& out = opt.outPath.empty() ? std::cout : file;
+
+    json::Writer jw(out);
+    jw.beginObject();
+    jw.keyString("tool", "rc_bench");
+    jw.keyRaw("seed", std::to_string(opt.seed));
+    jw.keyInt("minSamples", static_cast<int>(opt.minSamples));
+    jw.keyInt("minTimeMs", static_cast<int>(opt.minTimeMs));
+    jw.beginArray("results");
+    uint64_t peak = 0;
+
+    for (uint32_t size : opt.sizes) {
+        for (const char* wname : kWorkloads) {
+            std::unique_ptr<Workload> w;
+            uint64_t steps = 0;
+
+            for (const Bench& b : kBenches) {
+                const std::string id = std::string(wname) + "/" + std::to_string(size) + "/" + b.name;
+                if (!opt.filter.empty() && id.find(opt.filter) == std::string::npos) continue;
+
+                if (!w) {
+                    w = std::make_unique<Workload>(makeWorkload(wname, size, opt.seed));
+                    steps = simulatedSteps(*w, opt);
+                }
+
+                Result r;
+                r.name = b.name;
+                r.workload = w.get();
+                r.unit = b.unit;
+                r.units = b.units ? b.units(*w) : steps;
+
+                resetPeakRss();
+                {
+                    const std::function<uint64_t()> f = b.prepare(*w, opt);
+                    r.ns = measure(opt, f);
+                }
+                r.peakRssKb = RunStats::peakRssKb();
+                peak = std::max(peak, r.peakRssKb);
+
+                writeResult(jw, r);
+                out.flush();
+                if (!opt.quiet) {
+                    std::cerr << id << ": p50 " << number(percentile(r.ns, 50) / 1e3) << " us, "
+                              << number(static_cast<double>(r.units) * 1e9 / meanNs(r.ns)) << " " << r.unit
+                              << "/s\n";
+                }
+            }
+        }
+    }
+
+    jw.endArray();
+    jw.keyRaw("peakRssKb", std::to_string(std::max(peak, RunStats::peakRssKb())));
+    jw.endObject();
+    out << "\n";
+    return out ? 0 : 1;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    bool help = false;
+    if (!parseOptions(argc, argv, opt, help)) {
+        printUsage(std::cerr);
+        return 2;
+    }
+    if (help) {
+        printUsage(std::cout);
+        return 0;
+    }
+
+    try {
+        if (!opt.perfCase.empty()) return runPerfCheck(opt);
+        if (opt.perfUpdate) return runPerfUpdate(opt);
+        return runBench(opt);
+    } catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,131 @@
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "gen/Generator.h"
+
+static void printUsage(std::ostream& os) {
+    const gen::GenOptions d;
+    os
+        << "rc_gen - synthetic Racing Choreographies programs for scaling tests\n\n"
+        << "Usage:\n"
+        << "  rc_gen [options] [-o FILE]\n\n"
+        << "Writes one program to FILE (default stdout). The same options and seed\n"
+        << "always give the same program, on every platform.\n\n"
+        << "Options:\n"
+        << "  --seed N               Random seed (default " << d.seed << ")\n"
+        << "  --processes N          Global processes p0.. (default " << d.processes << ", at least 2)\n"
+        << "  --vars N               Int variables x0.. per process (default " << d.vars << ")\n"
+        << "  --statements N         Statements in total, approximate (default " << d.statements << ")\n"
+        << "  --procedures N         Non-recursive procedures (default " << d.procedures << ")\n"
+        << "  --max-arity N          Parameters of a procedure, 1..N (default " << d.maxArity << ")\n"
+        << "  --call-depth N         Levels of the call graph below main (default " << d.callDepth << ")\n"
+        << "  --calls N              Calls per body, to the next level (default " << d.callsPerBody << ")\n"
+        << "  --recursive N          Recursive procedures (default " << d.recursive << ")\n"
+        << "  --recursion-depth N    Self calls per activation chain, at most --processes (default "
+        << d.recursionDepth << ")\n"
+        << "  --if-depth N           Nesting of local ifs (default " << d.ifDepth << ")\n"
+        << "  --if-percent N         Statements that open a local if (default " << d.ifPercent << ")\n"
+        << "  --race-percent N       Statements of main in race groups (default " << d.racePercent << ")\n"
+        << "  --discharge-percent N  Race groups that branch on the race and discharge it (default "
+        << d.dischargePercent << ")\n"
+        << "  -o FILE                Output file\n\n"
+        << "Steps executed grow with calls^call-depth: raise rc_parser simulate --max-steps\n"
+        << "for large settings.\n";
+}
+
+static bool parseU64(const std::string& s, uint64_t& out) {
+    try {
+        size_t idx = 0;
+        unsigned long long v = std::stoull(s, &idx, 10);
+        if (idx != s.size()) return false;
+        out = static_cast<uint64_t>(v);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+int main(int argc, char** argv) {
+    gen::GenOptions opt;
+    std::string outPath;
+
+    struct Knob {
+        const char* name;
+        uint32_t* value;
+        uint64_t max;
+    };
+    const Knob knobs[] = {
+        {"--processes", &opt.processes, 100000},
+        {"--vars", &opt.vars, 100000},
+        {"--statements", &opt.statements, 100000000},
+        {"--procedures", &opt.procedures, 1000000},
+        {"--max-arity", &opt.maxArity, 1000},
+        {"--call-depth", &opt.callDepth, 1000},
+        {"--calls", &opt.callsPerBody, 1000},
+        {"--recursive", &opt.recursive, 1000000},
+        {"--recursion-depth", &opt.recursionDepth, 1000},
+        {"--if-depth", &opt.ifDepth, 100},
+        {"--if-percent", &opt.ifPercent, 100},
+        {"--race-percent", &opt.racePercent, 100},
+        {"--discharge-percent", &opt.dischargePercent, 100},
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+
+        if (a == "--help" || a == "-h") {
+            printUsage(std::cout);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << a << "\n";
+            printUsage(std::cerr);
+            return 2;
+        }
+        const std::string v = argv[++i];
+
+        if (a == "-o") {
+            outPath = v;
+            continue;
+        }
+        if (a == "--seed") {
+            if (!parseU64(v, opt.seed)) {
+                std::cerr << "Invalid --seed value\n";
+                return 2;
+            }
+            continue;
+        }
+
+        const Knob* knob = nullptr;
+        for (const Knob& k : knobs) {
+            if (a == k.name) knob = &k;
+        }
+        if (!knob) {
+            std::cerr << "Unknown option: " << a << "\n";
+            printUsage(std::cerr);
+            return 2;
+        }
+        uint64_t n = 0;
+        if (!parseU64(v, n) || n > knob->max) {
+            std::cerr << "Invalid " << a << " value\n";
+            return 2;
+        }
+        *knob->value = static_cast<uint32_t>(n);
+    }
+
+    const std::string text = gen::generate(opt);
+
+    if (outPath.empty()) {
+        std::cout << text;
+        return std::cout ? 0 : 1;
+    }
+    std::ofstream out(outPath, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error: Cannot open output file: " << outPath << "\n";
+        return 2;
+    }
+    out << text;
+    return out ? 0 : 1;
+}